@@ -0,0 +1,352 @@
+/*	Target side application for the Rich Viewer.
+	Copyright (C) 2008 Supercomputing Systems AG
+
+	This library is free software; you can redistribute it and/or modify it
+	under the terms of the GNU Lesser General Public License as published by
+	the Free Software Foundation; either version 2.1 of the License, or (at
+	your option) any later version.
+
+	This library is distributed in the hope that it will be useful, but
+	WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser
+	General Public License for more details.
+
+	You should have received a copy of the GNU Lesser General Public License
+	along with this library; if not, write to the Free Software Foundation,
+	Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+/*! @file bench.c
+ * @brief Host benchmark of the image processing stages.
+ *
+ * Runs the per-frame processing (statistics and renditions) on a
+ * synthetic image with 1 to N workers and reports the time per frame,
+ * the speedup and the scaling efficiency.
+ *
+ * Then runs a chain of pixel stages (look-up table, decimation, debayer
+ * and statistics of the decimated image) through the processing pipeline,
+ * once stage by stage on the whole frame and once fused strip by strip,
+ * and reports the time per stage and the memory traffic of both. The
+ * memory traffic is modelled, not measured: On the whole frame, every
+ * stage reads its input from and writes its output to memory. Fused, only
+ * the raw image is read from memory, the intermediate images are read
+ * from the cache right after they have been written.
+ *
+ * Usage: rich-view-bench_host [max workers] [frames]
+ */
+
+#include "inc/oscar.h"
+#include "statistics.h"
+#include "rendition.h"
+#include "timing.h"
+#include "workpool.h"
+#include "pipeline.h"
+#include "pixops.h"
+#include "communication.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*! @brief Width of the benchmark image. */
+#define BENCH_WIDTH OSC_CAM_MAX_IMAGE_WIDTH
+/*! @brief Height of the benchmark image. */
+#define BENCH_HEIGHT OSC_CAM_MAX_IMAGE_HEIGHT
+/*! @brief Default number of frames processed per worker count. */
+#define BENCH_FRAMES 500
+
+/*! @brief The framework module dependencies of the benchmark. */
+static struct OSC_DEPENDENCY deps[] = {
+	{"log", OscLogCreate, OscLogDestroy},
+	{"sup", OscSupCreate, OscSupDestroy}
+};
+
+/*! @brief The benchmark image. */
+static uint8 img[BENCH_WIDTH*BENCH_HEIGHT];
+/*! @brief The renditions. */
+static struct RendSet rends;
+/*! @brief Scratch space of the statistics. */
+static struct StatAccu statAccu[POOL_MAX_WORKERS];
+/*! @brief The statistics record. */
+static struct FeedStats stats;
+/*! @brief The chain of pixel stages. */
+static struct Pipeline pixPipe;
+/*! @brief Look-up table of the pixel stages. */
+static struct PixLut lut;
+/*! @brief Statistics of the pixel stages. */
+static struct PixStats pixStats;
+/*! @brief The debayered image of the whole frame run, to check the fused
+  run against. */
+static uint8 rgbImg[(BENCH_WIDTH/2)*(BENCH_HEIGHT/2)*3];
+
+/*********************************************************************//*!
+ * @brief Process a number of frames and measure the time.
+ *
+ * @param nFrames Number of frames.
+ * @param pRois The regions of interest of the statistics.
+ * @return Time per frame (us).
+ *//*********************************************************************/
+static uint32 Bench_Run(uint32 nFrames, const struct StatRoi *pRois)
+{
+	uint64 start;
+	uint32 i;
+
+	start = OscSupCycGet64();
+	for(i = 0; i < nFrames; i++)
+	{
+		Stat_Compute(&stats, statAccu, img, BENCH_WIDTH, BENCH_HEIGHT, pRois);
+		Rend_Produce(&rends, img, BENCH_WIDTH, BENCH_HEIGHT,
+			     1 << REND_QUARTER | 1 << REND_SIXTEENTH);
+	}
+	return Timing_CycToUs(OscSupCycGet64() - start)/nFrames;
+}
+
+/*********************************************************************//*!
+ * @brief Set up the chain of pixel stages.
+ *
+ * @param pRois The regions of interest of the statistics, in raw image
+ *              coordinates.
+ * @return SUCCESS or an appropriate error code.
+ *//*********************************************************************/
+static OSC_ERR Bench_SetupPipe(const struct StatRoi *pRois)
+{
+	OSC_ERR err;
+	uint32 i;
+
+	/* A contrast stretch. */
+	for(i = 0; i < 256; i++)
+	{
+		lut.lut[i] = (uint8)(i < 32 ? 0 : (i >= 224 ? 255 : (i - 32)*255/192));
+	}
+	/* The statistics are of the decimated image. */
+	for(i = 0; i < STAT_MAX_ROIS; i++)
+	{
+		pixStats.rois[i].x = pRois[i].x/2;
+		pixStats.rois[i].y = pRois[i].y/2;
+		pixStats.rois[i].width = pRois[i].width/2;
+		pixStats.rois[i].height = pRois[i].height/2;
+	}
+
+	Pipe_Init(&pixPipe);
+	err = Pipe_AddStripStage(&pixPipe, "lut", Pix_LutStrip, &lut, PIPE_INPUT_RAW, 1, 1);
+	err |= Pipe_AddStripStage(&pixPipe, "decimate", Pix_DecimateStrip, NULL, 0, 1, 2);
+	err |= Pipe_AddStripStage(&pixPipe, "debayer", Pix_DebayerStrip, NULL, 0, 3, 2);
+	err |= Pipe_AddStripStage(&pixPipe, "stats", Pix_StatsStrip, &pixStats, 1, 0, 1);
+	return err;
+}
+
+/*********************************************************************//*!
+ * @brief Get the modelled memory traffic of the chain of pixel stages.
+ *
+ * @param bFused TRUE for the fused run.
+ * @return Bytes read from and written to memory per frame.
+ *//*********************************************************************/
+static uint32 Bench_Traffic(bool bFused)
+{
+	const struct PipeStage *pStage;
+	const struct PipeStage *pInput;
+	uint32 i, bytes = 0;
+
+	if(bFused)
+	{
+		bytes = BENCH_WIDTH*BENCH_HEIGHT;
+	}
+	for(i = 0; i < pixPipe.nStages; i++)
+	{
+		pStage = &pixPipe.stages[i];
+		bytes += pStage->out.width*pStage->out.height*pStage->outBpp;
+		if(bFused)
+		{
+			continue;
+		}
+		if(pStage->input == PIPE_INPUT_RAW)
+		{
+			bytes += BENCH_WIDTH*BENCH_HEIGHT;
+		} else {
+			pInput = &pixPipe.stages[pStage->input];
+			bytes += pInput->out.width*pInput->out.height*pInput->outBpp;
+		}
+	}
+	return bytes;
+}
+
+/*********************************************************************//*!
+ * @brief Run the chain of pixel stages on a number of frames and report
+ * the time per stage.
+ *
+ * @param pFrame The frame.
+ * @param nFrames Number of frames.
+ * @param bFused TRUE to fuse the stages, FALSE to run them on the whole
+ *               frame.
+ * @return Time per frame (us).
+ *//*********************************************************************/
+static uint32 Bench_RunPipe(const struct FrameDesc *pFrame, uint32 nFrames, bool bFused)
+{
+	uint64 start;
+	uint32 i, us;
+
+	pixPipe.bStrips = bFused;
+	/* Warm up the caches and allocate the buffers. */
+	for(i = 0; i < nFrames/10 + 1; i++)
+	{
+		Pipe_Run(&pixPipe, pFrame);
+	}
+	Pipe_ResetStats(&pixPipe);
+
+	start = OscSupCycGet64();
+	for(i = 0; i < nFrames; i++)
+	{
+		Pipe_Run(&pixPipe, pFrame);
+	}
+	us = Timing_CycToUs(OscSupCycGet64() - start)/nFrames;
+
+	printf("%-11s  %8d", bFused ? "strips" : "whole frame", us);
+	for(i = 0; i < pixPipe.nStages; i++)
+	{
+		printf("  %8d", Pipe_MeanUs(&pixPipe.stages[i]));
+	}
+	printf("  %6d  %8d\n", bFused ? pixPipe.nStrips : 1, Bench_Traffic(bFused)/1024);
+	return us;
+}
+
+/*********************************************************************//*!
+ * @brief Benchmark the chain of pixel stages on the whole frame and
+ * fused.
+ *
+ * @param pRois The regions of interest of the statistics.
+ * @param nFrames Number of frames.
+ *//*********************************************************************/
+static void Bench_Pixels(const struct StatRoi *pRois, uint32 nFrames)
+{
+	struct FrameDesc frame;
+	struct FeedStats wholeStats;
+	uint32 i;
+
+	/* The raw image is taken as a bayer image. */
+	if(Bench_SetupPipe(pRois) != SUCCESS)
+	{
+		fprintf(stderr, "%s: Unable to set up the pixel stages.\n", __func__);
+		return;
+	}
+	memset(&frame, 0, sizeof(frame));
+	frame.pImg = img;
+	frame.feedHdr.imgWidth = BENCH_WIDTH;
+	frame.feedHdr.imgHeight = BENCH_HEIGHT;
+	frame.feedHdr.pixFmt = V4L2_PIX_FMT_SBGGR8;
+
+	printf("\n%dx%d, %d frames: look-up table, decimation, debayer, "
+	       "statistics (traffic modelled)\n", BENCH_WIDTH, BENCH_HEIGHT, nFrames);
+	printf("mode         us/frame");
+	for(i = 0; i < pixPipe.nStages; i++)
+	{
+		printf("  %8s", pixPipe.stages[i].strName);
+	}
+	printf("  strips  kB/frame\n");
+	Bench_RunPipe(&frame, nFrames, FALSE);
+	wholeStats = pixStats.stats;
+	memcpy(rgbImg, pixPipe.stages[2].out.pData, sizeof(rgbImg));
+	Bench_RunPipe(&frame, nFrames, TRUE);
+	if(memcmp(&wholeStats, &pixStats.stats, sizeof(wholeStats)) != 0 ||
+	   memcmp(rgbImg, pixPipe.stages[2].out.pData, sizeof(rgbImg)) != 0)
+	{
+		fprintf(stderr, "%s: The fused stages computed a different result!\n",
+			__func__);
+	}
+	Pipe_DeInit(&pixPipe);
+}
+
+/*********************************************************************//*!
+ * @brief Program entry.
+ *
+ * @param argc Command line argument count.
+ * @param argv Command line argument strings.
+ * @return 0 on success
+ *//*********************************************************************/
+int main(const int argc, const char * argv[])
+{
+	void *hFramework;
+	struct StatRoi rois[STAT_MAX_ROIS];
+	uint32 i, nWorkers, maxWorkers = POOL_MAX_WORKERS, nFrames = BENCH_FRAMES;
+	uint32 us, us1 = 0;
+	OSC_ERR err;
+
+	if(argc > 1)
+	{
+		maxWorkers = atoi(argv[1]);
+	}
+	if(argc > 2)
+	{
+		nFrames = atoi(argv[2]);
+	}
+	if(maxWorkers < 1 || maxWorkers > POOL_MAX_WORKERS || nFrames < 1)
+	{
+		fprintf(stderr, "Usage: %s [max workers (1..%d)] [frames]\n",
+			argv[0], POOL_MAX_WORKERS);
+		return 1;
+	}
+
+	err = OscCreate(&hFramework);
+	if(err < 0)
+	{
+		fprintf(stderr, "%s: Unable to create framework.\n", __func__);
+		return 1;
+	}
+	err = OscLoadDependencies(hFramework, deps, sizeof(deps)/sizeof(struct OSC_DEPENDENCY));
+	if(err != SUCCESS)
+	{
+		fprintf(stderr, "%s: Unable to load dependencies! (%d)\n", __func__, err);
+		OscDestroy(hFramework);
+		return 1;
+	}
+	OscLogSetConsoleLogLevel(WARN);
+	Timing_Init();
+
+	/* A gradient with some noise, so the histogram is not degenerate. */
+	srand(1);
+	for(i = 0; i < BENCH_WIDTH*BENCH_HEIGHT; i++)
+	{
+		img[i] = (uint8)((i % BENCH_WIDTH + i/BENCH_WIDTH + (rand() & 0x1f)) & 0xff);
+	}
+	memset(rois, 0, sizeof(rois));
+	for(i = 0; i < STAT_MAX_ROIS; i++)
+	{
+		rois[i].x = i*BENCH_WIDTH/8;
+		rois[i].y = i*BENCH_HEIGHT/8;
+		rois[i].width = BENCH_WIDTH/4;
+		rois[i].height = BENCH_HEIGHT/4;
+	}
+	Rend_Init(&rends);
+
+	printf("%dx%d, %d frames: statistics, 1/4 and 1/16 renditions\n",
+	       BENCH_WIDTH, BENCH_HEIGHT, nFrames);
+	printf("workers  us/frame  speedup  efficiency\n");
+	for(nWorkers = 1; nWorkers <= maxWorkers; nWorkers++)
+	{
+		if(Pool_Init(nWorkers) != SUCCESS || Pool_Workers() != nWorkers)
+		{
+			Pool_DeInit();
+			break;
+		}
+		/* Warm up the caches and the threads. */
+		Bench_Run(nFrames/10 + 1, rois);
+		us = Bench_Run(nFrames, rois);
+		Pool_DeInit();
+
+		if(nWorkers == 1)
+		{
+			us1 = us;
+		}
+		if(us == 0)
+		{
+			us = 1;
+		}
+		printf("%7d  %8d  %5d.%02d  %9d%%\n",
+		       nWorkers, us, us1/us, (us1*100/us) % 100,
+		       us1*100/(us*nWorkers));
+	}
+
+	Bench_Pixels(rois, nFrames);
+
+	OscUnloadDependencies(hFramework, deps, sizeof(deps)/sizeof(struct OSC_DEPENDENCY));
+	OscDestroy(hFramework);
+	return 0;
+}
@@ -0,0 +1,115 @@
+/*	Target side application for the Rich Viewer.
+	Copyright (C) 2008 Supercomputing Systems AG
+
+	This library is free software; you can redistribute it and/or modify it
+	under the terms of the GNU Lesser General Public License as published by
+	the Free Software Foundation; either version 2.1 of the License, or (at
+	your option) any later version.
+
+	This library is distributed in the hope that it will be useful, but
+	WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser
+	General Public License for more details.
+
+	You should have received a copy of the GNU Lesser General Public License
+	along with this library; if not, write to the Free Software Foundation,
+	Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+/*! @file change.c
+ * @brief Scene change detection implementation.
+ */
+
+#include "change.h"
+#include <string.h>
+
+/*********************************************************************//*!
+ * @brief Count the samples of a row that differ from the reference and
+ * take them over as the new reference.
+ *
+ * The test |p - r| > CHG_NOISE is done as a single unsigned comparison
+ * without branches, so the loop can be vectorized.
+ *
+ * @param pRow Pointer to the image row.
+ * @param pRef Pointer to the reference samples of the row.
+ * @param n Number of samples.
+ * @param bUpdate If TRUE, the samples are stored as the new reference.
+ * @return Number of changed samples.
+ *//*********************************************************************/
+static uint32 Chg_Row(const uint8 *pRow, uint8 *pRef, uint32 n, bool bUpdate)
+{
+	uint32 x, nChanged = 0;
+
+	for(x = 0; x < n; x++)
+	{
+		nChanged += (uint32)(pRow[x*CHG_COL_STEP] - pRef[x] + CHG_NOISE) > 2*CHG_NOISE;
+	}
+	if(bUpdate)
+	{
+		for(x = 0; x < n; x++)
+		{
+			pRef[x] = pRow[x*CHG_COL_STEP];
+		}
+	}
+	return nChanged;
+}
+
+void Chg_Init(struct ChangeDetect *pChg)
+{
+	memset(pChg, 0, sizeof(struct ChangeDetect));
+}
+
+bool Chg_Check(struct ChangeDetect *pChg,
+	       const uint8 *pImg,
+	       uint32 width,
+	       uint32 height,
+	       uint32 timeMs,
+	       uint32 *pSuppressed)
+{
+	uint32 nCols = width/CHG_COL_STEP, nRows = height/CHG_ROW_STEP;
+	uint32 y, nChanged = 0;
+	bool bSend;
+
+	*pSuppressed = 0;
+	if(pChg->threshold == 0)
+	{
+		pChg->refWidth = 0;
+		return TRUE;
+	}
+
+	/* Without a reference of the same size, the frame is sent. */
+	bSend = pChg->refWidth != width || pChg->refHeight != height ||
+		(pChg->heartbeatMs != 0 && timeMs - pChg->refTimeMs >= pChg->heartbeatMs);
+	if(!bSend)
+	{
+		for(y = 0; y < nRows; y++)
+		{
+			nChanged += Chg_Row(pImg + (y*CHG_ROW_STEP + CHG_ROW_STEP/2)*width,
+					    pChg->ref + y*nCols,
+					    nCols,
+					    FALSE);
+		}
+		pChg->lastChange = nCols*nRows == 0 ? 0 : nChanged*1000/(nCols*nRows);
+		bSend = pChg->lastChange > pChg->threshold;
+	}
+	if(!bSend)
+	{
+		pChg->nSuppressed++;
+		pChg->nSuppressedTotal++;
+		return FALSE;
+	}
+
+	for(y = 0; y < nRows; y++)
+	{
+		Chg_Row(pImg + (y*CHG_ROW_STEP + CHG_ROW_STEP/2)*width,
+			pChg->ref + y*nCols,
+			nCols,
+			TRUE);
+	}
+	pChg->refWidth = width;
+	pChg->refHeight = height;
+	pChg->refTimeMs = timeMs;
+	*pSuppressed = pChg->nSuppressed;
+	pChg->nSuppressed = 0;
+	return TRUE;
+}
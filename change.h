@@ -0,0 +1,102 @@
+/*	Target side application for the Rich Viewer.
+	Copyright (C) 2008 Supercomputing Systems AG
+
+	This library is free software; you can redistribute it and/or modify it
+	under the terms of the GNU Lesser General Public License as published by
+	the Free Software Foundation; either version 2.1 of the License, or (at
+	your option) any later version.
+
+	This library is distributed in the hope that it will be useful, but
+	WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser
+	General Public License for more details.
+
+	You should have received a copy of the GNU Lesser General Public License
+	along with this library; if not, write to the Free Software Foundation,
+	Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+/*! @file change.h
+ * @brief Detection of scene changes to stream only frames that differ.
+ *
+ * The frame is compared with the frame sent last on a subsampled grid:
+ * every CHG_COL_STEP-th pixel of every CHG_ROW_STEP-th row. Both steps
+ * are even, so in a bayer image only pixels of the same color are
+ * compared. A sample has changed if it differs from the reference by more
+ * than CHG_NOISE, so sensor noise alone does not trigger a frame. A frame
+ * is sent if the share of changed samples exceeds the threshold, or if no
+ * frame has been sent for the heartbeat interval.
+ */
+
+#ifndef CHANGE_H
+#define CHANGE_H
+
+#include "inc/oscar.h"
+
+/*! @brief Distance of the sampled columns (pixels, even). */
+#define CHG_COL_STEP 4
+/*! @brief Distance of the sampled rows (pixels, even). */
+#define CHG_ROW_STEP 8
+/*! @brief Largest difference of a sample to the reference that is taken
+  for noise (grey levels). */
+#define CHG_NOISE 12
+/*! @brief Maximum number of samples of a frame. */
+#define CHG_MAX_SAMPLES (OSC_CAM_MAX_IMAGE_WIDTH*OSC_CAM_MAX_IMAGE_HEIGHT/(CHG_COL_STEP*CHG_ROW_STEP))
+
+/*! @brief State of the change detection. */
+struct ChangeDetect
+{
+	/*! @brief Share of changed samples above which a frame is sent (per
+	  mille), 0 to send every frame. */
+	uint32 threshold;
+	/*! @brief A frame is sent at least this often (ms), 0 for no
+	  heartbeat. */
+	uint32 heartbeatMs;
+
+	/*! @brief Samples of the frame sent last. */
+	uint8 ref[CHG_MAX_SAMPLES];
+	/*! @brief Width of the reference frame, 0 if there is none. */
+	uint32 refWidth;
+	/*! @brief Height of the reference frame. */
+	uint32 refHeight;
+	/*! @brief Time stamp of the frame sent last (ms). */
+	uint32 refTimeMs;
+
+	/*! @brief Share of changed samples of the last frame checked (per
+	  mille). */
+	uint32 lastChange;
+	/*! @brief Number of frames suppressed since the frame sent last. */
+	uint32 nSuppressed;
+	/*! @brief Total number of frames suppressed. */
+	uint32 nSuppressedTotal;
+};
+
+/*********************************************************************//*!
+ * @brief Initialize the change detection; every frame is sent.
+ *
+ * @param pChg Pointer to the change detection.
+ *//*********************************************************************/
+void Chg_Init(struct ChangeDetect *pChg);
+
+/*********************************************************************//*!
+ * @brief Decide whether a frame is sent.
+ *
+ * A frame that is sent becomes the new reference.
+ *
+ * @param pChg Pointer to the change detection.
+ * @param pImg Pointer to the image.
+ * @param width Width of the image.
+ * @param height Height of the image.
+ * @param timeMs Time stamp of the frame (ms).
+ * @param pSuppressed Number of frames suppressed before this one, if it
+ *        is sent.
+ * @return TRUE if the frame is to be sent.
+ *//*********************************************************************/
+bool Chg_Check(struct ChangeDetect *pChg,
+	       const uint8 *pImg,
+	       uint32 width,
+	       uint32 height,
+	       uint32 timeMs,
+	       uint32 *pSuppressed);
+
+#endif /* CHANGE_H */
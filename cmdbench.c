@@ -0,0 +1,565 @@
+/*	Target side application for the Rich Viewer.
+	Copyright (C) 2008 Supercomputing Systems AG
+
+	This library is free software; you can redistribute it and/or modify it
+	under the terms of the GNU Lesser General Public License as published by
+	the Free Software Foundation; either version 2.1 of the License, or (at
+	your option) any later version.
+
+	This library is distributed in the hope that it will be useful, but
+	WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser
+	General Public License for more details.
+
+	You should have received a copy of the GNU Lesser General Public License
+	along with this library; if not, write to the Free Software Foundation,
+	Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+/*! @file cmdbench.c
+ * @brief Host tool measuring the command round-trip latency of a running
+ * rich-view.
+ *
+ * Each command client sends a mix of MSG_CMD_GET_VER,
+ * MSG_CMD_GET_COMPL_CONFIG and MSG_CMD_SET_CONFIG commands over its own
+ * connection. The latencies are measured with 1 to N concurrent clients,
+ * first without a feed connection and then while the feed is received in
+ * acquisition mode at the full frame rate. The feed can be read at a
+ * limited rate to emulate a slow link, and the synthetic frame source can
+ * be enabled to run without a camera.
+ *
+ * SET_CONFIG writes the current value of a statistics region register, so
+ * the command has no side effects on the target.
+ *
+ * Usage: rich-view-cmdbench_host [-a address] [-n commands] [-c clients]
+ *        [-r feed kB/s] [-s synthetic pattern]
+ */
+
+#include "rich-view.h"
+#include <arpa/inet.h>
+#include <pthread.h>
+
+/*! @brief Default number of commands per client and measurement. */
+#define CMDBENCH_COMMANDS 1000
+/*! @brief Size of the buffer the feed is read into. */
+#define CMDBENCH_FEED_CHUNK (16*1024)
+/*! @brief Number of different commands in the mix. */
+#define CMDBENCH_CMD_TYPES 3
+/*! @brief Register written by the SET_CONFIG commands. */
+#define CMDBENCH_SET_REG REG_ID_STAT_ROI_POS(STAT_MAX_ROIS - 1)
+
+/*! @brief The commands of the mix, sent in turn. */
+static const uint32 cmdTypes[CMDBENCH_CMD_TYPES] =
+{
+	MSG_CMD_GET_VER,
+	MSG_CMD_GET_COMPL_CONFIG,
+	MSG_CMD_SET_CONFIG
+};
+/*! @brief Names of the commands of the mix. */
+static const char *cmdNames[CMDBENCH_CMD_TYPES] =
+{
+	"GET_VER",
+	"GET_COMPL_CONFIG",
+	"SET_CONFIG"
+};
+
+/*! @brief Latency distribution of a series of commands. */
+struct LatStats
+{
+	/*! @brief Number of commands. */
+	uint32 count;
+	/*! @brief Shortest round trip (us). */
+	uint32 minUs;
+	/*! @brief Median round trip (us). */
+	uint32 medianUs;
+	/*! @brief 99th percentile of the round trips (us). */
+	uint32 p99Us;
+	/*! @brief Longest round trip (us). */
+	uint32 maxUs;
+	/*! @brief Mean round trip (us). */
+	uint32 meanUs;
+};
+
+/*! @brief A command client thread. */
+struct Client
+{
+	/*! @brief The thread. */
+	pthread_t thread;
+	/*! @brief Connected command socket. */
+	int sock;
+	/*! @brief Number of commands to send. */
+	uint32 nCmds;
+	/*! @brief Round trips of the commands by type (us). */
+	uint32 *pUs[CMDBENCH_CMD_TYPES];
+	/*! @brief Number of round trips in pUs by type. */
+	uint32 count[CMDBENCH_CMD_TYPES];
+	/*! @brief Buffer for the commands and replies. */
+	struct CommMsg *pMsg;
+	/*! @brief Result of the client. */
+	OSC_ERR err;
+};
+
+/*! @brief State of the feed reader thread. */
+static struct
+{
+	/*! @brief Connected feed socket. */
+	int sock;
+	/*! @brief Reading rate limit (bytes per second) or 0 for none. */
+	uint32 rateLimit;
+	/*! @brief Number of bytes received. */
+	uint64 nBytes;
+	/*! @brief TRUE if the thread shall terminate. */
+	volatile bool bQuit;
+} feed;
+
+/*********************************************************************//*!
+ * @brief Get the current time.
+ *
+ * @return Time in microseconds.
+ *//*********************************************************************/
+static uint64 Now(void)
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	return (uint64)tv.tv_sec*1000000 + tv.tv_usec;
+}
+
+/*********************************************************************//*!
+ * @brief Connect to a port of the target.
+ *
+ * @param strAddr IP address of the target.
+ * @param port Port number.
+ * @return The connected socket or -1.
+ *//*********************************************************************/
+static int Connect(const char *strAddr, int port)
+{
+	int sock;
+	struct sockaddr_in addr;
+
+	sock = socket(PF_INET, SOCK_STREAM, 0);
+	if(sock < 0)
+	{
+		return -1;
+	}
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons(port);
+	addr.sin_addr.s_addr = inet_addr(strAddr);
+	if(connect(sock, (struct sockaddr*)&addr, sizeof(addr)) != 0)
+	{
+		close(sock);
+		return -1;
+	}
+	return sock;
+}
+
+/*********************************************************************//*!
+ * @brief Receive exactly len bytes.
+ *
+ * @param sock The socket.
+ * @param pBuf Buffer to receive into.
+ * @param len Number of bytes.
+ * @return SUCCESS or -EDEVICE.
+ *//*********************************************************************/
+static OSC_ERR RecvAll(int sock, void *pBuf, uint32 len)
+{
+	uint8 *p = (uint8*)pBuf;
+	int retval;
+
+	while(len > 0)
+	{
+		retval = recv(sock, p, len, 0);
+		if(retval <= 0)
+		{
+			return -EDEVICE;
+		}
+		p += retval;
+		len -= retval;
+	}
+	return SUCCESS;
+}
+
+/*********************************************************************//*!
+ * @brief Send a command and wait for the reply.
+ *
+ * @param sock The command socket.
+ * @param pMsg The command; replaced by the reply.
+ * @return SUCCESS or an appropriate error code.
+ *//*********************************************************************/
+static OSC_ERR Command(int sock, struct CommMsg *pMsg)
+{
+	uint32 len = sizeof(struct MsgHdr) + pMsg->hdr.bodyLength;
+
+	pMsg->hdr.status = STATUS_REQUEST;
+	/* The target expects the whole command in one segment. */
+	if(send(sock, pMsg, len, 0) != (int)len)
+	{
+		return -EDEVICE;
+	}
+	if(RecvAll(sock, &pMsg->hdr, sizeof(struct MsgHdr)) != SUCCESS ||
+	   pMsg->hdr.bodyLength > MAX_MSG_BODY_LENGTH ||
+	   RecvAll(sock, pMsg->body, pMsg->hdr.bodyLength) != SUCCESS)
+	{
+		return -EDEVICE;
+	}
+	return pMsg->hdr.status == STATUS_REPLY_SUCC ? SUCCESS : -EDEVICE;
+}
+
+/*********************************************************************//*!
+ * @brief Write one register.
+ *
+ * @param sock The command socket.
+ * @param pMsg Buffer for the command and the reply.
+ * @param id ID of the register.
+ * @param val The new value.
+ * @return SUCCESS or an appropriate error code.
+ *//*********************************************************************/
+static OSC_ERR SetReg(int sock, struct CommMsg *pMsg, uint32 id, uint32 val)
+{
+	struct CBP_PARAM param;
+
+	memset(&pMsg->hdr, 0, sizeof(pMsg->hdr));
+	pMsg->hdr.msgType = MSG_CMD_SET_CONFIG;
+	pMsg->hdr.bodyLength = sizeof(param);
+	param.id = id;
+	param.val = val;
+	memcpy(pMsg->body, &param, sizeof(param));
+	return Command(sock, pMsg);
+}
+
+/*********************************************************************//*!
+ * @brief Compare two latencies for qsort.
+ *//*********************************************************************/
+static int CompareUs(const void *pA, const void *pB)
+{
+	uint32 a = *(const uint32*)pA, b = *(const uint32*)pB;
+
+	return a < b ? -1 : (a > b ? 1 : 0);
+}
+
+/*********************************************************************//*!
+ * @brief Compute the distribution of a series of round trips.
+ *
+ * @param pUs The round trips (us); sorted by this function.
+ * @param n Number of round trips (> 0).
+ * @param pStats The latency distribution.
+ *//*********************************************************************/
+static void ComputeStats(uint32 *pUs, uint32 n, struct LatStats *pStats)
+{
+	uint32 i;
+	uint64 sum = 0;
+
+	qsort(pUs, n, sizeof(uint32), CompareUs);
+	for(i = 0; i < n; i++)
+	{
+		sum += pUs[i];
+	}
+	pStats->count = n;
+	pStats->minUs = pUs[0];
+	pStats->medianUs = pUs[n/2];
+	pStats->p99Us = pUs[((uint64)n*99)/100];
+	pStats->maxUs = pUs[n - 1];
+	pStats->meanUs = (uint32)(sum/n);
+}
+
+/*********************************************************************//*!
+ * @brief Print a latency distribution.
+ *
+ * @param strName Name of the measurement.
+ * @param nClients Number of concurrent clients.
+ * @param pStats The latency distribution.
+ *//*********************************************************************/
+static void PrintLatency(const char *strName, uint32 nClients, const struct LatStats *pStats)
+{
+	printf("%-28s %7d %6d %8d %8d %8d %8d %8d\n", strName, nClients,
+	       pStats->count, pStats->minUs, pStats->medianUs, pStats->meanUs,
+	       pStats->p99Us, pStats->maxUs);
+}
+
+/*********************************************************************//*!
+ * @brief Main function of a command client thread.
+ *
+ * Sends the commands of the mix in turn and records their round trips.
+ *
+ * @param pArg The client.
+ * @return NULL
+ *//*********************************************************************/
+static void* ClientMain(void *pArg)
+{
+	struct Client *pClient = (struct Client*)pArg;
+	struct CommMsg *pMsg = pClient->pMsg;
+	struct CBP_PARAM param;
+	uint32 i, type;
+	uint64 start;
+
+	for(i = 0; i < pClient->nCmds; i++)
+	{
+		type = i % CMDBENCH_CMD_TYPES;
+		memset(&pMsg->hdr, 0, sizeof(pMsg->hdr));
+		pMsg->hdr.msgType = cmdTypes[type];
+		pMsg->hdr.ident = i;
+		if(cmdTypes[type] == MSG_CMD_SET_CONFIG)
+		{
+			param.id = CMDBENCH_SET_REG;
+			param.val = 0;
+			pMsg->hdr.bodyLength = sizeof(param);
+			memcpy(pMsg->body, &param, sizeof(param));
+		}
+
+		start = Now();
+		pClient->err = Command(pClient->sock, pMsg);
+		if(pClient->err != SUCCESS)
+		{
+			break;
+		}
+		pClient->pUs[type][pClient->count[type]++] = (uint32)(Now() - start);
+	}
+	return NULL;
+}
+
+/*********************************************************************//*!
+ * @brief Measure the round trips with concurrent command clients.
+ *
+ * @param strAddr IP address of the target.
+ * @param strFeed Description of the feed load.
+ * @param nClients Number of concurrent clients.
+ * @param nCmds Number of commands per client.
+ * @return SUCCESS or an appropriate error code.
+ *//*********************************************************************/
+static OSC_ERR MeasureLatency(const char *strAddr, const char *strFeed,
+			      uint32 nClients, uint32 nCmds)
+{
+	struct Client *pClients;
+	struct LatStats stats;
+	uint32 *pAll;
+	uint32 c, type, n;
+	char strName[64];
+	OSC_ERR err = SUCCESS;
+
+	pClients = calloc(nClients, sizeof(struct Client));
+	pAll = malloc(nClients*nCmds*sizeof(uint32));
+	if(pClients == NULL || pAll == NULL)
+	{
+		free(pClients);
+		free(pAll);
+		return -EOUT_OF_MEMORY;
+	}
+
+	for(c = 0; c < nClients && err == SUCCESS; c++)
+	{
+		pClients[c].nCmds = nCmds;
+		pClients[c].pMsg = malloc(sizeof(struct CommMsg));
+		for(type = 0; type < CMDBENCH_CMD_TYPES; type++)
+		{
+			pClients[c].pUs[type] = malloc(nCmds*sizeof(uint32));
+			if(pClients[c].pUs[type] == NULL)
+			{
+				err = -EOUT_OF_MEMORY;
+			}
+		}
+		pClients[c].sock = Connect(strAddr, TCP_CMD_PORT);
+		if(pClients[c].pMsg == NULL || pClients[c].sock < 0)
+		{
+			err = -EDEVICE;
+		}
+	}
+
+	if(err == SUCCESS)
+	{
+		for(c = 0; c < nClients; c++)
+		{
+			pthread_create(&pClients[c].thread, NULL, ClientMain, &pClients[c]);
+		}
+		for(c = 0; c < nClients; c++)
+		{
+			pthread_join(pClients[c].thread, NULL);
+			if(pClients[c].err != SUCCESS)
+			{
+				err = pClients[c].err;
+			}
+		}
+	}
+
+	/* One distribution per command type over all clients. */
+	for(type = 0; type < CMDBENCH_CMD_TYPES && err == SUCCESS; type++)
+	{
+		n = 0;
+		for(c = 0; c < nClients; c++)
+		{
+			memcpy(pAll + n, pClients[c].pUs[type],
+			       pClients[c].count[type]*sizeof(uint32));
+			n += pClients[c].count[type];
+		}
+		if(n > 0)
+		{
+			ComputeStats(pAll, n, &stats);
+			snprintf(strName, sizeof(strName), "%s, %s", cmdNames[type], strFeed);
+			PrintLatency(strName, nClients, &stats);
+		}
+	}
+
+	for(c = 0; c < nClients; c++)
+	{
+		if(pClients[c].sock > 0)
+		{
+			close(pClients[c].sock);
+		}
+		for(type = 0; type < CMDBENCH_CMD_TYPES; type++)
+		{
+			free(pClients[c].pUs[type]);
+		}
+		free(pClients[c].pMsg);
+	}
+	free(pClients);
+	free(pAll);
+	return err;
+}
+
+/*********************************************************************//*!
+ * @brief Main function of the feed reader thread.
+ *
+ * Reads and discards the feed, limited to feed.rateLimit.
+ *
+ * @param pArg Unused.
+ * @return NULL
+ *//*********************************************************************/
+static void* FeedReader(void *pArg)
+{
+	static uint8 buf[CMDBENCH_FEED_CHUNK];
+	uint64 start = Now(), dueUs;
+	int retval;
+
+	while(!feed.bQuit)
+	{
+		retval = recv(feed.sock, buf, sizeof(buf), 0);
+		if(retval <= 0)
+		{
+			break;
+		}
+		feed.nBytes += retval;
+		if(feed.rateLimit != 0)
+		{
+			dueUs = start + (feed.nBytes*1000000)/feed.rateLimit;
+			while(Now() < dueUs && !feed.bQuit)
+			{
+				usleep(1000);
+			}
+		}
+	}
+	return NULL;
+}
+
+/*********************************************************************//*!
+ * @brief Program entry.
+ *
+ * @param argc Command line argument count.
+ * @param argv Command line argument strings.
+ * @return 0 on success
+ *//*********************************************************************/
+int main(const int argc, const char * argv[])
+{
+	const char *strAddr = "127.0.0.1";
+	const char *strFeed;
+	uint32 nCmds = CMDBENCH_COMMANDS, nClients = 1, pattern = SYNTH_OFF, c;
+	struct CommMsg *pMsg;
+	pthread_t reader;
+	uint64 start, startBytes;
+	int i, ctrlSock;
+
+	memset(&feed, 0, sizeof(feed));
+	for(i = 1; i + 1 < argc; i += 2)
+	{
+		if(strcmp(argv[i], "-a") == 0)
+		{
+			strAddr = argv[i + 1];
+		} else if(strcmp(argv[i], "-n") == 0)
+		{
+			nCmds = atoi(argv[i + 1]);
+		} else if(strcmp(argv[i], "-c") == 0)
+		{
+			nClients = atoi(argv[i + 1]);
+		} else if(strcmp(argv[i], "-r") == 0)
+		{
+			feed.rateLimit = atoi(argv[i + 1])*1024;
+		} else if(strcmp(argv[i], "-s") == 0)
+		{
+			pattern = atoi(argv[i + 1]);
+		} else {
+			break;
+		}
+	}
+	if(i < argc || nCmds == 0 || nClients == 0 ||
+	   nClients >= COMM_MAX_CMD_CONNS || pattern >= SYNTH_PATTERN_COUNT)
+	{
+		fprintf(stderr, "Usage: %s [-a address] [-n commands] [-c clients (< %d)] "
+			"[-r feed kB/s] [-s synthetic pattern]\n",
+			argv[0], COMM_MAX_CMD_CONNS);
+		return 1;
+	}
+
+	/* The control connection configures the target and counts as one of
+	 * its command clients. */
+	pMsg = malloc(sizeof(struct CommMsg));
+	ctrlSock = Connect(strAddr, TCP_CMD_PORT);
+	if(pMsg == NULL || ctrlSock < 0)
+	{
+		fprintf(stderr, "Unable to connect to %s:%d.\n", strAddr, TCP_CMD_PORT);
+		return 1;
+	}
+	if(SetReg(ctrlSock, pMsg, REG_ID_AQUISITION_MODE, 0) != SUCCESS ||
+	   SetReg(ctrlSock, pMsg, REG_ID_SYNTH_PATTERN, pattern) != SUCCESS ||
+	   SetReg(ctrlSock, pMsg, REG_ID_FRAME_RATE, 0) != SUCCESS)
+	{
+		fprintf(stderr, "Unable to configure the target.\n");
+		return 1;
+	}
+
+	printf("%-28s %7s %6s %8s %8s %8s %8s %8s\n", "round trip (us)", "clients",
+	       "count", "min", "median", "mean", "p99", "max");
+
+	/* Without feed. */
+	for(c = 1; c <= nClients; c++)
+	{
+		if(MeasureLatency(strAddr, "no feed", c, nCmds) != SUCCESS)
+		{
+			fprintf(stderr, "Command failed.\n");
+			return 1;
+		}
+	}
+
+	/* With feed at the full frame rate. */
+	feed.sock = Connect(strAddr, TCP_FEED_PORT);
+	if(feed.sock < 0 || SetReg(ctrlSock, pMsg, REG_ID_AQUISITION_MODE, 1) != SUCCESS)
+	{
+		fprintf(stderr, "Unable to start the feed.\n");
+		return 1;
+	}
+	pthread_create(&reader, NULL, FeedReader, NULL);
+	/* Let the feed fill up the socket buffers first. */
+	usleep(500000);
+
+	strFeed = feed.rateLimit ? "limited feed" : "full feed";
+	start = Now();
+	startBytes = feed.nBytes;
+	for(c = 1; c <= nClients; c++)
+	{
+		if(MeasureLatency(strAddr, strFeed, c, nCmds) != SUCCESS)
+		{
+			fprintf(stderr, "Command failed.\n");
+			return 1;
+		}
+	}
+	printf("feed: %d kB/s\n",
+	       (uint32)(((feed.nBytes - startBytes)*1000000/1024)/(Now() - start)));
+
+	SetReg(ctrlSock, pMsg, REG_ID_AQUISITION_MODE, 0);
+	SetReg(ctrlSock, pMsg, REG_ID_SYNTH_PATTERN, SYNTH_OFF);
+	feed.bQuit = TRUE;
+	shutdown(feed.sock, SHUT_RDWR);
+	pthread_join(reader, NULL);
+	close(feed.sock);
+	close(ctrlSock);
+	free(pMsg);
+	return 0;
+}
@@ -1,479 +1,1826 @@
-/*	Target side application for the Rich Viewer.
-	Copyright (C) 2008 Supercomputing Systems AG
-	
-	This library is free software; you can redistribute it and/or modify it
-	under the terms of the GNU Lesser General Public License as published by
-	the Free Software Foundation; either version 2.1 of the License, or (at
-	your option) any later version.
-	
-	This library is distributed in the hope that it will be useful, but
-	WITHOUT ANY WARRANTY; without even the implied warranty of
-	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser
-	General Public License for more details.
-	
-	You should have received a copy of the GNU Lesser General Public License
-	along with this library; if not, write to the Free Software Foundation,
-	Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
-*/
-
-/*! @file communication.c
- * @brief TCP/UDP communication implementation
- */
-
-#include "communication.h"
-#include "version.h"
-
-/*********************************************************************//*!
- * @brief Send a data buffer over the specified socket (blocking).
- * 
- * On send error, this functions sets the supplied socket to 0.
- * 
- * @param pSock Pointer to socket to send the data over.
- * @param pBuf Pointer to the data to be sent.
- * @param len Length of the data buffer to be sent.
- * @return SUCCESS or a suitable error code.
- *//*********************************************************************/
-static OSC_ERR Comm_SendData(int* pSock, const void *pBuf, uint32 len);
-
-/*********************************************************************//*!
- * @brief Gets a new message from the command socket.
- *
- * Attempts to get a new command message from the socket. 
- *
- * @param pComm Pointer to the communication status structure.
- * @param timeout_ms Timeout of this function in milliseconds
- * @return Length of the command message on success, 0 on timeout,
- *         negative number on error.
- *//*********************************************************************/
-static int Comm_GetCmdMsg(struct COMM *pComm, int timeout_ms);
-
-/*********************************************************************//*!
- * @brief Initialize a socket according to the requirements of the
- *        host-target protocol.
- *
- * Gets a socket number, sets socket options, calls bind and listen on
- * the socket. Incoming connections have to be accepted in a different
- * function.
- * @see Comm_AcceptConnections
- * 
- * @param pSock Pointer to the socket to be created and initialized.
- * @param port Port number the socket should be bound to.
- * @return SUCCESS or an appropriate error code.
- *//*********************************************************************/
-static OSC_ERR Comm_InitSocket(int *pSock, int port);
-
-/*********************************************************************//*!
- * @brief Sends a reply to a received command.
- *
- * If the socket is not connected, a call to this function with -ETRY_AGAIN
- *
- * @param pComm Pointer to the communication status structure.
- * @return SUCCESS or a suitable error code.
- *//*********************************************************************/
-static OSC_ERR Comm_SendReply(struct COMM *pComm);
-
-
-
-
-void Comm_PrintMsg(const struct CommMsg *pMsg)
-{
-	int i;
-	const struct MsgHdr *pHdr = &pMsg->hdr;
-
-	OscLog(DEBUG, "Msg Start.\n");
-
-	OscLog(DEBUG, "Body Len  = %d\n", pHdr->bodyLength);
-	OscLog(DEBUG, "Type      = %#x\n", pHdr->msgType);
-	OscLog(DEBUG, "Ident     = %#x\n", pHdr->ident);
-	OscLog(DEBUG, "status    = %#x\n", pHdr->status);
-	OscLog(DEBUG, "param0    = %#x\n", pHdr->msgParams.genericParams.param0);
-	OscLog(DEBUG, "param1    = %#x\n", pHdr->msgParams.genericParams.param1);
-	OscLog(DEBUG, "param2    = %#x\n", pHdr->msgParams.genericParams.param2);
-	OscLog(DEBUG, "param3    = %#x\n", pHdr->msgParams.genericParams.param3);
-
-	OscLog(DEBUG, "\nData:\n");
-	for(i = 0; i < pHdr->bodyLength; i++)
-	{
-		OscLog(DEBUG, "%#x ", pMsg->body[i]);
-		if(i % 32 == 31)
-		{
-			OscLog(DEBUG, "\n");
-		}
-	}
-	OscLog(DEBUG, "\nMsg End.\n", i);
-}
-
-
-OSC_ERR Comm_AcceptConnections(struct COMM *pComm, int timeout_ms)
-{
-  int retval;
-  fd_set s;
-  struct timeval timeout;
-
-  if(pComm->connCmdSock > 0 && pComm->connFeedSock > 0)
-  {
-	  /* Connection on both sockets already established. */
-	  return 0;
-  }
-
-  FD_ZERO(&s);
-
-  if(pComm->connCmdSock <= 0)
-  {
-	  FD_SET(pComm->cmdSock, &s);
-  }
-
-  if(pComm->connFeedSock <= 0)
-  {
-	  FD_SET(pComm->feedSock, &s);
-  }
-
-  timeout.tv_sec = timeout_ms/1000;
-  timeout.tv_usec = (timeout_ms % 1000)*1000;
-
-  retval = select(MAX(pComm->cmdSock, pComm->feedSock)+1, /* Highest socket number + 1 */
-		  &s,   /* File descriptor set to monitor for reading and new connections. */
-		  NULL, /* File descriptor set to monitor for writing. */
-		  NULL, /* File descriptor set to monitor for exceptions. */
-		  &timeout);
-  if(retval > 0)
-  {
-	  /* Success. We have something new. */
-	  if(FD_ISSET(pComm->cmdSock, &s))
-	  {
-		  pComm->connCmdSock = accept(pComm->cmdSock, NULL, 0);
-		  if(pComm->connCmdSock < 0)
-		  {
-			  OscLog(ERROR, "%s: Command socket accept error (%s)!\n",
-				 __func__, strerror(errno));
-			  return -EDEVICE;
-		  }
-		  OscLog(INFO, "%s: Command socket connected.\n", __func__);
-	  }
-
-	  if(FD_ISSET(pComm->feedSock, &s))
-	  {
-		  pComm->connFeedSock = accept(pComm->feedSock, NULL, 0);
-		  if(pComm->connFeedSock < 0)
-		  {
-			  OscLog(ERROR, "%s: Feed socket accept error (%s)!\n",
-				 __func__, strerror(errno));
-			  return -EDEVICE;
-		  }
-		  OscLog(INFO, "%s: Feed socket connected.\n", __func__);
-	  }
-	  return SUCCESS;
-  } else if(retval < 0) {
-	  OscLog(ERROR, "%s: Select failed (%s)!\n", __func__, strerror(errno));
-	  return -EDEVICE;
-  } else {
-	  /* Timeout */
-	  return -ETIMEOUT;
-  }
-		  
-		  
-}
-
-static int Comm_GetCmdMsg(struct COMM *pComm, int timeout_ms)
-{
-  int retval;
-  fd_set s;
-  struct timeval timeout;
-
-  if(pComm->connCmdSock <= 0)
-  {
-	  OscLog(DEBUG, "%s: Socket not connected.\n", __func__);
-	  return 0;
-  }
-
-  FD_ZERO(&s);
-  FD_SET(pComm->connCmdSock, &s);
-
-  timeout.tv_sec = timeout_ms/1000;
-  timeout.tv_usec = (timeout_ms % 1000)*1000;
-
-  retval = select(pComm->connCmdSock + 1, /* Highest socket number + 1 */
-		  &s,   /* File descriptor set to monitor for reading and new connections. */
-		  NULL, /* File descriptor set to monitor for writing. */
-		  NULL, /* File descriptor set to monitor for exceptions. */
-		  &timeout);
-  if(retval > 0)
-  {
-	  /* Success. We have a new command. */
-	  retval = recv(pComm->connCmdSock,
-			&pComm->cmdMsg,
-			sizeof(struct CommMsg),
-			0);
-	  return retval;
-  } else if(retval < 0) {
-	  OscLog(ERROR, "%s: Select failed (%s)!\n", __func__, strerror(errno));
-	  return -1;
-  } else {
-	  /* Timeout */
-	  return 0;
-  }
-}
-
-static OSC_ERR Comm_SendReply(struct COMM *pComm)
-{
-	if(pComm->connCmdSock <= 0)
-	{
-		OscLog(DEBUG, "%s: Socket not connected.\n", __func__);
-		return -ETRY_AGAIN;
-	}
-
-
-	/* Send reply message. */
-	return Comm_SendData(&pComm->connCmdSock, 
-			     &pComm->cmdMsg, 
-			     sizeof(struct MsgHdr) + pComm->cmdMsg.hdr.bodyLength);
-}
-
-OSC_ERR Comm_HandleCommands(struct COMM *pComm, void *pHsm, uint32 timeout_ms)
-{
-	OSC_ERR err;
-	int bytesReceived;
-	struct MsgHdr *pHdr;
-	int reg;
-	struct CBP_PARAM* pParam;
-
-	bytesReceived = Comm_GetCmdMsg(pComm, timeout_ms);
-	if(bytesReceived == 0)
-	{
-		return -ETIMEOUT;
-	} else if(bytesReceived < 0)
-	{
-		return -EDEVICE;
-	}
-
-	pHdr = &pComm->cmdMsg.hdr;
-	switch(pHdr->msgType)
-	{
-	case MSG_CMD_GET_VER:
-		/* Can be handled without invoking the state machine. */
-		pHdr->msgParams.getVerReply.CBPVersion = CBP_VERSION;
-		pHdr->msgParams.getVerReply.FeedProtVersion = FEED_VERSION;
-		pHdr->msgParams.getVerReply.TargetSWVersion = 
-			VERSION_MAJOR << 16 | VERSION_MINOR << 8 | VERSION_PATCH;
-
-		pHdr->bodyLength = 0;
-		pHdr->status = STATUS_REPLY_SUCC;
-
-		return Comm_SendReply(pComm);
-	case MSG_CMD_GET_COMPL_CONFIG:
-		/* Can be handled without invoking the state machine. */
-		pHdr->bodyLength = pComm->nRegs * sizeof(struct CBP_PARAM);
-
-		assert(pHdr->bodyLength <= MAX_MSG_BODY_LENGTH);
-		memcpy(pComm->cmdMsg.body, pComm->pRegFile, pHdr->bodyLength);
-
-		pHdr->status = STATUS_REPLY_SUCC;
-
-		return Comm_SendReply(pComm);
-	case MSG_CMD_SET_CONFIG:
-		/* Invoke the state machine for all assigned config registers.
-		   Do not change the contents of the register file here, this will
-		   be done by the state machine. */
-		pParam = (struct CBP_PARAM*)&pComm->cmdMsg;
-		for(reg = 0; reg < pComm->nRegs; reg++)
-		{
-			pComm->enReqState = REQ_STATE_IDLE;
-			err = SetConfigRegister(pHsm, pParam);
-			pParam++;
-
-			if(err != SUCCESS)
-			{
-				goto set_config_fail;
-			}
-		}					
-		pHdr->status = STATUS_REPLY_SUCC;
-		return Comm_SendReply(pComm);
-
-set_config_fail:  
-		pHdr->status = STATUS_REPLY_FAIL;
-		return Comm_SendReply(pComm);
-	default:
-		OscLog(ERROR, "%s: Unsupported message type (%#x) received!\n",
-		       __func__);
-	}
-	return SUCCESS;
-}
-
-
-OSC_ERR Comm_SendImage(struct COMM *pComm, const void* pImg, uint32 imgSize, const struct FeedHdr *pFeedHdr)
-{
-	OSC_ERR err;
-	struct MsgHdr msgHdr;
-
-	if(pComm->connFeedSock <= 0)
-	{
-		OscLog(DEBUG, "%s: Socket not connected.\n", __func__);
-		return -ETRY_AGAIN;
-	}
-
-	msgHdr.bodyLength = sizeof(struct FeedHdr) + imgSize;
-	msgHdr.msgType = MSG_FEED_DATA;
-	msgHdr.ident = 0;
-	msgHdr.status = STATUS_FEED;
-	
-	memset(&msgHdr.msgParams.feedDataParams, 0, sizeof(msgHdr.msgParams.feedDataParams));
-
-	/* Send message header. */
-	err = Comm_SendData(&pComm->connFeedSock, &msgHdr, sizeof(struct MsgHdr));
-	if(err != SUCCESS)
-	{
-		return err;
-	}
-
-	/* Send feed header. */
-	Comm_SendData(&pComm->connFeedSock, pFeedHdr, sizeof(struct FeedHdr));
-	if(err != SUCCESS)
-	{
-		return err;
-	}
-
-	/* Send image data */
-	Comm_SendData(&pComm->connFeedSock, pImg, imgSize);
-	if(err != SUCCESS)
-	{
-		return err;
-	}
-
-	return SUCCESS;
-}
-
-static OSC_ERR Comm_SendData(int *pSock, const void *pBuf, uint32 len)
-{
-	int retval;
-	uint8 *pTemp = (uint8*)pBuf;
-	uint32 bytesToSend = len;
-
-	while(bytesToSend > 0)
-	{
-		retval = send(*pSock, pTemp, bytesToSend, 0);
-		if(retval < 0)
-		{
-			OscLog(ERROR, "%s: Send error (%s)!\n", 
-			       __func__, strerror(errno));
-			*pSock = 0;
-			return -EDEVICE;
-		}
-		bytesToSend -= retval;
-		pTemp += retval;
-	}
-	return SUCCESS;
-}
-
-static OSC_ERR Comm_InitSocket(int *pSock, int port)
-{
-	int sock, retval, on;
-	struct sockaddr_in addr;
-
-	if(*pSock > 0)
-	{
-		return -EALREADY_INITIALIZED;
-	}
-
-	/* Initialize command socket. */
-	sock = socket(PF_INET, SOCK_STREAM, 0);
-	if (sock < 0)
-	{
-		OscLog(ERROR, "%s: Could not get socket!\n", __func__);
-		return -EDEVICE;
-	}	
-
-	/* Enable address reuse, because Linux sends TCP-FIN and Windows 
-	   uses TCP-RST, so Windows does not close connection correctly 
-	   on close(sock) */
-	on = 1;
-	retval = setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
-	if (retval==-1)
-	{
-		OscLog(ERROR, "%s: could not set socket-option SO_REUSEADDR", __func__);
-		return -EDEVICE;
-	}
-
-	memset(&addr, 0, sizeof(addr));
-	addr.sin_family = AF_INET;
-	addr.sin_port = htons(port);
-	addr.sin_addr.s_addr = htonl(INADDR_ANY);
-
-	retval = bind(sock, (struct sockaddr *)&addr, sizeof(addr));
-	if (retval==-1)
-	{
-		OscLog(ERROR, "%s: could not bind socket (%s)!", 
-		       __func__, strerror(errno));
-		return -EDEVICE;
-	}
-
-	retval = listen(sock, 1);
-	if(retval == -1)
-	  {
-	    OscLog(ERROR, "%s: Unable to listen to socket (%s)!\n",
-		   __func__, strerror(errno));	    
-	    return -EDEVICE;
-	  }
-
-	*pSock = sock;
-
-	return SUCCESS;
-}
-
-OSC_ERR Comm_Init(struct COMM *pComm)
-{
-	OSC_ERR err;
-
-	if (pComm->cmdSock > 0 || pComm->feedSock > 0)
-	{
-		return -EALREADY_INITIALIZED;
-	}
-
-
-	/* Initialize command socket. */
-	err = Comm_InitSocket(&pComm->cmdSock, TCP_CMD_PORT);
-	if(err != SUCCESS && err != -EALREADY_INITIALIZED)
-	{
-		return err;
-	}
-
-	/* Initialize feed socket. */
-	err = Comm_InitSocket(&pComm->feedSock, TCP_FEED_PORT);
-	if(err != SUCCESS && err != -EALREADY_INITIALIZED)
-	{
-		Comm_DeInit(pComm);
-		return err;
-	}
-
-	return SUCCESS;
-}
-
-
-void Comm_DeInit(struct COMM *pComm)
-{
-	if(pComm->connCmdSock > 0)
-	{
-		close(pComm->connCmdSock);
-		pComm->connCmdSock = -1;
-	}
-	if(pComm->connFeedSock > 0)
-	{
-		close(pComm->connFeedSock);
-		pComm->connFeedSock = -1;
-	}
-	if(pComm->cmdSock > 0)
-	{
-		close(pComm->cmdSock);
-		pComm->cmdSock = -1;
-	}
-	if(pComm->feedSock > 0)
-	{
-		close(pComm->feedSock);
-		pComm->feedSock = -1;
-	}
-}
-
-
-
-
-
-
+/*	Target side application for the Rich Viewer.
+	Copyright (C) 2008 Supercomputing Systems AG
+	
+	This library is free software; you can redistribute it and/or modify it
+	under the terms of the GNU Lesser General Public License as published by
+	the Free Software Foundation; either version 2.1 of the License, or (at
+	your option) any later version.
+	
+	This library is distributed in the hope that it will be useful, but
+	WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser
+	General Public License for more details.
+	
+	You should have received a copy of the GNU Lesser General Public License
+	along with this library; if not, write to the Free Software Foundation,
+	Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+/*! @file communication.c
+ * @brief TCP/UDP communication implementation
+ */
+
+#include "communication.h"
+#include "version.h"
+#include "trace.h"
+#include <sys/ioctl.h>
+#include <sys/uio.h>
+#include <linux/sockios.h>
+
+/*********************************************************************//*!
+ * @brief Send a data buffer over the specified socket (blocking).
+ * 
+ * On send error, this functions sets the supplied socket to 0.
+ * 
+ * @param pSock Pointer to socket to send the data over.
+ * @param pBuf Pointer to the data to be sent.
+ * @param len Length of the data buffer to be sent.
+ * @return SUCCESS or a suitable error code.
+ *//*********************************************************************/
+static OSC_ERR Comm_SendData(int* pSock, const void *pBuf, uint32 len);
+
+/*********************************************************************//*!
+ * @brief Gets a new message from the command socket.
+ *
+ * Attempts to get a new command message from the socket. Only waits
+ * for data to arrive; the commands are assembled from what has arrived
+ * of them.
+ *
+ * @param pComm Pointer to the communication status structure.
+ * @param timeout_ms Timeout of this function in milliseconds
+ * @return Length of the command message on success, 0 on timeout or if
+ *         no command is complete, negative number on error.
+ *//*********************************************************************/
+static int Comm_GetCmdMsg(struct COMM *pComm, int timeout_ms);
+
+/*********************************************************************//*!
+ * @brief Initialize a socket according to the requirements of the
+ *        host-target protocol.
+ *
+ * Gets a socket number, sets socket options, calls bind and listen on
+ * the socket. Incoming connections have to be accepted in a different
+ * function.
+ * @see Comm_AcceptConnections
+ * 
+ * @param pSock Pointer to the socket to be created and initialized.
+ * @param port Port number the socket should be bound to.
+ * @return SUCCESS or an appropriate error code.
+ *//*********************************************************************/
+static OSC_ERR Comm_InitSocket(int *pSock, int port);
+
+/*********************************************************************//*!
+ * @brief Set the socket options of the feed socket according to the
+ *        selected transport profile.
+ *
+ * @param pComm Pointer to the communication status structure.
+ *//*********************************************************************/
+static void Comm_ApplyFeedProfile(struct COMM *pComm);
+
+/*********************************************************************//*!
+ * @brief Save the values of the socket options changed by the feed
+ * profiles of a newly connected feed.
+ *
+ * @param pComm Pointer to the communication status structure.
+ *//*********************************************************************/
+static void Comm_SaveFeedDefaults(struct COMM *pComm);
+
+/*********************************************************************//*!
+ * @brief Check whether the live feed is held for MSG_CMD_RESUME_FEED.
+ *
+ * Ends the hold when FEED_RESUME_WAIT_MS have passed.
+ *
+ * @param pComm Pointer to the communication status structure.
+ * @return TRUE if the live feed is held.
+ *//*********************************************************************/
+static bool Comm_FeedHeld(struct COMM *pComm);
+
+/*********************************************************************//*!
+ * @brief Sends a reply to a received command.
+ *
+ * If the socket is not connected, a call to this function with -ETRY_AGAIN
+ *
+ * @param pComm Pointer to the communication status structure.
+ * @return SUCCESS or a suitable error code.
+ *//*********************************************************************/
+static OSC_ERR Comm_SendReply(struct COMM *pComm);
+
+
+
+
+void Comm_PrintMsg(const struct CommMsg *pMsg)
+{
+	int i;
+	const struct MsgHdr *pHdr = &pMsg->hdr;
+
+	OscLog(DEBUG, "Msg Start.\n");
+
+	OscLog(DEBUG, "Body Len  = %d\n", pHdr->bodyLength);
+	OscLog(DEBUG, "Type      = %#x\n", pHdr->msgType);
+	OscLog(DEBUG, "Ident     = %#x\n", pHdr->ident);
+	OscLog(DEBUG, "status    = %#x\n", pHdr->status);
+	OscLog(DEBUG, "param0    = %#x\n", pHdr->msgParams.genericParams.param0);
+	OscLog(DEBUG, "param1    = %#x\n", pHdr->msgParams.genericParams.param1);
+	OscLog(DEBUG, "param2    = %#x\n", pHdr->msgParams.genericParams.param2);
+	OscLog(DEBUG, "param3    = %#x\n", pHdr->msgParams.genericParams.param3);
+
+	OscLog(DEBUG, "\nData:\n");
+	for(i = 0; i < pHdr->bodyLength; i++)
+	{
+		OscLog(DEBUG, "%#x ", pMsg->body[i]);
+		if(i % 32 == 31)
+		{
+			OscLog(DEBUG, "\n");
+		}
+	}
+	OscLog(DEBUG, "\nMsg End.\n", i);
+}
+
+
+/*********************************************************************//*!
+ * @brief Discard the snapshot request and its reply.
+ *
+ * @param pComm Pointer to the communication status structure.
+ *//*********************************************************************/
+static void Comm_DropSnapshot(struct COMM *pComm)
+{
+	free(pComm->snap.pReply);
+	pComm->snap.pReply = NULL;
+	pComm->snap.sock = 0;
+}
+
+/*********************************************************************//*!
+ * @brief Close the connection to a command client.
+ *
+ * @param pComm Pointer to the communication status structure.
+ * @param conn Index of the client in cmdConns.
+ *//*********************************************************************/
+static void Comm_CloseCmdConn(struct COMM *pComm, uint32 conn)
+{
+	if(pComm->cmdConns[conn] == pComm->snap.sock)
+	{
+		Comm_DropSnapshot(pComm);
+	}
+	close(pComm->cmdConns[conn]);
+	free(pComm->cmdRecv[conn].pMsg);
+	pComm->nCmdConns--;
+	pComm->cmdConns[conn] = pComm->cmdConns[pComm->nCmdConns];
+	pComm->cmdRecv[conn] = pComm->cmdRecv[pComm->nCmdConns];
+	OscLog(INFO, "%s: Command client disconnected, %d left.\n",
+	       __func__, pComm->nCmdConns);
+}
+
+/*********************************************************************//*!
+ * @brief Close the connection to a command client given its socket.
+ *
+ * @param pComm Pointer to the communication status structure.
+ * @param sock Socket of the client.
+ *//*********************************************************************/
+static void Comm_CloseCmdSock(struct COMM *pComm, int sock)
+{
+	uint32 conn;
+
+	for(conn = 0; conn < pComm->nCmdConns; conn++)
+	{
+		if(pComm->cmdConns[conn] == sock)
+		{
+			Comm_CloseCmdConn(pComm, conn);
+			return;
+		}
+	}
+}
+
+/*********************************************************************//*!
+ * @brief Add the sockets of the command clients to a set to select on.
+ *
+ * A client waiting for a snapshot is left out; its next command is only
+ * read after the reply.
+ *
+ * @param pComm Pointer to the communication status structure.
+ * @param pSet The set.
+ * @param maxSock Highest socket number in the set.
+ * @return Highest socket number in the set including the clients.
+ *//*********************************************************************/
+static int Comm_SetCmdConns(const struct COMM *pComm, fd_set *pSet, int maxSock)
+{
+	uint32 i;
+
+	for(i = 0; i < pComm->nCmdConns; i++)
+	{
+		if(pComm->cmdConns[i] != pComm->snap.sock)
+		{
+			FD_SET(pComm->cmdConns[i], pSet);
+			maxSock = MAX(maxSock, pComm->cmdConns[i]);
+		}
+	}
+	return maxSock;
+}
+
+OSC_ERR Comm_AcceptConnections(struct COMM *pComm, int timeout_ms)
+{
+  int retval, sock, maxSock;
+  fd_set s;
+  struct timeval timeout;
+
+  if(pComm->nCmdConns == COMM_MAX_CMD_CONNS && pComm->connFeedSock > 0)
+  {
+	  /* No more connections can be accepted. */
+	  return 0;
+  }
+  if(pComm->nCmdConns > 0 && pComm->connFeedSock > 0)
+  {
+	  /* Only additional command clients, do not wait for them. */
+	  timeout_ms = 0;
+  }
+
+  FD_ZERO(&s);
+
+  if(pComm->nCmdConns < COMM_MAX_CMD_CONNS)
+  {
+	  FD_SET(pComm->cmdSock, &s);
+  }
+
+  if(pComm->connFeedSock <= 0)
+  {
+	  FD_SET(pComm->feedSock, &s);
+  }
+
+  /* Stop waiting as soon as a command arrives. */
+  maxSock = Comm_SetCmdConns(pComm, &s, MAX(pComm->cmdSock, pComm->feedSock));
+
+  timeout.tv_sec = timeout_ms/1000;
+  timeout.tv_usec = (timeout_ms % 1000)*1000;
+
+  retval = select(maxSock + 1, /* Highest socket number + 1 */
+		  &s,   /* File descriptor set to monitor for reading and new connections. */
+		  NULL, /* File descriptor set to monitor for writing. */
+		  NULL, /* File descriptor set to monitor for exceptions. */
+		  &timeout);
+  if(retval > 0)
+  {
+	  /* Success. We have something new. */
+	  if(pComm->nCmdConns < COMM_MAX_CMD_CONNS && FD_ISSET(pComm->cmdSock, &s))
+	  {
+		  sock = accept(pComm->cmdSock, NULL, 0);
+		  if(sock < 0)
+		  {
+			  OscLog(ERROR, "%s: Command socket accept error (%s)!\n",
+				 __func__, strerror(errno));
+			  return -EDEVICE;
+		  }
+		  pComm->cmdRecv[pComm->nCmdConns].pMsg =
+			  malloc(sizeof(struct MsgHdr) + pComm->cmdBodySize);
+		  if(pComm->cmdRecv[pComm->nCmdConns].pMsg == NULL)
+		  {
+			  OscLog(ERROR, "%s: Unable to allocate the command buffer!\n",
+				 __func__);
+			  close(sock);
+			  return -EOUT_OF_MEMORY;
+		  }
+		  pComm->cmdRecv[pComm->nCmdConns].len = 0;
+		  pComm->cmdConns[pComm->nCmdConns++] = sock;
+		  Trace_Add(TRACE_ACCEPT, TCP_CMD_PORT);
+		  OscLog(INFO, "%s: Command socket connected (%d clients).\n",
+			 __func__, pComm->nCmdConns);
+	  }
+
+	  if(pComm->connFeedSock <= 0 && FD_ISSET(pComm->feedSock, &s))
+	  {
+		  pComm->connFeedSock = accept(pComm->feedSock, NULL, 0);
+		  if(pComm->connFeedSock < 0)
+		  {
+			  OscLog(ERROR, "%s: Feed socket accept error (%s)!\n",
+				 __func__, strerror(errno));
+			  return -EDEVICE;
+		  }
+		  OscLog(INFO, "%s: Feed socket connected.\n", __func__);
+		  Trace_Add(TRACE_ACCEPT, TCP_FEED_PORT);
+		  Comm_SaveFeedDefaults(pComm);
+		  Comm_ApplyFeedProfile(pComm);
+		  /* A reconnecting host resumes before the live feed starts. */
+		  pComm->feedHoldCyc = 0;
+		  if(pComm->retain.pArena != NULL)
+		  {
+			  pComm->feedHoldCyc = OscSupCycGet64() +
+				  Timing_UsToCyc(FEED_RESUME_WAIT_MS*1000);
+		  }
+	  }
+	  return SUCCESS;
+  } else if(retval < 0) {
+	  OscLog(ERROR, "%s: Select failed (%s)!\n", __func__, strerror(errno));
+	  return -EDEVICE;
+  } else {
+	  /* Timeout */
+	  return -ETIMEOUT;
+  }
+		  
+		  
+}
+
+/*********************************************************************//*!
+ * @brief Receive what has arrived of the command of a command client.
+ *
+ * Does not block, so a client sending a command in pieces does not hold
+ * up the others. A body too long for the buffer is read but not stored;
+ * the command is rejected when it is handled.
+ *
+ * @param pComm Pointer to the communication status structure.
+ * @param conn Index of the client in cmdConns.
+ * @return 1 if the command is complete, 0 if not, -1 if the client
+ *         closed the connection or it broke down.
+ *//*********************************************************************/
+static int Comm_RecvCmd(struct COMM *pComm, uint32 conn)
+{
+	struct CmdRecv *pRecv = &pComm->cmdRecv[conn];
+	struct MsgHdr *pHdr = &pRecv->pMsg->hdr;
+	uint8 discard[256];
+	uint8 *pDst;
+	uint32 want, msgLen;
+	int retval;
+
+	while(TRUE)
+	{
+		if(pRecv->len < sizeof(struct MsgHdr))
+		{
+			pDst = (uint8*)pHdr + pRecv->len;
+			want = sizeof(struct MsgHdr) - pRecv->len;
+		} else {
+			if(pHdr->bodyLength > MAX_MSG_BODY_LENGTH)
+			{
+				OscLog(WARN, "%s: Invalid command body length (%d bytes).\n",
+				       __func__, pHdr->bodyLength);
+				return -1;
+			}
+			msgLen = sizeof(struct MsgHdr) + pHdr->bodyLength;
+			if(pRecv->len == msgLen)
+			{
+				return 1;
+			}
+			if(pHdr->bodyLength > pComm->cmdBodySize)
+			{
+				pDst = discard;
+				want = MIN(msgLen - pRecv->len, sizeof(discard));
+			} else {
+				pDst = (uint8*)pHdr + pRecv->len;
+				want = msgLen - pRecv->len;
+			}
+		}
+
+		retval = recv(pComm->cmdConns[conn], pDst, want, MSG_DONTWAIT);
+		if(retval < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR))
+		{
+			return 0;
+		}
+		if(retval <= 0)
+		{
+			return -1;
+		}
+		pRecv->len += retval;
+	}
+}
+
+static int Comm_GetCmdMsg(struct COMM *pComm, int timeout_ms)
+{
+  int retval, maxSock = 0;
+  uint32 i, conn = 0;
+  fd_set s;
+  struct timeval timeout;
+  struct CommMsg *pMsg;
+
+  if(pComm->nCmdConns == 0)
+  {
+	  OscLog(DEBUG, "%s: Socket not connected.\n", __func__);
+	  return 0;
+  }
+
+  FD_ZERO(&s);
+  maxSock = Comm_SetCmdConns(pComm, &s, maxSock);
+
+  timeout.tv_sec = timeout_ms/1000;
+  timeout.tv_usec = (timeout_ms % 1000)*1000;
+
+  retval = select(maxSock + 1, /* Highest socket number + 1 */
+		  &s,   /* File descriptor set to monitor for reading and new connections. */
+		  NULL, /* File descriptor set to monitor for writing. */
+		  NULL, /* File descriptor set to monitor for exceptions. */
+		  &timeout);
+  if(retval > 0)
+  {
+	  /* Success. Something has arrived. Serve the clients in turn,
+	   * starting after the one served last. */
+	  for(i = 1; i <= pComm->nCmdConns; i++)
+	  {
+		  conn = (pComm->lastCmdConn + i) % pComm->nCmdConns;
+		  if(!FD_ISSET(pComm->cmdConns[conn], &s))
+		  {
+			  continue;
+		  }
+		  retval = Comm_RecvCmd(pComm, conn);
+		  if(retval < 0)
+		  {
+			  /* The client closed the connection or it broke down. */
+			  Comm_CloseCmdConn(pComm, conn);
+			  pComm->connCmdSock = 0;
+			  return 0;
+		  }
+		  if(retval > 0)
+		  {
+			  /* The complete command becomes the one handled. */
+			  pMsg = pComm->pCmdMsg;
+			  pComm->pCmdMsg = pComm->cmdRecv[conn].pMsg;
+			  pComm->cmdRecv[conn].pMsg = pMsg;
+			  pComm->cmdRecv[conn].len = 0;
+			  pComm->lastCmdConn = conn;
+			  pComm->connCmdSock = pComm->cmdConns[conn];
+			  return sizeof(struct MsgHdr) + pComm->pCmdMsg->hdr.bodyLength;
+		  }
+	  }
+	  /* Only parts of commands. */
+	  return 0;
+  } else if(retval < 0) {
+	  OscLog(ERROR, "%s: Select failed (%s)!\n", __func__, strerror(errno));
+	  return -1;
+  } else {
+	  /* Timeout */
+	  return 0;
+  }
+}
+
+static OSC_ERR Comm_SendReply(struct COMM *pComm)
+{
+	OSC_ERR err;
+	int sock = pComm->connCmdSock;
+
+	if(pComm->connCmdSock <= 0)
+	{
+		OscLog(DEBUG, "%s: Socket not connected.\n", __func__);
+		return -ETRY_AGAIN;
+	}
+
+
+	/* Send reply message. */
+	Trace_Add(TRACE_REPLY, pComm->pCmdMsg->hdr.msgType);
+	err = Comm_SendData(&pComm->connCmdSock, 
+			    pComm->pCmdMsg, 
+			    sizeof(struct MsgHdr) + pComm->pCmdMsg->hdr.bodyLength);
+	if(err != SUCCESS)
+	{
+		Comm_CloseCmdSock(pComm, sock);
+	}
+	return err;
+}
+
+/*********************************************************************//*!
+ * @brief Mark a register as changed for the register change
+ * notifications.
+ *
+ * @param pComm Pointer to the communication status structure.
+ * @param pReg The register (an entry of the register file).
+ *//*********************************************************************/
+static void Comm_MarkReg(struct COMM *pComm, const struct CBP_PARAM *pReg)
+{
+	uint32 reg = pReg - pComm->pRegFile;
+
+	if(pComm->pRegDirty != NULL)
+	{
+		pComm->pRegDirty[reg/32] |= 1u << (reg % 32);
+	}
+}
+
+OSC_ERR Comm_HandleCommands(struct COMM *pComm, void *pHsm, uint32 timeout_ms)
+{
+	OSC_ERR err;
+	int bytesReceived;
+	struct MsgHdr *pHdr;
+	int reg, nParams;
+	struct CBP_PARAM *pParam, *pStored;
+	uint32 firstSeqNr, scale, nRecs;
+
+	bytesReceived = Comm_GetCmdMsg(pComm, timeout_ms);
+	if(bytesReceived == 0)
+	{
+		return -ETIMEOUT;
+	} else if(bytesReceived < 0)
+	{
+		return -EDEVICE;
+	}
+
+	pHdr = &pComm->pCmdMsg->hdr;
+	Trace_Add(TRACE_COMMAND, pHdr->msgType);
+	if(pHdr->bodyLength > pComm->cmdBodySize)
+	{
+		/* The body has not been stored. No handler may read it, e.g.
+		 * the parameters of SET_CONFIG, nor may it be sent back. */
+		pHdr->bodyLength = 0;
+		pHdr->status = STATUS_REPLY_FAIL;
+		return Comm_SendReply(pComm);
+	}
+
+	switch(pHdr->msgType)
+	{
+	case MSG_CMD_GET_VER:
+		/* Can be handled without invoking the state machine. */
+		pHdr->msgParams.getVerReply.CBPVersion = CBP_VERSION;
+		pHdr->msgParams.getVerReply.FeedProtVersion = FEED_VERSION;
+		pHdr->msgParams.getVerReply.TargetSWVersion = 
+			VERSION_MAJOR << 16 | VERSION_MINOR << 8 | VERSION_PATCH;
+
+		pHdr->bodyLength = 0;
+		pHdr->status = STATUS_REPLY_SUCC;
+
+		return Comm_SendReply(pComm);
+	case MSG_CMD_GET_COMPL_CONFIG:
+		/* Can be handled without invoking the state machine. */
+		pHdr->bodyLength = pComm->nRegs * sizeof(struct CBP_PARAM);
+
+		assert(pHdr->bodyLength <= pComm->cmdBodySize);
+		memcpy(pComm->pCmdMsg->body, pComm->pRegFile, pHdr->bodyLength);
+
+		pHdr->status = STATUS_REPLY_SUCC;
+
+		return Comm_SendReply(pComm);
+	case MSG_CMD_SET_CONFIG:
+		/* Invoke the state machine for all assigned config registers.
+		   The register file only takes over values the state machine
+		   accepted. */
+		pParam = (struct CBP_PARAM*)pComm->pCmdMsg->body;
+		nParams = pHdr->bodyLength/sizeof(struct CBP_PARAM);
+		for(reg = 0; reg < nParams; reg++)
+		{
+			pComm->enReqState = REQ_STATE_IDLE;
+			err = SetConfigRegister(pHsm, pParam);
+			if(err != SUCCESS)
+			{
+				goto set_config_fail;
+			}
+
+			pStored = Comm_GetReg(pComm, pParam->id);
+			if(pStored != NULL && pStored->val != pParam->val)
+			{
+				pStored->val = pParam->val;
+				Comm_MarkReg(pComm, pStored);
+			}
+			pParam++;
+		}					
+		pHdr->status = STATUS_REPLY_SUCC;
+		return Comm_SendReply(pComm);
+
+set_config_fail:  
+		pHdr->status = STATUS_REPLY_FAIL;
+		return Comm_SendReply(pComm);
+	case MSG_CMD_RESUME_FEED:
+		/* The host usually reconnects the feed right before. */
+		if(pComm->connFeedSock <= 0)
+		{
+			Comm_AcceptConnections(pComm, 0);
+		}
+		pHdr->bodyLength = 0;
+		if(pComm->connFeedSock <= 0 || pComm->retain.pArena == NULL)
+		{
+			/* Without retention, there is nothing to replay. */
+			pHdr->status = STATUS_REPLY_FAIL;
+			return Comm_SendReply(pComm);
+		}
+		if(!Comm_FeedHeld(pComm))
+		{
+			/* The replay would repeat the messages sent live. */
+			OscLog(WARN, "%s: Live feed already started.\n", __func__);
+			pHdr->status = STATUS_REPLY_FAIL;
+			return Comm_SendReply(pComm);
+		}
+
+		/* Nothing has been sent on the connection yet; the messages
+		 * retained while it was held go out with the replay. */
+		pComm->feedHoldCyc = 0;
+		pHdr->msgParams.resumeFeedReply.nMsgs =
+			Ret_Seek(&pComm->retain,
+				 pHdr->msgParams.resumeFeedReq.lastSeqNr,
+				 &firstSeqNr);
+		pHdr->msgParams.resumeFeedReply.firstSeqNr = firstSeqNr;
+		OscLog(INFO, "%s: Replaying %d feed messages from frame %d on.\n",
+		       __func__, pHdr->msgParams.resumeFeedReply.nMsgs, firstSeqNr);
+
+		pHdr->status = STATUS_REPLY_SUCC;
+		return Comm_SendReply(pComm);
+	case MSG_CMD_SUBSCRIBE_REGS:
+		/* Can be handled without invoking the state machine. */
+		pHdr->bodyLength = 0;
+		if(pHdr->msgParams.subscribeRegsReq.enable > 1)
+		{
+			pHdr->status = STATUS_REPLY_FAIL;
+			return Comm_SendReply(pComm);
+		}
+		pComm->bRegNotify = pHdr->msgParams.subscribeRegsReq.enable;
+		if(pComm->bRegNotify)
+		{
+			/* The first notification brings the host up to date. */
+			memset(pComm->pRegDirty, 0xff, ((pComm->nRegs + 31)/32)*sizeof(uint32));
+		}
+		pHdr->status = STATUS_REPLY_SUCC;
+		return Comm_SendReply(pComm);
+	case MSG_CMD_TRACE_DUMP:
+		/* Sent from the snapshot slot, so the main loop does not block
+		 * on the long reply. */
+		pHdr->bodyLength = 0;
+		if(pComm->snap.sock > 0)
+		{
+			pHdr->status = STATUS_REPLY_FAIL;
+			return Comm_SendReply(pComm);
+		}
+		pComm->snap.pReply = malloc(sizeof(struct MsgHdr) +
+					    TRACE_LEN*sizeof(struct TraceRec));
+		if(pComm->snap.pReply == NULL)
+		{
+			pHdr->status = STATUS_REPLY_FAIL;
+			return Comm_SendReply(pComm);
+		}
+		nRecs = Trace_Dump((struct TraceRec*)(pComm->snap.pReply + sizeof(struct MsgHdr)));
+		pHdr->bodyLength = nRecs*sizeof(struct TraceRec);
+		pHdr->msgParams.traceDumpReply.nRecs = nRecs;
+		pHdr->msgParams.traceDumpReply.nTotal = traceRing.nRecs;
+		pHdr->msgParams.traceDumpReply.cycPerMs = (uint32)Timing_UsToCyc(1000);
+		pHdr->msgParams.traceDumpReply.unused3 = 0;
+		pHdr->status = STATUS_REPLY_SUCC;
+		memcpy(pComm->snap.pReply, pHdr, sizeof(struct MsgHdr));
+		pComm->snap.sock = pComm->connCmdSock;
+		pComm->snap.len = sizeof(struct MsgHdr) + pHdr->bodyLength;
+		pComm->snap.sent = 0;
+		return SUCCESS;
+	case MSG_CMD_SNAPSHOT:
+		/* Answered by the main program when the frame is there. One
+		 * snapshot is taken at a time. */
+		scale = pHdr->msgParams.snapshotReq.scale;
+		if(pComm->snap.sock > 0 ||
+		   pHdr->msgParams.snapshotReq.mode > SNAPSHOT_NEXT ||
+		   scale > SNAPSHOT_MAX_SCALE || (scale & (scale - 1)) != 0)
+		{
+			pHdr->bodyLength = 0;
+			pHdr->status = STATUS_REPLY_FAIL;
+			return Comm_SendReply(pComm);
+		}
+		pComm->snap.sock = pComm->connCmdSock;
+		pComm->snap.req = *pHdr;
+		return SUCCESS;
+	default:
+		OscLog(ERROR, "%s: Unsupported message type (%#x) received!\n",
+		       __func__);
+	}
+	return SUCCESS;
+}
+
+
+/*********************************************************************//*!
+ * @brief Get the number of bytes of a queued feed message still to be
+ * sent.
+ *
+ * @param pEntry The queued message.
+ * @return Number of bytes.
+ *//*********************************************************************/
+static uint32 Comm_FeedRemaining(const struct FeedQueueEntry *pEntry)
+{
+	return pEntry->hdrLen + pEntry->len - pEntry->sent;
+}
+
+/*********************************************************************//*!
+ * @brief Get the number of bytes of small feed messages in the batch
+ * being filled.
+ *
+ * @param pComm Pointer to the communication status structure.
+ * @return Number of bytes, 0 if the batch has been queued already.
+ *//*********************************************************************/
+static uint32 Comm_BatchPending(const struct COMM *pComm)
+{
+	const struct FeedBatch *pBatch = &pComm->batches[pComm->curBatch];
+
+	return pBatch->bQueued ? 0 : pBatch->len;
+}
+
+/*********************************************************************//*!
+ * @brief Get the number of bytes of all queued and batched feed messages
+ * still to be sent.
+ *
+ * @param pComm Pointer to the communication status structure.
+ * @return Number of bytes.
+ *//*********************************************************************/
+static uint32 Comm_FeedBacklog(const struct COMM *pComm)
+{
+	uint32 i, backlog = 0;
+
+	for(i = 0; i < pComm->nFeedQueued; i++)
+	{
+		backlog += Comm_FeedRemaining(&pComm->feedQueue[(pComm->feedQueueHead + i) % FEED_QUEUE_LEN]);
+	}
+	return backlog + Comm_BatchPending(pComm);
+}
+
+/*********************************************************************//*!
+ * @brief Get the number of bytes sent at once under the rate cap.
+ *
+ * @param pComm Pointer to the communication status structure.
+ * @return Number of bytes, 0 if nothing is queued.
+ *//*********************************************************************/
+static uint32 Comm_FeedChunk(const struct COMM *pComm)
+{
+	if(pComm->nFeedQueued == 0)
+	{
+		return 0;
+	}
+	return MIN(Comm_FeedRemaining(&pComm->feedQueue[pComm->feedQueueHead]),
+		   FEED_CAP_CHUNK);
+}
+
+/*********************************************************************//*!
+ * @brief Queue the batch being filled, if there is anything in it, and
+ * start filling the next one.
+ *
+ * @param pComm Pointer to the communication status structure.
+ * @return SUCCESS, or -ETRY_AGAIN if the queue is full.
+ *//*********************************************************************/
+static OSC_ERR Comm_FlushBatch(struct COMM *pComm)
+{
+	struct FeedBatch *pBatch = &pComm->batches[pComm->curBatch];
+	struct FeedQueueEntry *pEntry;
+
+	if(Comm_BatchPending(pComm) == 0)
+	{
+		return SUCCESS;
+	}
+	if(pComm->nFeedQueued == FEED_QUEUE_LEN)
+	{
+		return -ETRY_AGAIN;
+	}
+
+	/* The batch holds complete messages, so it goes out as data. */
+	pEntry = &pComm->feedQueue[(pComm->feedQueueHead + pComm->nFeedQueued) % FEED_QUEUE_LEN];
+	pEntry->hdrLen = 0;
+	pEntry->pData = pBatch->pBuf;
+	pEntry->len = pBatch->len;
+	pEntry->sent = 0;
+	pEntry->bRetained = FALSE;
+	pEntry->batch = pComm->curBatch;
+	pComm->nFeedQueued++;
+
+	pBatch->bQueued = TRUE;
+	pComm->nBatches++;
+	pComm->nBatchedMsgs += pBatch->nMsgs;
+	pComm->curBatch = (pComm->curBatch + 1) % FEED_BATCHES;
+	return SUCCESS;
+}
+
+/*********************************************************************//*!
+ * @brief Get the time until the batch being filled is due.
+ *
+ * @param pComm Pointer to the communication status structure.
+ * @param now The current cycle count.
+ * @return Time (us), 0 if the batch is due, 0xffffffff if it is empty.
+ *//*********************************************************************/
+static uint32 Comm_BatchWaitUs(const struct COMM *pComm, uint64 now)
+{
+	const struct FeedBatch *pBatch = &pComm->batches[pComm->curBatch];
+	uint32 waitedUs;
+
+	if(Comm_BatchPending(pComm) == 0)
+	{
+		return 0xffffffff;
+	}
+	waitedUs = Timing_CycToUs(now - pBatch->startCyc);
+	if(waitedUs >= pComm->batchMaxUs)
+	{
+		return 0;
+	}
+	return pComm->batchMaxUs - waitedUs;
+}
+
+/*********************************************************************//*!
+ * @brief Copy a small message into the batch being filled.
+ *
+ * @param pComm Pointer to the communication status structure.
+ * @param pHdrs The headers of the message.
+ * @param pData The data of the message.
+ * @param len Length of the data.
+ * @return TRUE if the message has been batched, FALSE if it has to be
+ *         queued on its own because no batch is free.
+ *//*********************************************************************/
+static bool Comm_BatchMsg(struct COMM *pComm,
+			  const uint8 *pHdrs,
+			  const void *pData,
+			  uint32 len)
+{
+	struct FeedBatch *pBatch = &pComm->batches[pComm->curBatch];
+	uint32 hdrLen = sizeof(struct MsgHdr) + sizeof(struct FeedHdr);
+
+	if(pBatch->len + hdrLen + len > pComm->batchSize)
+	{
+		Comm_FlushBatch(pComm);
+		pBatch = &pComm->batches[pComm->curBatch];
+	}
+	if(pBatch->bQueued || pBatch->len + hdrLen + len > pComm->batchSize)
+	{
+		return FALSE;
+	}
+
+	if(pBatch->len == 0)
+	{
+		pBatch->startCyc = OscSupCycGet64();
+		pBatch->nMsgs = 0;
+	}
+	memcpy(pBatch->pBuf + pBatch->len, pHdrs, hdrLen);
+	memcpy(pBatch->pBuf + pBatch->len + hdrLen, pData, len);
+	pBatch->len += hdrLen + len;
+	pBatch->nMsgs++;
+	return TRUE;
+}
+
+OSC_ERR Comm_SendImage(struct COMM *pComm, const void* pImg, uint32 imgSize, const struct FeedHdr *pFeedHdr)
+{
+	return Comm_SendFeedMsg(pComm, MSG_FEED_DATA, NULL, pFeedHdr, pImg, imgSize);
+}
+
+OSC_ERR Comm_SendFeedMsg(struct COMM *pComm,
+			 uint32 msgType,
+			 const FeedData_Params *pParams,
+			 const struct FeedHdr *pFeedHdr,
+			 const void *pData,
+			 uint32 len)
+{
+	struct MsgHdr msgHdr;
+	uint8 hdrs[sizeof(struct MsgHdr) + sizeof(struct FeedHdr)];
+	struct FeedQueueEntry *pEntry;
+	bool bRetained;
+
+	msgHdr.bodyLength = sizeof(struct FeedHdr) + len;
+	msgHdr.msgType = msgType;
+	msgHdr.ident = 0;
+	msgHdr.status = STATUS_FEED;
+	
+	if(pParams != NULL)
+	{
+		msgHdr.msgParams.feedDataParams = *pParams;
+	} else {
+		memset(&msgHdr.msgParams.feedDataParams, 0, sizeof(msgHdr.msgParams.feedDataParams));
+	}
+
+	memcpy(hdrs, &msgHdr, sizeof(struct MsgHdr));
+	memcpy(hdrs + sizeof(struct MsgHdr), pFeedHdr, sizeof(struct FeedHdr));
+	Trace_Add(TRACE_FEED_MSG, msgType);
+
+	bRetained = FALSE;
+	if(pComm->retain.pArena != NULL)
+	{
+		bRetained = Ret_Add(&pComm->retain, pFeedHdr->seqNr,
+				    hdrs, sizeof(hdrs), pData, len) == SUCCESS;
+		if(!bRetained)
+		{
+			OscLog(DEBUG, "%s: Feed message not retained.\n", __func__);
+		}
+	}
+	if(Comm_FeedHeld(pComm))
+	{
+		/* Only sent if the host resumes. */
+		return -ETRY_AGAIN;
+	}
+	if(pComm->retain.bReplaying)
+	{
+		if(bRetained)
+		{
+			/* Goes out with the replay. */
+			return SUCCESS;
+		}
+		/* Sent now, it would overtake the replayed messages. */
+		OscLog(DEBUG, "%s: Replay in progress, message dropped.\n", __func__);
+		return -ETRY_AGAIN;
+	}
+
+	if(pComm->connFeedSock <= 0)
+	{
+		OscLog(DEBUG, "%s: Socket not connected.\n", __func__);
+		return -ETRY_AGAIN;
+	}
+
+	if(pComm->feedCap.rate != 0 && Comm_FeedBacklog(pComm) > pComm->feedCap.burst)
+	{
+		/* The messages queued already use up more than a burst. */
+		OscLog(DEBUG, "%s: Feed rate cap exceeded, message dropped.\n", __func__);
+		pComm->nCapDropped++;
+		return -ETRY_AGAIN;
+	}
+
+	if(pComm->batchSize != 0 &&
+	   sizeof(hdrs) + len <= pComm->batchSize/FEED_BATCH_SMALL_DIV)
+	{
+		if(Comm_BatchMsg(pComm, hdrs, pData, len))
+		{
+			return SUCCESS;
+		}
+	} else {
+		/* The batched messages go first. */
+		Comm_FlushBatch(pComm);
+	}
+
+	if(pComm->nFeedQueued == FEED_QUEUE_LEN)
+	{
+		OscLog(WARN, "%s: Feed queue full, message dropped.\n", __func__);
+		return -ETRY_AGAIN;
+	}
+
+	/* Queue the message; the headers are copied, the data is not. */
+	pEntry = &pComm->feedQueue[(pComm->feedQueueHead + pComm->nFeedQueued) % FEED_QUEUE_LEN];
+	memcpy(pEntry->hdrs, hdrs, sizeof(hdrs));
+	pEntry->hdrLen = sizeof(hdrs);
+	pEntry->pData = (const uint8*)pData;
+	pEntry->len = len;
+	pEntry->sent = 0;
+	pEntry->bRetained = FALSE;
+	pEntry->batch = FEED_NO_BATCH;
+	pComm->nFeedQueued++;
+
+	return SUCCESS;
+}
+
+/*********************************************************************//*!
+ * @brief Set an integer socket option.
+ *
+ * @param sock The socket.
+ * @param level Protocol level of the option.
+ * @param name Name of the option.
+ * @param val Value of the option.
+ * @return SUCCESS or -EDEVICE.
+ *//*********************************************************************/
+static OSC_ERR Comm_SetSockOpt(int sock, int level, int name, int val)
+{
+	if(setsockopt(sock, level, name, &val, sizeof(val)) != 0)
+	{
+		OscLog(WARN, "%s: Unable to set socket option %d (%s).\n",
+		       __func__, name, strerror(errno));
+		return -EDEVICE;
+	}
+	return SUCCESS;
+}
+
+/*! @brief The socket options the feed profiles change. */
+static const struct
+{
+	int level;
+	int name;
+} feedSockOpts[FEED_SOCK_OPTS] =
+{
+	{ IPPROTO_TCP, TCP_NODELAY },
+	{ IPPROTO_TCP, TCP_CORK },
+	{ SOL_SOCKET, SO_KEEPALIVE },
+	{ IPPROTO_TCP, TCP_KEEPIDLE },
+	{ IPPROTO_TCP, TCP_KEEPINTVL },
+	{ IPPROTO_TCP, TCP_KEEPCNT },
+	{ SOL_SOCKET, SO_SNDBUF }
+};
+
+static void Comm_SaveFeedDefaults(struct COMM *pComm)
+{
+	uint32 i;
+	socklen_t len;
+
+	for(i = 0; i < FEED_SOCK_OPTS; i++)
+	{
+		len = sizeof(int);
+		if(getsockopt(pComm->connFeedSock, feedSockOpts[i].level, feedSockOpts[i].name,
+			      &pComm->feedSockDefaults[i], &len) != 0)
+		{
+			pComm->feedSockDefaults[i] = -1;
+		}
+	}
+	pComm->bFeedSockTuned = FALSE;
+}
+
+/*********************************************************************//*!
+ * @brief Restore the socket options of the feed saved on connecting.
+ *
+ * @param pComm Pointer to the communication status structure.
+ *//*********************************************************************/
+static void Comm_RestoreFeedDefaults(struct COMM *pComm)
+{
+	uint32 i;
+	int val;
+
+	for(i = 0; i < FEED_SOCK_OPTS; i++)
+	{
+		val = pComm->feedSockDefaults[i];
+		if(val < 0)
+		{
+			continue;
+		}
+		if(feedSockOpts[i].name == SO_SNDBUF)
+		{
+			/* The kernel reports twice the size set. */
+			val /= 2;
+		}
+		Comm_SetSockOpt(pComm->connFeedSock, feedSockOpts[i].level,
+				feedSockOpts[i].name, val);
+	}
+	pComm->bFeedSockTuned = FALSE;
+}
+
+static void Comm_ApplyFeedProfile(struct COMM *pComm)
+{
+	int sock = pComm->connFeedSock;
+
+	gettimeofday(&pComm->feedTuneTime, NULL);
+	pComm->feedBytesSent = 0;
+	if(sock <= 0)
+	{
+		return;
+	}
+	if(pComm->feedProfile == FEED_PROFILE_DEFAULT)
+	{
+		/* Only options another profile has changed are set, as setting
+		 * the send buffer turns off its automatic sizing. */
+		if(pComm->bFeedSockTuned)
+		{
+			Comm_RestoreFeedDefaults(pComm);
+		}
+		return;
+	}
+	pComm->bFeedSockTuned = TRUE;
+
+	Comm_SetSockOpt(sock, IPPROTO_TCP, TCP_NODELAY,
+			pComm->feedProfile == FEED_PROFILE_LOW_LATENCY);
+	Comm_SetSockOpt(sock, IPPROTO_TCP, TCP_CORK,
+			pComm->feedProfile == FEED_PROFILE_THROUGHPUT);
+
+	/* Detect hosts that disappeared without closing the connection. A
+	 * constrained link is probed sooner, as the feed stalls otherwise. */
+	Comm_SetSockOpt(sock, SOL_SOCKET, SO_KEEPALIVE, 1);
+	Comm_SetSockOpt(sock, IPPROTO_TCP, TCP_KEEPIDLE,
+			pComm->feedProfile == FEED_PROFILE_CONSTRAINED ? 5 : 30);
+	Comm_SetSockOpt(sock, IPPROTO_TCP, TCP_KEEPINTVL,
+			pComm->feedProfile == FEED_PROFILE_CONSTRAINED ? 2 : 10);
+	Comm_SetSockOpt(sock, IPPROTO_TCP, TCP_KEEPCNT, 3);
+
+	/* Start values of the send buffer until the link has been measured. */
+	switch(pComm->feedProfile)
+	{
+	case FEED_PROFILE_LOW_LATENCY:
+		Comm_SetSockOpt(sock, SOL_SOCKET, SO_SNDBUF, 32*1024);
+		break;
+	case FEED_PROFILE_THROUGHPUT:
+		Comm_SetSockOpt(sock, SOL_SOCKET, SO_SNDBUF, 512*1024);
+		break;
+	case FEED_PROFILE_CONSTRAINED:
+		Comm_SetSockOpt(sock, SOL_SOCKET, SO_SNDBUF, 16*1024);
+		break;
+	}
+}
+
+static bool Comm_FeedHeld(struct COMM *pComm)
+{
+	if(pComm->feedHoldCyc == 0)
+	{
+		return FALSE;
+	}
+	if(OscSupCycGet64() < pComm->feedHoldCyc)
+	{
+		return TRUE;
+	}
+	OscLog(INFO, "%s: No resume requested, starting the live feed.\n", __func__);
+	pComm->feedHoldCyc = 0;
+	return FALSE;
+}
+
+OSC_ERR Comm_SetFeedProfile(struct COMM *pComm, uint32 profile)
+{
+	if(profile >= FEED_PROFILE_COUNT)
+	{
+		return -EINVALID_PARAMETER;
+	}
+	pComm->feedProfile = profile;
+	Comm_ApplyFeedProfile(pComm);
+	return SUCCESS;
+}
+
+OSC_ERR Comm_TuneFeed(struct COMM *pComm, struct FeedLinkStats *pStats)
+{
+	struct timeval now;
+	uint64 elapsedUs;
+	uint32 bdp, sndBuf;
+	int val;
+	socklen_t len;
+#ifdef TCP_INFO
+	struct tcp_info info;
+#endif /* TCP_INFO */
+
+	memset(pStats, 0, sizeof(struct FeedLinkStats));
+	if(pComm->connFeedSock <= 0)
+	{
+		return -ETRY_AGAIN;
+	}
+
+	gettimeofday(&now, NULL);
+	/* Frames may be hours apart in idle or external trigger mode. */
+	elapsedUs = (uint64)(now.tv_sec - pComm->feedTuneTime.tv_sec)*1000000 +
+		now.tv_usec - pComm->feedTuneTime.tv_usec;
+	if(elapsedUs > 0)
+	{
+		pStats->kBps = (uint32)(((uint64)pComm->feedBytesSent*1000000/1024)/elapsedUs);
+	}
+	pComm->feedTuneTime = now;
+	pComm->feedBytesSent = 0;
+
+	/* The bandwidth-delay product is the larger of what TCP allows in
+	 * flight and what the feed actually moved during one round trip. */
+	bdp = 0;
+#ifdef TCP_INFO
+	len = sizeof(info);
+	if(getsockopt(pComm->connFeedSock, IPPROTO_TCP, TCP_INFO, &info, &len) == 0)
+	{
+		pStats->rttUs = info.tcpi_rtt;
+		pStats->retrans = info.tcpi_total_retrans;
+		bdp = (uint32)(((uint64)pStats->kBps*1024*pStats->rttUs)/1000000);
+		bdp = MAX(bdp, info.tcpi_snd_cwnd*info.tcpi_snd_mss);
+	}
+#endif /* TCP_INFO */
+
+	switch(pComm->feedProfile)
+	{
+	case FEED_PROFILE_LOW_LATENCY:
+	case FEED_PROFILE_CONSTRAINED:
+		/* Just enough to keep the link busy. */
+		sndBuf = bdp;
+		break;
+	case FEED_PROFILE_THROUGHPUT:
+		/* Room for the data in flight and as much again to refill. */
+		sndBuf = 2*bdp;
+		break;
+	default:
+		sndBuf = 0;
+	}
+	if(sndBuf != 0)
+	{
+		sndBuf = sndBuf < FEED_SNDBUF_MIN ? FEED_SNDBUF_MIN : sndBuf;
+		sndBuf = sndBuf > FEED_SNDBUF_MAX ? FEED_SNDBUF_MAX : sndBuf;
+		Comm_SetSockOpt(pComm->connFeedSock, SOL_SOCKET, SO_SNDBUF, sndBuf);
+	}
+
+	len = sizeof(val);
+	if(getsockopt(pComm->connFeedSock, SOL_SOCKET, SO_SNDBUF, &val, &len) == 0)
+	{
+		pStats->sndBuf = val;
+	}
+	return SUCCESS;
+}
+
+/*********************************************************************//*!
+ * @brief Empty the feed queue and the batches and stop a replay.
+ *
+ * @param pComm Pointer to the communication status structure.
+ *//*********************************************************************/
+static void Comm_DropFeedQueue(struct COMM *pComm)
+{
+	uint32 i;
+
+	pComm->nFeedQueued = 0;
+	for(i = 0; i < FEED_BATCHES; i++)
+	{
+		pComm->batches[i].len = 0;
+		pComm->batches[i].bQueued = FALSE;
+	}
+	Ret_StopReplay(&pComm->retain);
+}
+
+/*********************************************************************//*!
+ * @brief Queue the next retained message to be replayed.
+ *
+ * The replayed messages are queued one by one, so only one of them is
+ * pinned in the retention window at a time.
+ *
+ * @param pComm Pointer to the communication status structure.
+ *//*********************************************************************/
+static void Comm_QueueReplay(struct COMM *pComm)
+{
+	struct FeedQueueEntry *pEntry;
+	const uint8 *pMsg;
+	uint32 len;
+
+	if(!Ret_Next(&pComm->retain, &pMsg, &len))
+	{
+		OscLog(INFO, "%s: Replay complete.\n", __func__);
+		return;
+	}
+
+	pEntry = &pComm->feedQueue[(pComm->feedQueueHead + pComm->nFeedQueued) % FEED_QUEUE_LEN];
+	memcpy(pEntry->hdrs, pMsg, sizeof(pEntry->hdrs));
+	pEntry->hdrLen = sizeof(pEntry->hdrs);
+	pEntry->pData = pMsg + sizeof(pEntry->hdrs);
+	pEntry->len = len - sizeof(pEntry->hdrs);
+	pEntry->sent = 0;
+	pEntry->bRetained = TRUE;
+	pEntry->batch = FEED_NO_BATCH;
+	pComm->nFeedQueued++;
+}
+
+/*********************************************************************//*!
+ * @brief Send queued feed messages until the socket would block.
+ *
+ * On send error, the feed socket is closed and the queue is emptied.
+ *
+ * @param pComm Pointer to the communication status structure.
+ * @return SUCCESS or a suitable error code.
+ *//*********************************************************************/
+static OSC_ERR Comm_SendQueued(struct COMM *pComm)
+{
+	struct FeedQueueEntry *pEntry;
+	struct iovec iov[2];
+	struct msghdr msg;
+	uint32 len, avail;
+	int retval;
+
+	while(pComm->nFeedQueued > 0)
+	{
+		/* Under the rate cap, the messages go out in chunks as the
+		 * tokens accrue. */
+		avail = Timing_BucketFill(&pComm->feedCap, OscSupCycGet64());
+		if(avail < Comm_FeedChunk(pComm))
+		{
+			/* Still corked; a partial segment must not be pushed out
+			 * while waiting for the tokens. */
+			return SUCCESS;
+		}
+
+		/* The rest of the headers and the data go out in one write. */
+		pEntry = &pComm->feedQueue[pComm->feedQueueHead];
+		len = MIN(Comm_FeedRemaining(pEntry), avail);
+		memset(&msg, 0, sizeof(msg));
+		msg.msg_iov = iov;
+		if(pEntry->sent < pEntry->hdrLen)
+		{
+			iov[0].iov_base = pEntry->hdrs + pEntry->sent;
+			iov[0].iov_len = MIN(pEntry->hdrLen - pEntry->sent, len);
+			iov[1].iov_base = (void*)pEntry->pData;
+			iov[1].iov_len = len - iov[0].iov_len;
+			msg.msg_iovlen = iov[1].iov_len != 0 ? 2 : 1;
+		} else {
+			iov[0].iov_base = (void*)(pEntry->pData + (pEntry->sent - pEntry->hdrLen));
+			iov[0].iov_len = len;
+			msg.msg_iovlen = 1;
+		}
+
+		retval = sendmsg(pComm->connFeedSock, &msg, MSG_DONTWAIT | MSG_NOSIGNAL);
+		if(retval < 0)
+		{
+			if(errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)
+			{
+				return SUCCESS;
+			}
+			OscLog(ERROR, "%s: Send error (%s)!\n", 
+			       __func__, strerror(errno));
+			close(pComm->connFeedSock);
+			pComm->connFeedSock = 0;
+			Comm_DropFeedQueue(pComm);
+			return -EDEVICE;
+		}
+
+		Trace_Add(TRACE_FEED_SEND, retval);
+		pEntry->sent += retval;
+		pComm->feedBytesSent += retval;
+		Timing_BucketTake(&pComm->feedCap, retval);
+		if(pEntry->sent == pEntry->hdrLen + pEntry->len)
+		{
+			if(pEntry->bRetained)
+			{
+				Ret_Unpin(&pComm->retain);
+			}
+			if(pEntry->batch != FEED_NO_BATCH)
+			{
+				pComm->batches[pEntry->batch].len = 0;
+				pComm->batches[pEntry->batch].bQueued = FALSE;
+			}
+			pComm->feedQueueHead = (pComm->feedQueueHead + 1) % FEED_QUEUE_LEN;
+			pComm->nFeedQueued--;
+		}
+	}
+
+	if(pComm->feedProfile == FEED_PROFILE_THROUGHPUT)
+	{
+		/* The queue has been drained. Push out the last partial
+		 * segment, then cork again for the next messages. */
+		Comm_SetSockOpt(pComm->connFeedSock, IPPROTO_TCP, TCP_CORK, 0);
+		Comm_SetSockOpt(pComm->connFeedSock, IPPROTO_TCP, TCP_CORK, 1);
+	}
+	return SUCCESS;
+}
+
+/*********************************************************************//*!
+ * @brief Send the snapshot reply until the socket would block.
+ *
+ * On send error, the connection to the client is closed.
+ *
+ * @param pComm Pointer to the communication status structure.
+ *//*********************************************************************/
+static void Comm_SendSnapshot(struct COMM *pComm)
+{
+	struct Snapshot *pSnap = &pComm->snap;
+	int retval;
+
+	while(pSnap->sent < pSnap->len)
+	{
+		retval = send(pSnap->sock,
+			      pSnap->pReply + pSnap->sent,
+			      pSnap->len - pSnap->sent,
+			      MSG_DONTWAIT | MSG_NOSIGNAL);
+		if(retval < 0)
+		{
+			if(errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)
+			{
+				return;
+			}
+			OscLog(ERROR, "%s: Send error (%s)!\n",
+			       __func__, strerror(errno));
+			Comm_CloseCmdSock(pComm, pSnap->sock);
+			return;
+		}
+		pSnap->sent += retval;
+	}
+	Comm_DropSnapshot(pComm);
+}
+
+OSC_ERR Comm_PumpFeed(struct COMM *pComm, int timeout_ms)
+{
+	int retval, maxSock;
+	uint32 i, waitUs, batchWaitUs;
+	fd_set rd, wr;
+	struct timeval timeout;
+
+	if(pComm->snap.pReply != NULL)
+	{
+		Comm_SendSnapshot(pComm);
+	}
+
+	if(pComm->connFeedSock <= 0)
+	{
+		if(pComm->nFeedQueued == 0 && !pComm->retain.bReplaying)
+		{
+			return SUCCESS;
+		}
+		Comm_DropFeedQueue(pComm);
+		return -ETRY_AGAIN;
+	}
+	if(pComm->nFeedQueued == 0 && pComm->retain.bReplaying)
+	{
+		Comm_QueueReplay(pComm);
+	}
+	batchWaitUs = Comm_BatchWaitUs(pComm, OscSupCycGet64());
+	if(batchWaitUs == 0)
+	{
+		Comm_FlushBatch(pComm);
+	}
+
+	if(pComm->nFeedQueued != 0)
+	{
+		/* Under the rate cap, wait for the tokens instead of the
+		 * socket. */
+		Timing_BucketFill(&pComm->feedCap, OscSupCycGet64());
+		waitUs = Timing_BucketWaitUs(&pComm->feedCap, Comm_FeedChunk(pComm));
+	} else if(batchWaitUs != 0xffffffff)
+	{
+		/* Wait for the batch to be due. */
+		waitUs = batchWaitUs;
+	} else {
+		return SUCCESS;
+	}
+
+	FD_ZERO(&rd);
+	FD_ZERO(&wr);
+	if(waitUs == 0)
+	{
+		FD_SET(pComm->connFeedSock, &wr);
+	}
+	maxSock = Comm_SetCmdConns(pComm, &rd, pComm->connFeedSock);
+
+	timeout.tv_sec = timeout_ms/1000;
+	timeout.tv_usec = (timeout_ms % 1000)*1000;
+	if(waitUs != 0 && waitUs < (uint32)timeout_ms*1000)
+	{
+		timeout.tv_sec = 0;
+		timeout.tv_usec = waitUs;
+	}
+
+	retval = select(maxSock + 1, &rd, &wr, NULL, &timeout);
+	if(retval < 0)
+	{
+		if(errno == EINTR)
+		{
+			return SUCCESS;
+		}
+		OscLog(ERROR, "%s: Select failed (%s)!\n", __func__, strerror(errno));
+		return -EDEVICE;
+	} else if(retval == 0)
+	{
+		if(waitUs != 0 && waitUs <= (uint32)timeout_ms*1000)
+		{
+			/* The tokens are there or the batch is due now. */
+			if(pComm->nFeedQueued == 0)
+			{
+				Comm_FlushBatch(pComm);
+			}
+			return Comm_SendQueued(pComm);
+		}
+		return -ETIMEOUT;
+	}
+
+	for(i = 0; i < pComm->nCmdConns; i++)
+	{
+		if(FD_ISSET(pComm->cmdConns[i], &rd))
+		{
+			/* Commands go first. */
+			return SUCCESS;
+		}
+	}
+	return Comm_SendQueued(pComm);
+}
+
+OSC_ERR Comm_SetFeedCap(struct COMM *pComm, uint32 rate, uint32 burst)
+{
+	if(burst < FEED_CAP_CHUNK)
+	{
+		return -EINVALID_PARAMETER;
+	}
+	Timing_BucketSetup(&pComm->feedCap, rate, burst);
+	return SUCCESS;
+}
+
+OSC_ERR Comm_SetFeedBatch(struct COMM *pComm, uint32 size, uint32 maxUs)
+{
+	uint8 *pBufs[FEED_BATCHES];
+	uint32 i;
+
+	if(size > FEED_BATCH_MAX_BYTES)
+	{
+		return -EINVALID_PARAMETER;
+	}
+	for(i = 0; i < FEED_BATCHES; i++)
+	{
+		if(pComm->batches[i].len != 0)
+		{
+			return -ETRY_AGAIN;
+		}
+	}
+
+	memset(pBufs, 0, sizeof(pBufs));
+	for(i = 0; i < FEED_BATCHES && size != 0; i++)
+	{
+		pBufs[i] = malloc(size);
+		if(pBufs[i] == NULL)
+		{
+			while(i-- > 0)
+			{
+				free(pBufs[i]);
+			}
+			return -EOUT_OF_MEMORY;
+		}
+	}
+	for(i = 0; i < FEED_BATCHES; i++)
+	{
+		free(pComm->batches[i].pBuf);
+		pComm->batches[i].pBuf = pBufs[i];
+	}
+	pComm->batchSize = size;
+	pComm->batchMaxUs = maxUs;
+	return SUCCESS;
+}
+
+OSC_ERR Comm_SetRetention(struct COMM *pComm, uint32 budget)
+{
+	if(pComm->retain.pinned != RET_NONE)
+	{
+		return -ETRY_AGAIN;
+	}
+	return Ret_SetBudget(&pComm->retain, budget);
+}
+
+bool Comm_FeedBusy(const struct COMM *pComm)
+{
+	return pComm->nFeedQueued > 0 || pComm->retain.bReplaying ||
+		Comm_BatchPending(pComm) != 0 ||
+		pComm->snap.pReply != NULL;
+}
+
+bool Comm_FeedUsesData(const struct COMM *pComm)
+{
+	const struct FeedQueueEntry *pEntry;
+	uint32 i;
+
+	for(i = 0; i < pComm->nFeedQueued; i++)
+	{
+		pEntry = &pComm->feedQueue[(pComm->feedQueueHead + i) % FEED_QUEUE_LEN];
+		if(!pEntry->bRetained && pEntry->batch == FEED_NO_BATCH)
+		{
+			return TRUE;
+		}
+	}
+	return FALSE;
+}
+
+bool Comm_FeedDrained(const struct COMM *pComm)
+{
+	int outq;
+
+	if(pComm->nFeedQueued != 0 || Comm_BatchPending(pComm) != 0)
+	{
+		return FALSE;
+	}
+	/* The bytes in the send queue of the socket have not been
+	 * acknowledged yet. */
+	if(pComm->connFeedSock <= 0 ||
+	   ioctl(pComm->connFeedSock, SIOCOUTQ, &outq) != 0)
+	{
+		return TRUE;
+	}
+	return outq == 0;
+}
+
+const struct MsgHdr* Comm_SnapshotRequest(const struct COMM *pComm)
+{
+	if(pComm->snap.sock <= 0 || pComm->snap.pReply != NULL)
+	{
+		return NULL;
+	}
+	return &pComm->snap.req;
+}
+
+uint8* Comm_SnapshotReply(struct COMM *pComm,
+			  const SnapshotReply_Params *pParams,
+			  const struct FeedHdr *pFeedHdr)
+{
+	struct Snapshot *pSnap = &pComm->snap;
+	struct MsgHdr hdr = pSnap->req;
+	uint32 imgSize;
+	int sock, replySock;
+
+	hdr.bodyLength = 0;
+	hdr.status = STATUS_REPLY_FAIL;
+	if(pFeedHdr != NULL)
+	{
+		imgSize = pFeedHdr->imgWidth*pFeedHdr->imgHeight;
+		pSnap->len = sizeof(struct MsgHdr) + sizeof(struct FeedHdr) + imgSize;
+		pSnap->pReply = malloc(pSnap->len);
+		if(pSnap->pReply == NULL)
+		{
+			OscLog(ERROR, "%s: Unable to allocate the reply (%d bytes)!\n",
+			       __func__, pSnap->len);
+		} else {
+			hdr.bodyLength = sizeof(struct FeedHdr) + imgSize;
+			hdr.status = STATUS_REPLY_SUCC;
+			hdr.msgParams.snapshotReply = *pParams;
+			memcpy(pSnap->pReply, &hdr, sizeof(struct MsgHdr));
+			memcpy(pSnap->pReply + sizeof(struct MsgHdr),
+			       pFeedHdr, sizeof(struct FeedHdr));
+			pSnap->sent = 0;
+			return pSnap->pReply + sizeof(struct MsgHdr) + sizeof(struct FeedHdr);
+		}
+	}
+
+	/* The failure is just a header, it is sent right away. */
+	sock = replySock = pSnap->sock;
+	Comm_DropSnapshot(pComm);
+	if(Comm_SendData(&replySock, &hdr, sizeof(struct MsgHdr)) != SUCCESS)
+	{
+		Comm_CloseCmdSock(pComm, sock);
+	}
+	return NULL;
+}
+
+struct CBP_PARAM* Comm_GetReg(struct COMM *pComm, uint32 id)
+{
+	uint32 reg;
+
+	for(reg = 0; reg < pComm->nRegs; reg++)
+	{
+		if(pComm->pRegFile[reg].id == id)
+		{
+			return &pComm->pRegFile[reg];
+		}
+	}
+	return NULL;
+}
+
+void Comm_UpdateReg(struct COMM *pComm, uint32 id, uint32 val)
+{
+	struct CBP_PARAM *pReg = Comm_GetReg(pComm, id);
+
+	if(pReg != NULL && pReg->val != val)
+	{
+		pReg->val = val;
+		Comm_MarkReg(pComm, pReg);
+	}
+}
+
+OSC_ERR Comm_SendRegChanges(struct COMM *pComm)
+{
+	struct FeedHdr feedHdr = pComm->feedHdr;
+	uint32 i, reg, nWords, nChanged = 0;
+	OSC_ERR err;
+
+	if(!pComm->bRegNotify || pComm->connFeedSock <= 0 || pComm->pRegDirty == NULL)
+	{
+		return SUCCESS;
+	}
+	nWords = (pComm->nRegs + 31)/32;
+	for(i = 0; i < nWords && pComm->pRegDirty[i] == 0; i++);
+	if(i == nWords)
+	{
+		return SUCCESS;
+	}
+	/* The body of the last notification is not copied when it is
+	 * queued. */
+	for(i = 0; i < pComm->nFeedQueued; i++)
+	{
+		if(pComm->feedQueue[(pComm->feedQueueHead + i) % FEED_QUEUE_LEN].pData ==
+		   (const uint8*)pComm->pRegChanges)
+		{
+			return -ETRY_AGAIN;
+		}
+	}
+
+	for(reg = 0; reg < pComm->nRegs; reg++)
+	{
+		if(pComm->pRegDirty[reg/32] & (1u << (reg % 32)))
+		{
+			pComm->pRegChanges[nChanged++] = pComm->pRegFile[reg];
+		}
+	}
+	/* No image, only the frame for reference. */
+	feedHdr.imgWidth = 0;
+	feedHdr.imgHeight = 0;
+	err = Comm_SendFeedMsg(pComm,
+			       MSG_FEED_REGS,
+			       NULL,
+			       &feedHdr,
+			       pComm->pRegChanges,
+			       nChanged*sizeof(struct CBP_PARAM));
+	if(err == SUCCESS)
+	{
+		memset(pComm->pRegDirty, 0, nWords*sizeof(uint32));
+	}
+	return err;
+}
+
+static OSC_ERR Comm_SendData(int *pSock, const void *pBuf, uint32 len)
+{
+	int retval;
+	uint8 *pTemp = (uint8*)pBuf;
+	uint32 bytesToSend = len;
+
+	while(bytesToSend > 0)
+	{
+		/* A client that has gone away must not raise SIGPIPE. */
+		retval = send(*pSock, pTemp, bytesToSend, MSG_NOSIGNAL);
+		if(retval < 0)
+		{
+			OscLog(ERROR, "%s: Send error (%s)!\n", 
+			       __func__, strerror(errno));
+			*pSock = 0;
+			return -EDEVICE;
+		}
+		bytesToSend -= retval;
+		pTemp += retval;
+	}
+	return SUCCESS;
+}
+
+static OSC_ERR Comm_InitSocket(int *pSock, int port)
+{
+	int sock, retval, on;
+	struct sockaddr_in addr;
+
+	if(*pSock > 0)
+	{
+		return -EALREADY_INITIALIZED;
+	}
+
+	/* Initialize command socket. */
+	sock = socket(PF_INET, SOCK_STREAM, 0);
+	if (sock < 0)
+	{
+		OscLog(ERROR, "%s: Could not get socket!\n", __func__);
+		return -EDEVICE;
+	}	
+
+	/* Enable address reuse, because Linux sends TCP-FIN and Windows 
+	   uses TCP-RST, so Windows does not close connection correctly 
+	   on close(sock) */
+	on = 1;
+	retval = setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+	if (retval==-1)
+	{
+		OscLog(ERROR, "%s: could not set socket-option SO_REUSEADDR", __func__);
+		return -EDEVICE;
+	}
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons(port);
+	addr.sin_addr.s_addr = htonl(INADDR_ANY);
+
+	retval = bind(sock, (struct sockaddr *)&addr, sizeof(addr));
+	if (retval==-1)
+	{
+		OscLog(ERROR, "%s: could not bind socket (%s)!", 
+		       __func__, strerror(errno));
+		return -EDEVICE;
+	}
+
+	retval = listen(sock, 1);
+	if(retval == -1)
+	  {
+	    OscLog(ERROR, "%s: Unable to listen to socket (%s)!\n",
+		   __func__, strerror(errno));	    
+	    return -EDEVICE;
+	  }
+
+	*pSock = sock;
+
+	return SUCCESS;
+}
+
+OSC_ERR Comm_Init(struct COMM *pComm)
+{
+	OSC_ERR err;
+
+	if (pComm->cmdSock > 0 || pComm->feedSock > 0)
+	{
+		return -EALREADY_INITIALIZED;
+	}
+
+	/* Retention stays disabled until a budget is set, the feed is not
+	 * capped until a rate is set and small messages are not batched until
+	 * a batch size is set. */
+	Ret_SetBudget(&pComm->retain, 0);
+	Comm_SetFeedCap(pComm, 0, FEED_CAP_DEFAULT_BURST);
+	Comm_SetFeedBatch(pComm, 0, FEED_BATCH_DEFAULT_US);
+
+	/* The longest commands write or read out all registers. */
+	pComm->cmdBodySize = pComm->nRegs*sizeof(struct CBP_PARAM);
+	pComm->pCmdMsg = malloc(sizeof(struct MsgHdr) + pComm->cmdBodySize);
+	pComm->pRegDirty = calloc((pComm->nRegs + 31)/32, sizeof(uint32));
+	pComm->pRegChanges = malloc(pComm->nRegs*sizeof(struct CBP_PARAM));
+	if(pComm->pCmdMsg == NULL || pComm->pRegDirty == NULL ||
+	   pComm->pRegChanges == NULL)
+	{
+		Comm_DeInit(pComm);
+		return -EOUT_OF_MEMORY;
+	}
+
+	/* Initialize command socket. */
+	err = Comm_InitSocket(&pComm->cmdSock, TCP_CMD_PORT);
+	if(err != SUCCESS && err != -EALREADY_INITIALIZED)
+	{
+		Comm_DeInit(pComm);
+		return err;
+	}
+
+	/* Initialize feed socket. */
+	err = Comm_InitSocket(&pComm->feedSock, TCP_FEED_PORT);
+	if(err != SUCCESS && err != -EALREADY_INITIALIZED)
+	{
+		Comm_DeInit(pComm);
+		return err;
+	}
+
+	return SUCCESS;
+}
+
+
+void Comm_DeInit(struct COMM *pComm)
+{
+	while(pComm->nCmdConns > 0)
+	{
+		Comm_CloseCmdConn(pComm, pComm->nCmdConns - 1);
+	}
+	pComm->connCmdSock = -1;
+	if(pComm->connFeedSock > 0)
+	{
+		close(pComm->connFeedSock);
+		pComm->connFeedSock = -1;
+	}
+	if(pComm->cmdSock > 0)
+	{
+		close(pComm->cmdSock);
+		pComm->cmdSock = -1;
+	}
+	if(pComm->feedSock > 0)
+	{
+		close(pComm->feedSock);
+		pComm->feedSock = -1;
+	}
+	Ret_SetBudget(&pComm->retain, 0);
+	Comm_DropFeedQueue(pComm);
+	Comm_SetFeedBatch(pComm, 0, pComm->batchMaxUs);
+	free(pComm->pCmdMsg);
+	pComm->pCmdMsg = NULL;
+	free(pComm->pRegDirty);
+	pComm->pRegDirty = NULL;
+	free(pComm->pRegChanges);
+	pComm->pRegChanges = NULL;
+}
+
+
+
+
+
+
@@ -1,350 +1,937 @@
-/*	Target side application for the Rich Viewer.
-	Copyright (C) 2008 Supercomputing Systems AG
-	
-	This library is free software; you can redistribute it and/or modify it
-	under the terms of the GNU Lesser General Public License as published by
-	the Free Software Foundation; either version 2.1 of the License, or (at
-	your option) any later version.
-	
-	This library is distributed in the hope that it will be useful, but
-	WITHOUT ANY WARRANTY; without even the implied warranty of
-	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser
-	General Public License for more details.
-	
-	You should have received a copy of the GNU Lesser General Public License
-	along with this library; if not, write to the Free Software Foundation,
-	Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
-*/
-
-/*! @file communication.h
- * @brief Header file for the TCP/UDP communication.
- */
- 
-#include <stdio.h>
-#include <stdlib.h>
-#include <sys/types.h>
-#include <sys/socket.h>
-#include <sys/select.h>
-#include <netinet/in.h>
-#include <errno.h>
-#include <string.h>
-#include <time.h>
-#include <sys/time.h>
-#include <unistd.h>
-#include <assert.h>
-
-#include "inc/oscar.h"
-
-#ifndef COMMUNICATION_H
-#define COMMUNICATION_H
-
-/******************************************************************************
-*
-*	Host - Target protocol definitions
-*
-******************************************************************************/
-/*! @brief Version of the Common base protocol.*/
-#define CBP_VERSION 2008121600
-/*! @brief Version of the Feed protocol. */
-#define FEED_VERSION 2008121600
-
-/*! @brief TCP port to exchange commands with the host. */
-#define TCP_CMD_PORT    49100
-/*! @brief TCP image feed port number */
-#define TCP_FEED_PORT   49099
-
-
-/*! @brief socket error value */
-#define SOCK_ERROR 		-1
-/*! @brief Maximum message size (bytes) */
-#define MAX_MSG_BODY_LENGTH	64*1024
-
-/******************************************************************************
-*	Message header
-******************************************************************************/
-
-/************ Message types **************/
-/*! @brief Command to get version information. */
-#define MSG_CMD_GET_VER			1
-/*! @brief Command to set config registers. */
-#define MSG_CMD_SET_CONFIG		10
-/*! @brief Command to read out the complete config register file. */
-#define MSG_CMD_GET_COMPL_CONFIG	20
-/*! @brief Message contains feed data. */
-#define MSG_FEED_DATA                   30
-
-/***** Status codes in struct MsgHdr *****/
-/*! @brief Status code for a request. */
-#define STATUS_REQUEST   	20
-/*! @brief Status code for a successful reply. */
-#define STATUS_REPLY_SUCC	21
-/*! @brief Status code for a failed reply. */
-#define STATUS_REPLY_FAIL	22
-/*! @brief Status code for a feed message. */
-#define STATUS_FEED	        30
-
-/*! @brief Dummy placeholder structure for message types without commands. */
-typedef struct _Generic_Params
-{
-	/*! @brief Message type specific parameter 0. */
-	uint32 param0;
-	/*! @brief Message type specific parameter 1. */
-	uint32 param1;
-	/*! @brief Message type specific parameter 2. */
-	uint32 param2;
-	/*! @brief Message type specific parameter 3. */
-	uint32 param3;
-} Generic_Params;
-
-/*! @brief MsgHdr parameters for the request message of the GetVersion 
-  command. */
-typedef Generic_Params GetVersionReq_Params;
-
-/*! @brief MsgHdr parameters for the reply message of the GetVersion 
-  command. */
-typedef struct _GetVersionReply_Params
-{
-	/*! @brief Version of the Common Base Protocol. */
-	uint32 CBPVersion;
-	/*! @brief Version of the Feed Protocol. */
-	uint32 FeedProtVersion;
-	/*! @brief Target software version (Version of this program. */
-	uint32 TargetSWVersion;
-	/*! @brief unused */
-	uint32 unused3;
-} GetVersionReply_Params;
-
-/*! @brief MsgHdr parameters for the request message of the SetConfig
-  command. */
-typedef Generic_Params SetConfigReq_Params;
-/*! @brief MsgHdr parameters for the reply message of the SetConfig 
-  command. */
-typedef Generic_Params SetConfigReply_Params;
-
-/*! @brief MsgHdr parameters for the request message of the GetCompleteConfig
-  command. */
-typedef  Generic_Params GetComplConfigReq_Params;
-/*! @brief MsgHdr parameters for the reply message of the GetCompleteConfig
-  command. */
-typedef  Generic_Params GetcomplConfigReply_Params;
-
-/*! @brief MsgHdr parameters for the feed protocol message. */
-typedef  Generic_Params FeedData_Params;
-
-/*! @brief The header shared by all messages (commands and feed data). */
-struct MsgHdr
-{
-	/*! @brief Length of the body following this header in bytes. */
-	uint32 bodyLength;
-	/*! @brief Message type identifier. */
-	uint32 msgType;
-	/*! @brief This field may be used to identify messages e.g. for a
-	  sequence number. */
-	uint32 ident;
-	/*! @brief Identifies whether the message is a request, reply, etc. */
-	uint32 status;
-
-	/*! @brief 4 additional values that depend on the message type. */
-	union _msgParams
-	{
-		GetVersionReq_Params getVerReq;
-		GetVersionReply_Params getVerReply;
-		
-		SetConfigReq_Params setConfReq;
-		SetConfigReply_Params setConfReply;
-
-		GetComplConfigReq_Params getComplConfReq;
-		GetComplConfigReq_Params getComplConfReply;
-
-		FeedData_Params feedDataParams;
-		Generic_Params genericParams;
-		
-	} msgParams;
-};
-
-/******************************************************************************
-*	Feed protocol header
-******************************************************************************/
-/*! @brief Convert a 4 byte character string to an unsigned int. */
-#define STR_TO_UINT(str) ((str[0] << 24) | (str[1] << 16) | (str[2] << 8) | (str[3]))
-
-/*! @brief Pixel format descriptor for 8 bit bayer pattern. */
-#define V4L2_PIX_FMT_SBGGR8 STR_TO_UINT("BA81")
-/*! @brief Pixel format descriptor for 8 bit greyscale images. */
-#define V4L2_PIX_FMT_GREY   STR_TO_UINT("GREY")
-
-/*! @brief The header for the image data in the feed protocol. */
-struct FeedHdr
-{
-	/*! @brief Sequence number to detect communication problems. */
-	uint32 seqNr;
-	/*! @brief Number of milliseconds since start up of the target. */
-	uint32 timeStamp;
-
-	/*! @brief Width of the image following this header. */
-	uint32 imgWidth;
-	/*! @brief Height of the image following this header. */
-	uint32 imgHeight;
-	/*! @brief 4-character human readable code to identify how the pixels
-	  are stored (equivalen to V4L2 pixel format descriptor). */
-	uint32 pixFmt;
-};
-
-/******************************************************************************
-*	Message packet
-******************************************************************************/
-/*! @brief The message type used in this protocol with maximum size*/
-struct CommMsg
-{
-	/*! @brief Message header. */
-	struct MsgHdr hdr;
-	/*! @brief Message body. */
-	uint8 body[MAX_MSG_BODY_LENGTH];
-};
-
-/******************************************************************************
-*
-*	Register file
-*
-******************************************************************************/
-
-/*! @brief Represents one configuration parameter as an ID-value pair. */
-struct CBP_PARAM
-{
-	uint32 id;
-	uint32 val;
-};
-
-/******************************************************************************
-*
-*	Data container
-*
-******************************************************************************/
-
-
-/*! @brief The different states of a pending request. */
-enum EnRequestState
-{
-    REQ_STATE_IDLE,
-    REQ_STATE_ACK_PENDING,
-    REQ_STATE_NACK_PENDING
-};
-
-/*! @brief Contains all communication-relevant variables. */
-struct COMM
-{
-	/*! @brief Socket for incoming UDP command packets */
-	int cmdSock;						
-	/*! @brief Socket for outgoing TCP data packets */
-	int feedSock;						
-	/*! @brief Socket for outgoing TCP feed after connection to host */
-	int connFeedSock;	
-	/*! @brief Socket for command traffic after connection to host. */
-	int connCmdSock;
-
-	/*! @brief Buffer for incoming command packets. */
-	struct CommMsg cmdMsg;
-	/*! @brief The state of the last command request. */
-	enum EnRequestState enReqState;
-
-	/*! @brief Temporary buffer containing the initialized message 
-	  header of the feed protocol.*/
-	struct FeedHdr feedHdr;
-
-	/*! @brief Pointer to the register file of the main program. */
-	struct CBP_PARAM *pRegFile;
-	/*! @brief Number of entries (registers) in the register file. */
-	uint32 nRegs;
-};
-
-
-/******************************************************************************
-*
-*	function prototypes
-*
-******************************************************************************/
-
-/*! @brief Build the maximum of two numbers. */
-#define MAX(a, b) (a >= b ? a : b)
-
-/*********************************************************************//*!
- * @brief Set a register in the configuration register file and invoke 
- * all actions that need to be done after a write to that specific
- * register.
- * This function is implemented within the main program but accessed by
- * the communication part.
- * 
- * @param pHsm Pointer to the state machine.
- * @param pReg Pointer to the register id/value pair.
- *//*********************************************************************/
-OSC_ERR SetConfigRegister(void *pMainState, struct CBP_PARAM *pReg);
-
-/*********************************************************************//*!
- * @brief Accepts incoming connection on the feed and command socket.
- *
- * Sockets that are already connected are ignored.
- *
- * @param pComm Pointer to the communication status structure.
- * @param timeout_ms Timeout of this function in milliseconds
- * @return SUCCESS, -ETIMEOUT, -EDEVICE
- *//*********************************************************************/
-OSC_ERR Comm_AcceptConnections(struct COMM *pComm, int timeout_ms);
-
-/*********************************************************************//*!
- * @brief Send a new image over the feed.
- *
- * Attempts to send a new image over the feed. Fills out the message header.
- * The feed header containing the format and size information of the image has
- * to be supplied and filled out by the caller. If the feed socket is not
- * connected, a call to this function returns with -ETRY_AGAIN;
- *
- * @param pComm Pointer to the communication status structure.
- * @param pImg Pointer to the image to be sent.
- * @param imgSize Total length of the image data.
- * @param pFeedHdr Pointer to a filled out feed header for the image data.
- * @return SUCCESS or an appropriate error code.
- *//*********************************************************************/
-OSC_ERR Comm_SendImage(struct COMM *pComm, const void* pImg, uint32 imgSize, const struct FeedHdr *pFeedHdr);
-
-/*********************************************************************//*!
- * @brief Check for new commands from the host and handle them.
- *
- * Commands only reading out the register file can be handled locally.
- * Commands that need to invoke the state machine do this with the function
- * SetConfigRegister.
- * @see SetConfigRegister
- *
- * @param pComm Pointer to the communication status structure.
- * @param pHsm Pointer to state machine
- * @param Timeout of this function in milliseconds
- * @return SUCCESS or an appropriate error code.
- *//*********************************************************************/
-OSC_ERR Comm_HandleCommands(struct COMM *pComm, void *pHsm, uint32 timeout_ms);
-
-/*********************************************************************//*!
- * @brief Logs the contents of a message to the console.
- *
- * @param pMsg Pointer to the message to be printed.
- *//*********************************************************************/
-void Comm_PrintMsg(const struct CommMsg *pMsg);
-
-/*********************************************************************//*!
- * @brief Initialize the command and feed sockets to be ready to accept
- *        connections.
- *
- * @see Comm_DeInit
- * 
- * @param pComm Pointer to the communication status structure.
- * @return SUCCESS or a suitable error code.
- *//*********************************************************************/
-OSC_ERR Comm_Init(struct COMM *pComm);
-
-/*********************************************************************//*!
- * @brief Deinitialize the command and feed sockets.
- * @param pComm Pointer to the communication status structure.
- *//*********************************************************************/
-void Comm_DeInit(struct COMM *pComm);
-
-#endif	/* COMMUNICATION_H */
-
-
+/*	Target side application for the Rich Viewer.
+	Copyright (C) 2008 Supercomputing Systems AG
+	
+	This library is free software; you can redistribute it and/or modify it
+	under the terms of the GNU Lesser General Public License as published by
+	the Free Software Foundation; either version 2.1 of the License, or (at
+	your option) any later version.
+	
+	This library is distributed in the hope that it will be useful, but
+	WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser
+	General Public License for more details.
+	
+	You should have received a copy of the GNU Lesser General Public License
+	along with this library; if not, write to the Free Software Foundation,
+	Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+/*! @file communication.h
+ * @brief Header file for the TCP/UDP communication.
+ */
+ 
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/select.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <errno.h>
+#include <string.h>
+#include <time.h>
+#include <sys/time.h>
+#include <unistd.h>
+#include <assert.h>
+
+#include "inc/oscar.h"
+#include "retention.h"
+#include "timing.h"
+
+#ifndef COMMUNICATION_H
+#define COMMUNICATION_H
+
+/******************************************************************************
+*
+*	Host - Target protocol definitions
+*
+******************************************************************************/
+/*! @brief Version of the Common base protocol.*/
+#define CBP_VERSION 2008121600
+/*! @brief Version of the Feed protocol. */
+#define FEED_VERSION 2008121600
+
+/*! @brief TCP port to exchange commands with the host. */
+#define TCP_CMD_PORT    49100
+/*! @brief TCP image feed port number */
+#define TCP_FEED_PORT   49099
+
+
+/*! @brief socket error value */
+#define SOCK_ERROR 		-1
+/*! @brief Maximum message size (bytes) */
+#define MAX_MSG_BODY_LENGTH	64*1024
+/*! @brief Maximum number of feed messages waiting to be sent. */
+#define FEED_QUEUE_LEN		8
+/*! @brief Maximum number of command clients connected at the same
+  time. */
+#define COMM_MAX_CMD_CONNS	8
+
+/*! @brief Smallest send buffer the feed socket is tuned to (bytes). */
+#define FEED_SNDBUF_MIN		(8*1024)
+/*! @brief Largest send buffer the feed socket is tuned to (bytes). */
+#define FEED_SNDBUF_MAX		(1024*1024)
+
+/*! @brief Smallest piece of a feed message sent under the rate cap
+  (bytes); also the smallest burst size. */
+#define FEED_CAP_CHUNK		(4*1024)
+/*! @brief Burst size of the feed rate cap by default (bytes). */
+#define FEED_CAP_DEFAULT_BURST	(64*1024)
+
+/*! @brief Number of batches of small feed messages; one is filled while
+  the other one is sent. */
+#define FEED_BATCHES		2
+/*! @brief Largest size of a batch of small feed messages (bytes). */
+#define FEED_BATCH_MAX_BYTES	(64*1024)
+/*! @brief Feed messages up to this fraction of the batch size are
+  batched. */
+#define FEED_BATCH_SMALL_DIV	4
+/*! @brief Longest time a feed message waits in a batch by default
+  (us). */
+#define FEED_BATCH_DEFAULT_US	5000
+/*! @brief Index of the batch of a queued feed message meaning "not a
+  batch". */
+#define FEED_NO_BATCH		0xffffffff
+/*! @brief Time a new feed connection waits for MSG_CMD_RESUME_FEED
+  before the live feed starts, if retention is enabled (ms). */
+#define FEED_RESUME_WAIT_MS	500
+
+/******************************************************************************
+*	Message header
+******************************************************************************/
+
+/************ Message types **************/
+/*! @brief Command to get version information. */
+#define MSG_CMD_GET_VER			1
+/*! @brief Command to set config registers. */
+#define MSG_CMD_SET_CONFIG		10
+/*! @brief Command to read out the complete config register file. */
+#define MSG_CMD_GET_COMPL_CONFIG	20
+/*! @brief Command to replay the retained feed messages the host missed
+  before the live feed resumes. To be sent right after the feed has been
+  reconnected: the live feed of a new connection is held for
+  FEED_RESUME_WAIT_MS, so the replayed and the live messages arrive in
+  order and only once. Fails if retention is disabled or the live feed
+  has already started. */
+#define MSG_CMD_RESUME_FEED		21
+/*! @brief Command to get a single frame, see SnapshotReq_Params. The body
+  of the reply contains a feed header and the image and may exceed
+  MAX_MSG_BODY_LENGTH. No further commands of the client are served
+  before the reply has been sent. */
+#define MSG_CMD_SNAPSHOT		22
+/*! @brief Command to subscribe to (or unsubscribe from) the register
+  changes, see SubscribeRegsReq_Params. While subscribed, the changes are
+  pushed over the feed (MSG_FEED_REGS). */
+#define MSG_CMD_SUBSCRIBE_REGS		23
+/*! @brief Command to dump the event trace (see trace.h). The body of
+  the reply are the records (struct TraceRec), oldest first; see
+  TraceDumpReply_Params. */
+#define MSG_CMD_TRACE_DUMP		24
+/*! @brief Message contains feed data. */
+#define MSG_FEED_DATA                   30
+/*! @brief Message contains the statistics record of a frame instead of
+  the image data. */
+#define MSG_FEED_STATS                  31
+/*! @brief Message contains regions of interest of the image instead of
+  the whole image: A table of contents (see roi.h) followed by the pixels
+  of the regions. The feed header describes the whole image. */
+#define MSG_FEED_ROIS                   32
+/*! @brief Message contains the registers changed since the last such
+  message: An array of struct CBP_PARAM (ID and new value). The feed
+  header is that of the frame captured last. The first message after
+  subscribing contains all registers. */
+#define MSG_FEED_REGS                   33
+
+/***** Status codes in struct MsgHdr *****/
+/*! @brief Status code for a request. */
+#define STATUS_REQUEST   	20
+/*! @brief Status code for a successful reply. */
+#define STATUS_REPLY_SUCC	21
+/*! @brief Status code for a failed reply. */
+#define STATUS_REPLY_FAIL	22
+/*! @brief Status code for a feed message. */
+#define STATUS_FEED	        30
+
+/***** Snapshot modes *****/
+/*! @brief Snapshot of the frame captured last, or of the next one if there
+  is none. */
+#define SNAPSHOT_LATEST		0
+/*! @brief Snapshot of the next frame captured. */
+#define SNAPSHOT_NEXT		1
+/*! @brief Largest down scaling factor of a snapshot. */
+#define SNAPSHOT_MAX_SCALE	16
+
+/*! @brief Dummy placeholder structure for message types without commands. */
+typedef struct _Generic_Params
+{
+	/*! @brief Message type specific parameter 0. */
+	uint32 param0;
+	/*! @brief Message type specific parameter 1. */
+	uint32 param1;
+	/*! @brief Message type specific parameter 2. */
+	uint32 param2;
+	/*! @brief Message type specific parameter 3. */
+	uint32 param3;
+} Generic_Params;
+
+/*! @brief MsgHdr parameters for the request message of the GetVersion 
+  command. */
+typedef Generic_Params GetVersionReq_Params;
+
+/*! @brief MsgHdr parameters for the reply message of the GetVersion 
+  command. */
+typedef struct _GetVersionReply_Params
+{
+	/*! @brief Version of the Common Base Protocol. */
+	uint32 CBPVersion;
+	/*! @brief Version of the Feed Protocol. */
+	uint32 FeedProtVersion;
+	/*! @brief Target software version (Version of this program. */
+	uint32 TargetSWVersion;
+	/*! @brief unused */
+	uint32 unused3;
+} GetVersionReply_Params;
+
+/*! @brief MsgHdr parameters for the request message of the SetConfig
+  command. */
+typedef Generic_Params SetConfigReq_Params;
+/*! @brief MsgHdr parameters for the reply message of the SetConfig 
+  command. */
+typedef Generic_Params SetConfigReply_Params;
+
+/*! @brief MsgHdr parameters for the request message of the GetCompleteConfig
+  command. */
+typedef  Generic_Params GetComplConfigReq_Params;
+/*! @brief MsgHdr parameters for the reply message of the GetCompleteConfig
+  command. */
+typedef  Generic_Params GetcomplConfigReply_Params;
+
+/*! @brief MsgHdr parameters for the request message of the ResumeFeed
+  command. */
+typedef struct _ResumeFeedReq_Params
+{
+	/*! @brief Sequence number of the last frame the host received. */
+	uint32 lastSeqNr;
+	/*! @brief unused */
+	uint32 unused1;
+	/*! @brief unused */
+	uint32 unused2;
+	/*! @brief unused */
+	uint32 unused3;
+} ResumeFeedReq_Params;
+
+/*! @brief MsgHdr parameters for the reply message of the ResumeFeed
+  command. */
+typedef struct _ResumeFeedReply_Params
+{
+	/*! @brief Sequence number of the first frame replayed. Frames
+	  between lastSeqNr and this one are lost. */
+	uint32 firstSeqNr;
+	/*! @brief Number of messages replayed (not counting those retained
+	  during the replay). */
+	uint32 nMsgs;
+	/*! @brief unused */
+	uint32 unused2;
+	/*! @brief unused */
+	uint32 unused3;
+} ResumeFeedReply_Params;
+
+/*! @brief MsgHdr parameters for the request message of the Snapshot
+  command. */
+typedef struct _SnapshotReq_Params
+{
+	/*! @brief Frame to be taken (SNAPSHOT_*). In idle mode, the next
+	  frame is captured on demand. */
+	uint32 mode;
+	/*! @brief Upper left corner of the region (x << 16 | y). */
+	uint32 pos;
+	/*! @brief Size of the region (width << 16 | height), 0 for the
+	  whole frame. The region is clipped to the frame. */
+	uint32 size;
+	/*! @brief Down scaling factor of the region (power of two up to
+	  SNAPSHOT_MAX_SCALE, 0 for 1). A bayer frame scaled down becomes a
+	  greyscale image. */
+	uint32 scale;
+} SnapshotReq_Params;
+
+/*! @brief MsgHdr parameters for the reply message of the Snapshot
+  command. */
+typedef struct _SnapshotReply_Params
+{
+	/*! @brief Upper left corner of the region taken (x << 16 | y). */
+	uint32 pos;
+	/*! @brief Size of the region taken (width << 16 | height). */
+	uint32 size;
+	/*! @brief Down scaling factor applied. */
+	uint32 scale;
+	/*! @brief unused */
+	uint32 unused3;
+} SnapshotReply_Params;
+
+/*! @brief MsgHdr parameters for the request message of the
+  SubscribeRegs command. */
+typedef struct _SubscribeRegsReq_Params
+{
+	/*! @brief 1 to subscribe, 0 to unsubscribe. The subscription holds
+	  until unsubscribed, also while the feed is not connected. */
+	uint32 enable;
+	/*! @brief unused */
+	uint32 unused1;
+	/*! @brief unused */
+	uint32 unused2;
+	/*! @brief unused */
+	uint32 unused3;
+} SubscribeRegsReq_Params;
+
+/*! @brief MsgHdr parameters for the reply message of the TraceDump
+  command. */
+typedef struct _TraceDumpReply_Params
+{
+	/*! @brief Number of records in the body. */
+	uint32 nRecs;
+	/*! @brief Number of records written since the start (wraps around);
+	  the records before the ones in the body have been overwritten. */
+	uint32 nTotal;
+	/*! @brief Cycles per millisecond, to convert the cycle counts. */
+	uint32 cycPerMs;
+	/*! @brief unused */
+	uint32 unused3;
+} TraceDumpReply_Params;
+
+/*! @brief MsgHdr parameters for the feed protocol message. */
+typedef struct _FeedData_Params
+{
+	/*! @brief Rendition of the frame the message contains (0 is the
+	  full resolution image). */
+	uint32 rendition;
+	/*! @brief Number of frames not sent before this one because the
+	  scene did not change. */
+	uint32 suppressed;
+	/*! @brief Quality of service mode the frame was sent in (see
+	  qos.h), 0 if the mode is not controlled. */
+	uint32 qosMode;
+	/*! @brief unused */
+	uint32 unused3;
+} FeedData_Params;
+
+/*! @brief The header shared by all messages (commands and feed data). */
+struct MsgHdr
+{
+	/*! @brief Length of the body following this header in bytes. */
+	uint32 bodyLength;
+	/*! @brief Message type identifier. */
+	uint32 msgType;
+	/*! @brief This field may be used to identify messages e.g. for a
+	  sequence number. */
+	uint32 ident;
+	/*! @brief Identifies whether the message is a request, reply, etc. */
+	uint32 status;
+
+	/*! @brief 4 additional values that depend on the message type. */
+	union _msgParams
+	{
+		GetVersionReq_Params getVerReq;
+		GetVersionReply_Params getVerReply;
+		
+		SetConfigReq_Params setConfReq;
+		SetConfigReply_Params setConfReply;
+
+		GetComplConfigReq_Params getComplConfReq;
+		GetComplConfigReq_Params getComplConfReply;
+
+		ResumeFeedReq_Params resumeFeedReq;
+		ResumeFeedReply_Params resumeFeedReply;
+
+		SnapshotReq_Params snapshotReq;
+		SnapshotReply_Params snapshotReply;
+
+		SubscribeRegsReq_Params subscribeRegsReq;
+
+		TraceDumpReply_Params traceDumpReply;
+
+		FeedData_Params feedDataParams;
+		Generic_Params genericParams;
+		
+	} msgParams;
+};
+
+/******************************************************************************
+*	Feed protocol header
+******************************************************************************/
+/*! @brief Convert a 4 byte character string to an unsigned int. */
+#define STR_TO_UINT(str) ((str[0] << 24) | (str[1] << 16) | (str[2] << 8) | (str[3]))
+
+/*! @brief Pixel format descriptor for 8 bit bayer pattern. */
+#define V4L2_PIX_FMT_SBGGR8 STR_TO_UINT("BA81")
+/*! @brief Pixel format descriptor for 8 bit greyscale images. */
+#define V4L2_PIX_FMT_GREY   STR_TO_UINT("GREY")
+/*! @brief Pixel format descriptor for 24 bit RGB images. */
+#define V4L2_PIX_FMT_RGB24  STR_TO_UINT("RGB3")
+
+/*! @brief The header for the image data in the feed protocol. */
+struct FeedHdr
+{
+	/*! @brief Sequence number to detect communication problems. */
+	uint32 seqNr;
+	/*! @brief Number of milliseconds since start up of the target. */
+	uint32 timeStamp;
+
+	/*! @brief Width of the image following this header. */
+	uint32 imgWidth;
+	/*! @brief Height of the image following this header. */
+	uint32 imgHeight;
+	/*! @brief 4-character human readable code to identify how the pixels
+	  are stored (equivalen to V4L2 pixel format descriptor). */
+	uint32 pixFmt;
+};
+
+/******************************************************************************
+*	Message packet
+******************************************************************************/
+/*! @brief The message type used in this protocol with maximum size*/
+struct CommMsg
+{
+	/*! @brief Message header. */
+	struct MsgHdr hdr;
+	/*! @brief Message body. */
+	uint8 body[MAX_MSG_BODY_LENGTH];
+};
+
+/******************************************************************************
+*
+*	Register file
+*
+******************************************************************************/
+
+/*! @brief Represents one configuration parameter as an ID-value pair. */
+struct CBP_PARAM
+{
+	uint32 id;
+	uint32 val;
+};
+
+/******************************************************************************
+*
+*	Data container
+*
+******************************************************************************/
+
+
+/*! @brief Transport profiles of the feed socket. */
+enum EnFeedProfile
+{
+	/*! @brief Socket options as set by the operating system; the
+	  options changed by another profile are restored. */
+	FEED_PROFILE_DEFAULT,
+	/*! @brief Small send buffer and no Nagle delay, so a frame is on the
+	  wire as soon as possible and no frames queue up in the kernel. */
+	FEED_PROFILE_LOW_LATENCY,
+	/*! @brief Large send buffer and full segments (corked until the end
+	  of the queued messages). */
+	FEED_PROFILE_THROUGHPUT,
+	/*! @brief Send buffer of the size of the bandwidth-delay product and
+	  a fast keepalive, for slow and lossy links. */
+	FEED_PROFILE_CONSTRAINED,
+	/*! @brief Number of profiles. */
+	FEED_PROFILE_COUNT
+};
+
+/*! @brief Number of socket options the feed profiles change. */
+#define FEED_SOCK_OPTS 7
+
+/*! @brief Transport statistics of the feed socket. */
+struct FeedLinkStats
+{
+	/*! @brief Throughput since the last call of Comm_TuneFeed (kB/s). */
+	uint32 kBps;
+	/*! @brief Smoothed round trip time measured by TCP (us). */
+	uint32 rttUs;
+	/*! @brief Size of the send buffer (bytes, as reported by the
+	  kernel). */
+	uint32 sndBuf;
+	/*! @brief Total number of retransmitted segments. */
+	uint32 retrans;
+};
+
+/*! @brief A feed message waiting to be sent. */
+struct FeedQueueEntry
+{
+	/*! @brief Message header and feed header, as sent. */
+	uint8 hdrs[sizeof(struct MsgHdr) + sizeof(struct FeedHdr)];
+	/*! @brief Length of the headers, 0 for a batch. */
+	uint32 hdrLen;
+	/*! @brief The data following the headers (not copied). */
+	const uint8 *pData;
+	/*! @brief Length of the data. */
+	uint32 len;
+	/*! @brief Number of bytes of headers and data already sent. */
+	uint32 sent;
+	/*! @brief TRUE if the data is a replayed message of the retention
+	  window instead of data passed to Comm_SendFeedMsg. */
+	bool bRetained;
+	/*! @brief Index of the batch the data is, or FEED_NO_BATCH. */
+	uint32 batch;
+};
+
+/*! @brief Small feed messages collected to be sent in one write. */
+struct FeedBatch
+{
+	/*! @brief The messages (headers and data), back to back. */
+	uint8 *pBuf;
+	/*! @brief Length of the messages. */
+	uint32 len;
+	/*! @brief Number of messages. */
+	uint32 nMsgs;
+	/*! @brief Cycle count at which the first message was added. */
+	uint64 startCyc;
+	/*! @brief TRUE from the time the batch is queued until it has been
+	  sent. */
+	bool bQueued;
+};
+
+/*! @brief A snapshot request and its reply. */
+struct Snapshot
+{
+	/*! @brief Socket of the client requesting the snapshot, 0 if there is
+	  no request. */
+	int sock;
+	/*! @brief Header of the request. */
+	struct MsgHdr req;
+	/*! @brief The reply (message header, feed header and image) or NULL
+	  while the request waits for a frame. Trace dumps are sent as
+	  replies of this slot as well. */
+	uint8 *pReply;
+	/*! @brief Length of the reply. */
+	uint32 len;
+	/*! @brief Number of bytes of the reply already sent. */
+	uint32 sent;
+};
+
+/*! @brief The different states of a pending request. */
+enum EnRequestState
+{
+    REQ_STATE_IDLE,
+    REQ_STATE_ACK_PENDING,
+    REQ_STATE_NACK_PENDING
+};
+
+/*! @brief A command being received from a command client. */
+struct CmdRecv
+{
+	/*! @brief The command received so far, with room for a body of
+	  cmdBodySize bytes only. */
+	struct CommMsg *pMsg;
+	/*! @brief Number of bytes of the command received. */
+	uint32 len;
+};
+
+/*! @brief Contains all communication-relevant variables. */
+struct COMM
+{
+	/*! @brief Socket for incoming UDP command packets */
+	int cmdSock;						
+	/*! @brief Socket for outgoing TCP data packets */
+	int feedSock;						
+	/*! @brief Socket for outgoing TCP feed after connection to host */
+	int connFeedSock;	
+	/*! @brief Sockets for command traffic after connection to the
+	  command clients. */
+	int cmdConns[COMM_MAX_CMD_CONNS];
+	/*! @brief The commands being received from the command clients,
+	  in the order of cmdConns. */
+	struct CmdRecv cmdRecv[COMM_MAX_CMD_CONNS];
+	/*! @brief Number of connected command clients. */
+	uint32 nCmdConns;
+	/*! @brief Index in cmdConns of the client served last. */
+	uint32 lastCmdConn;
+	/*! @brief Socket of the client the command in pCmdMsg came from. */
+	int connCmdSock;
+
+	/*! @brief The command being handled, with room for a body of
+	  cmdBodySize bytes only. It is swapped with the buffer of the
+	  client when a command is complete. */
+	struct CommMsg *pCmdMsg;
+	/*! @brief Longest body of a command (bytes): A value for every
+	  register of the register file. */
+	uint32 cmdBodySize;
+	/*! @brief The state of the last command request. */
+	enum EnRequestState enReqState;
+
+	/*! @brief Temporary buffer containing the initialized message 
+	  header of the feed protocol.*/
+	struct FeedHdr feedHdr;
+
+	/*! @brief Feed messages waiting to be sent (ring buffer). */
+	struct FeedQueueEntry feedQueue[FEED_QUEUE_LEN];
+	/*! @brief Index of the oldest message in feedQueue. */
+	uint32 feedQueueHead;
+	/*! @brief Number of messages in feedQueue. */
+	uint32 nFeedQueued;
+
+	/*! @brief Transport profile of the feed socket (EnFeedProfile). */
+	uint32 feedProfile;
+	/*! @brief Values of the socket options changed by the profiles when
+	  the feed was connected, -1 if unknown. */
+	int feedSockDefaults[FEED_SOCK_OPTS];
+	/*! @brief TRUE if a profile other than the default has changed the
+	  socket options. */
+	bool bFeedSockTuned;
+	/*! @brief Bytes sent over the feed since the last call of
+	  Comm_TuneFeed. */
+	uint32 feedBytesSent;
+	/*! @brief Time of the last call of Comm_TuneFeed. */
+	struct timeval feedTuneTime;
+	/*! @brief Rate cap of the feed (bytes per second). */
+	struct TokenBucket feedCap;
+	/*! @brief Number of feed messages dropped because of the rate
+	  cap. */
+	uint32 nCapDropped;
+
+	/*! @brief The batches of small feed messages. */
+	struct FeedBatch batches[FEED_BATCHES];
+	/*! @brief Index of the batch being filled. */
+	uint32 curBatch;
+	/*! @brief Size of the batches (bytes), 0 if small messages are not
+	  batched. */
+	uint32 batchSize;
+	/*! @brief Longest time a message waits in a batch (us). */
+	uint32 batchMaxUs;
+	/*! @brief Number of batches sent. */
+	uint32 nBatches;
+	/*! @brief Number of messages sent in batches. */
+	uint32 nBatchedMsgs;
+
+	/*! @brief Copies of the recent feed messages, replayed to the host
+	  after a reconnect. */
+	struct Retention retain;
+	/*! @brief Cycle count until which the live feed of a new
+	  connection is held for MSG_CMD_RESUME_FEED or 0. */
+	uint64 feedHoldCyc;
+
+	/*! @brief The snapshot requested. */
+	struct Snapshot snap;
+
+	/*! @brief Pointer to the register file of the main program. */
+	struct CBP_PARAM *pRegFile;
+	/*! @brief Number of entries (registers) in the register file. */
+	uint32 nRegs;
+
+	/*! @brief TRUE if the host has subscribed to the register
+	  changes. */
+	bool bRegNotify;
+	/*! @brief Bit i is set if entry i of the register file has changed
+	  since the last notification. */
+	uint32 *pRegDirty;
+	/*! @brief Body of the last register change notification. */
+	struct CBP_PARAM *pRegChanges;
+};
+
+
+/******************************************************************************
+*
+*	function prototypes
+*
+******************************************************************************/
+
+/*! @brief Build the maximum of two numbers. */
+#define MAX(a, b) (a >= b ? a : b)
+/*! @brief Build the minimum of two numbers. */
+#define MIN(a, b) ((a) <= (b) ? (a) : (b))
+
+/*********************************************************************//*!
+ * @brief Set a register in the configuration register file and invoke 
+ * all actions that need to be done after a write to that specific
+ * register.
+ * This function is implemented within the main program but accessed by
+ * the communication part.
+ * 
+ * @param pHsm Pointer to the state machine.
+ * @param pReg Pointer to the register id/value pair.
+ *//*********************************************************************/
+OSC_ERR SetConfigRegister(void *pMainState, struct CBP_PARAM *pReg);
+
+/*********************************************************************//*!
+ * @brief Accepts incoming connection on the feed and command socket.
+ *
+ * Sockets that are already connected are ignored. Up to
+ * COMM_MAX_CMD_CONNS command clients may be connected; once the feed and
+ * at least one command client are connected, further command clients are
+ * accepted without waiting. Returns early if a command is waiting.
+ *
+ * @param pComm Pointer to the communication status structure.
+ * @param timeout_ms Timeout of this function in milliseconds
+ * @return SUCCESS, -ETIMEOUT, -EDEVICE
+ *//*********************************************************************/
+OSC_ERR Comm_AcceptConnections(struct COMM *pComm, int timeout_ms);
+
+/*********************************************************************//*!
+ * @brief Send a new image over the feed.
+ *
+ * Attempts to send a new image over the feed. Fills out the message header.
+ * The feed header containing the format and size information of the image has
+ * to be supplied and filled out by the caller. If the feed socket is not
+ * connected, a call to this function returns with -ETRY_AGAIN;
+ *
+ * The message is only queued; it is sent by Comm_PumpFeed. The image
+ * is not copied and must not be modified before Comm_FeedUsesData returns
+ * FALSE.
+ *
+ * If the retention window is enabled, a copy of the message is retained,
+ * also while the feed is not connected. While the retained messages are
+ * replayed, the message is not queued but replayed after them.
+ *
+ * If batching is enabled, a small message is copied into a batch instead
+ * of being queued. The batch is queued as one message when it is full,
+ * when its first message has waited long enough or before a message that
+ * is not batched.
+ *
+ * @param pComm Pointer to the communication status structure.
+ * @param pImg Pointer to the image to be sent.
+ * @param imgSize Total length of the image data.
+ * @param pFeedHdr Pointer to a filled out feed header for the image data.
+ * @return SUCCESS or an appropriate error code.
+ *//*********************************************************************/
+OSC_ERR Comm_SendImage(struct COMM *pComm, const void* pImg, uint32 imgSize, const struct FeedHdr *pFeedHdr);
+
+/*********************************************************************//*!
+ * @brief Send a message of arbitrary feed type over the feed.
+ *
+ * Same as Comm_SendImage, but the message type can be chosen and the data
+ * following the feed header need not be an image.
+ * @see Comm_SendImage
+ *
+ * @param pComm Pointer to the communication status structure.
+ * @param msgType Message type (MSG_FEED_*).
+ * @param pParams Message header parameters or NULL if all are 0.
+ * @param pFeedHdr Pointer to a filled out feed header.
+ * @param pData Pointer to the data following the feed header.
+ * @param len Length of the data.
+ * @return SUCCESS or an appropriate error code.
+ *//*********************************************************************/
+OSC_ERR Comm_SendFeedMsg(struct COMM *pComm,
+			 uint32 msgType,
+			 const FeedData_Params *pParams,
+			 const struct FeedHdr *pFeedHdr,
+			 const void *pData,
+			 uint32 len);
+
+/*********************************************************************//*!
+ * @brief Send queued feed messages without blocking for long.
+ *
+ * Waits at most timeout_ms for the feed socket to accept data, then sends
+ * as much as it accepts without blocking. Returns early if a command is
+ * waiting, so commands are never delayed by the feed. A snapshot reply is
+ * sent the same way over the command socket. A batch of small messages is
+ * queued once it is due, which is waited for the same way.
+ *
+ * @param pComm Pointer to the communication status structure.
+ * @param timeout_ms Longest time to wait for the feed socket (ms).
+ * @return SUCCESS or an appropriate error code.
+ *//*********************************************************************/
+OSC_ERR Comm_PumpFeed(struct COMM *pComm, int timeout_ms);
+
+/*********************************************************************//*!
+ * @brief Select the transport profile of the feed socket.
+ *
+ * The profile is applied to the connected feed socket immediately and to
+ * every feed socket accepted later.
+ *
+ * @param pComm Pointer to the communication status structure.
+ * @param profile The profile (EnFeedProfile).
+ * @return SUCCESS or -EINVALID_PARAMETER.
+ *//*********************************************************************/
+OSC_ERR Comm_SetFeedProfile(struct COMM *pComm, uint32 profile);
+
+/*********************************************************************//*!
+ * @brief Cap the bandwidth of the feed.
+ *
+ * The messages are paced to the rate, with bursts of up to the burst
+ * size. A message is dropped if the messages queued before it exceed the
+ * burst size.
+ *
+ * @param pComm Pointer to the communication status structure.
+ * @param rate The rate (bytes per second), 0 for no cap.
+ * @param burst The burst size (bytes, at least FEED_CAP_CHUNK).
+ * @return SUCCESS or -EINVALID_PARAMETER.
+ *//*********************************************************************/
+OSC_ERR Comm_SetFeedCap(struct COMM *pComm, uint32 rate, uint32 burst);
+
+/*********************************************************************//*!
+ * @brief Set up the batching of small feed messages.
+ *
+ * Many small messages, e.g. of statistics only or of small renditions,
+ * are sent in one write instead of one or more writes each, at the cost
+ * of some latency. Messages up to 1/FEED_BATCH_SMALL_DIV of the batch size
+ * are batched.
+ *
+ * @param pComm Pointer to the communication status structure.
+ * @param size The batch size (bytes, up to FEED_BATCH_MAX_BYTES), 0 to
+ *             disable batching.
+ * @param maxUs Longest time a message waits in a batch (us).
+ * @return SUCCESS, -EINVALID_PARAMETER, -EOUT_OF_MEMORY or -ETRY_AGAIN
+ *         while a batch is being sent.
+ *//*********************************************************************/
+OSC_ERR Comm_SetFeedBatch(struct COMM *pComm, uint32 size, uint32 maxUs);
+
+/*********************************************************************//*!
+ * @brief Adapt the feed socket to the link and report its statistics.
+ *
+ * The send buffer is sized from the bandwidth-delay product, which is
+ * estimated from the congestion window and the round trip time reported
+ * by the kernel as well as the throughput measured since the last call.
+ * Has to be called periodically, e.g. every few seconds.
+ *
+ * @param pComm Pointer to the communication status structure.
+ * @param pStats The statistics to be filled out.
+ * @return SUCCESS, or -ETRY_AGAIN if the feed is not connected.
+ *//*********************************************************************/
+OSC_ERR Comm_TuneFeed(struct COMM *pComm, struct FeedLinkStats *pStats);
+
+/*********************************************************************//*!
+ * @brief Set the byte budget of the feed retention window.
+ *
+ * The retained messages are discarded.
+ *
+ * @param pComm Pointer to the communication status structure.
+ * @param budget Byte budget (0 .. RET_MAX_BYTES), 0 disables retention.
+ * @return SUCCESS, -EINVALID_PARAMETER, -EOUT_OF_MEMORY, or -ETRY_AGAIN
+ *         while a retained message is being sent.
+ *//*********************************************************************/
+OSC_ERR Comm_SetRetention(struct COMM *pComm, uint32 budget);
+
+/*********************************************************************//*!
+ * @brief Check whether feed messages or a snapshot are waiting to be sent.
+ *
+ * @param pComm Pointer to the communication status structure.
+ * @return TRUE if messages are queued, batched or being replayed, or a
+ *         snapshot is being sent.
+ *//*********************************************************************/
+bool Comm_FeedBusy(const struct COMM *pComm);
+
+/*********************************************************************//*!
+ * @brief Check whether queued feed messages still reference data passed
+ * to Comm_SendFeedMsg.
+ *
+ * @param pComm Pointer to the communication status structure.
+ * @return TRUE if the data is still in use.
+ *//*********************************************************************/
+bool Comm_FeedUsesData(const struct COMM *pComm);
+
+/*********************************************************************//*!
+ * @brief Check whether the feed has delivered all messages, i.e. no
+ * message is queued or batched and the host has acknowledged all data
+ * sent.
+ *
+ * @param pComm Pointer to the communication status structure.
+ * @return TRUE if all messages have been delivered or the feed is not
+ *         connected.
+ *//*********************************************************************/
+bool Comm_FeedDrained(const struct COMM *pComm);
+
+/*********************************************************************//*!
+ * @brief Get the snapshot request waiting for a frame.
+ *
+ * @param pComm Pointer to the communication status structure.
+ * @return Header of the request or NULL if there is none.
+ *//*********************************************************************/
+const struct MsgHdr* Comm_SnapshotRequest(const struct COMM *pComm);
+
+/*********************************************************************//*!
+ * @brief Answer the snapshot request.
+ *
+ * Allocates the reply with the feed header and returns the buffer the
+ * image has to be written to. The reply is sent by Comm_PumpFeed without
+ * blocking. If no feed header is given or the reply cannot be allocated,
+ * the request fails.
+ *
+ * @param pComm Pointer to the communication status structure.
+ * @param pParams Parameters of the reply.
+ * @param pFeedHdr Feed header of the image or NULL to fail the request.
+ * @return Buffer for the image (imgWidth*imgHeight bytes) or NULL.
+ *//*********************************************************************/
+uint8* Comm_SnapshotReply(struct COMM *pComm,
+			  const SnapshotReply_Params *pParams,
+			  const struct FeedHdr *pFeedHdr);
+
+/*********************************************************************//*!
+ * @brief Look up a register in the register file.
+ *
+ * @param pComm Pointer to the communication status structure.
+ * @param id ID of the register.
+ * @return Pointer to the register or NULL if there is no such register.
+ *//*********************************************************************/
+struct CBP_PARAM* Comm_GetReg(struct COMM *pComm, uint32 id);
+
+/*********************************************************************//*!
+ * @brief Update the value of a register from the target side.
+ *
+ * Used for registers whose value is determined by the target, e.g.
+ * status registers. Unknown registers are ignored. A changed value is
+ * notified to the host if it has subscribed.
+ *
+ * @param pComm Pointer to the communication status structure.
+ * @param id ID of the register.
+ * @param val New value of the register.
+ *//*********************************************************************/
+void Comm_UpdateReg(struct COMM *pComm, uint32 id, uint32 val);
+
+/*********************************************************************//*!
+ * @brief Send the register changes to the host if it has subscribed.
+ *
+ * All registers changed since the last call go out in one message
+ * (MSG_FEED_REGS), so it is called e.g. once per main loop iteration.
+ * While the feed is not connected, the changes are kept.
+ *
+ * @param pComm Pointer to the communication status structure.
+ * @return SUCCESS or an appropriate error code.
+ *//*********************************************************************/
+OSC_ERR Comm_SendRegChanges(struct COMM *pComm);
+
+/*********************************************************************//*!
+ * @brief Check for new commands from the host and handle them.
+ *
+ * The command clients are served in turn, one command per call. Commands
+ * only reading out the register file or resuming the feed can be handled
+ * locally. Snapshot requests are answered by the main program.
+ * @see Comm_SnapshotRequest
+ * Commands that need to invoke the state machine do this with the function
+ * SetConfigRegister. The register file is updated with every value that
+ * SetConfigRegister accepted.
+ * @see SetConfigRegister
+ *
+ * @param pComm Pointer to the communication status structure.
+ * @param pHsm Pointer to state machine
+ * @param Timeout of this function in milliseconds
+ * @return SUCCESS or an appropriate error code.
+ *//*********************************************************************/
+OSC_ERR Comm_HandleCommands(struct COMM *pComm, void *pHsm, uint32 timeout_ms);
+
+/*********************************************************************//*!
+ * @brief Logs the contents of a message to the console.
+ *
+ * @param pMsg Pointer to the message to be printed.
+ *//*********************************************************************/
+void Comm_PrintMsg(const struct CommMsg *pMsg);
+
+/*********************************************************************//*!
+ * @brief Initialize the command and feed sockets to be ready to accept
+ *        connections.
+ *
+ * The command buffer is sized to the register file, which has to be set
+ * before.
+ * @see Comm_DeInit
+ * 
+ * @param pComm Pointer to the communication status structure.
+ * @return SUCCESS or a suitable error code.
+ *//*********************************************************************/
+OSC_ERR Comm_Init(struct COMM *pComm);
+
+/*********************************************************************//*!
+ * @brief Deinitialize the command and feed sockets.
+ * @param pComm Pointer to the communication status structure.
+ *//*********************************************************************/
+void Comm_DeInit(struct COMM *pComm);
+
+#endif	/* COMMUNICATION_H */
+
+
@@ -0,0 +1,101 @@
+/*	Target side application for the Rich Viewer.
+	Copyright (C) 2008 Supercomputing Systems AG
+
+	This library is free software; you can redistribute it and/or modify it
+	under the terms of the GNU Lesser General Public License as published by
+	the Free Software Foundation; either version 2.1 of the License, or (at
+	your option) any later version.
+
+	This library is distributed in the hope that it will be useful, but
+	WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser
+	General Public License for more details.
+
+	You should have received a copy of the GNU Lesser General Public License
+	along with this library; if not, write to the Free Software Foundation,
+	Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+/*! @file framering.c
+ * @brief Frame descriptor ring implementation.
+ */
+
+#include "framering.h"
+#include <string.h>
+
+#ifdef OSC_HOST
+/*! @brief Orders the memory accesses before and after it, also as seen by
+ * other cores. */
+#define RING_BARRIER() __sync_synchronize()
+#else
+/*! @brief The target has a single core, so it is sufficient to keep the
+ * compiler from moving memory accesses across the barrier. */
+#define RING_BARRIER() __asm__ __volatile__("" : : : "memory")
+#endif /* OSC_HOST */
+
+OSC_ERR FrameRing_Init(struct FrameRing *pRing, uint32 nConsumers)
+{
+	if(nConsumers == 0 || nConsumers > FRAME_RING_MAX_CONSUMERS)
+	{
+		return -EINVALID_PARAMETER;
+	}
+	memset(pRing, 0, sizeof(struct FrameRing));
+	pRing->nConsumers = nConsumers;
+	return SUCCESS;
+}
+
+uint32 FrameRing_InUse(const struct FrameRing *pRing)
+{
+	uint32 i, inUse, maxInUse = 0;
+	uint32 head = pRing->head.idx;
+
+	for(i = 0; i < pRing->nConsumers; i++)
+	{
+		inUse = head - pRing->tail[i].idx;
+		if(inUse > maxInUse)
+		{
+			maxInUse = inUse;
+		}
+	}
+	return maxInUse;
+}
+
+struct FrameDesc* FrameRing_Claim(struct FrameRing *pRing)
+{
+	if(FrameRing_InUse(pRing) >= FRAME_RING_SIZE)
+	{
+		return NULL;
+	}
+	/* The consumers are done with the slot; do not write to it before
+	 * their last reads. */
+	RING_BARRIER();
+	return &pRing->slots[pRing->head.idx % FRAME_RING_SIZE];
+}
+
+void FrameRing_Publish(struct FrameRing *pRing)
+{
+	/* The descriptor has to be complete before the consumers see it. */
+	RING_BARRIER();
+	pRing->head.idx++;
+}
+
+struct FrameDesc* FrameRing_Peek(struct FrameRing *pRing, uint32 consumer)
+{
+	uint32 tail = pRing->tail[consumer].idx;
+
+	if(tail == pRing->head.idx)
+	{
+		return NULL;
+	}
+	/* Do not read the descriptor before the head that published it. */
+	RING_BARRIER();
+	return &pRing->slots[tail % FRAME_RING_SIZE];
+}
+
+void FrameRing_Release(struct FrameRing *pRing, uint32 consumer)
+{
+	/* All reads of the frame have to be done before the producer may
+	 * reuse it. */
+	RING_BARRIER();
+	pRing->tail[consumer].idx++;
+}
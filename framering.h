@@ -0,0 +1,146 @@
+/*	Target side application for the Rich Viewer.
+	Copyright (C) 2008 Supercomputing Systems AG
+
+	This library is free software; you can redistribute it and/or modify it
+	under the terms of the GNU Lesser General Public License as published by
+	the Free Software Foundation; either version 2.1 of the License, or (at
+	your option) any later version.
+
+	This library is distributed in the hope that it will be useful, but
+	WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser
+	General Public License for more details.
+
+	You should have received a copy of the GNU Lesser General Public License
+	along with this library; if not, write to the Free Software Foundation,
+	Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+/*! @file framering.h
+ * @brief Lock-free ring of frame descriptors between the capture loop and
+ * the consumers of the frames.
+ *
+ * The capture loop is the only producer. Every consumer sees every frame
+ * and has its own tail index, which only it writes. A frame is released
+ * once the tails of all consumers have passed it; the number of tails
+ * that have not yet passed a frame is its reference count. As every index
+ * has exactly one writer, neither locks nor atomic read-modify-write
+ * operations are needed, only ordering barriers.
+ *
+ * The head and every tail are placed in cache lines of their own, so the
+ * producer and the consumers do not invalidate each others' lines.
+ */
+
+#ifndef FRAMERING_H
+#define FRAMERING_H
+
+#include "inc/oscar.h"
+#include "communication.h"
+
+/*! @brief Number of descriptors in the ring (power of two). */
+#define FRAME_RING_SIZE 4
+/*! @brief Maximum number of consumers of the ring. */
+#define FRAME_RING_MAX_CONSUMERS 4
+/*! @brief Size of a cache line (the target has 32 bytes, most hosts 64). */
+#define CACHE_LINE_SIZE 64
+
+#if (FRAME_RING_SIZE & (FRAME_RING_SIZE - 1)) != 0
+#error "FRAME_RING_SIZE has to be a power of two."
+#endif
+
+/*! @brief Descriptor of a captured frame. */
+struct FrameDesc
+{
+	/*! @brief The frame buffer holding the raw image. */
+	uint8 *pImg;
+	/*! @brief The feed header of the frame. */
+	struct FeedHdr feedHdr;
+	/*! @brief Cycle count at which the frame has been read. */
+	uint64 frameCyc;
+};
+
+/*! @brief An index of the ring alone in its cache line. */
+struct FrameRingIdx
+{
+	/*! @brief Free running index; the slot is idx % FRAME_RING_SIZE. */
+	volatile uint32 idx;
+	/*! @brief Fills up the cache line. */
+	uint8 pad[CACHE_LINE_SIZE - sizeof(uint32)];
+};
+
+/*! @brief The frame descriptor ring. */
+struct FrameRing
+{
+	/*! @brief Next descriptor to be published (written by the
+	  producer). */
+	struct FrameRingIdx head;
+	/*! @brief Next descriptor to be taken by each consumer (written by
+	  the respective consumer). */
+	struct FrameRingIdx tail[FRAME_RING_MAX_CONSUMERS];
+	/*! @brief Number of consumers. */
+	uint32 nConsumers;
+	/*! @brief The descriptors. */
+	struct FrameDesc slots[FRAME_RING_SIZE];
+};
+
+/*********************************************************************//*!
+ * @brief Initialize an empty ring.
+ *
+ * @param pRing Pointer to the ring.
+ * @param nConsumers Number of consumers (1 .. FRAME_RING_MAX_CONSUMERS).
+ * @return SUCCESS or -EINVALID_PARAMETER.
+ *//*********************************************************************/
+OSC_ERR FrameRing_Init(struct FrameRing *pRing, uint32 nConsumers);
+
+/*********************************************************************//*!
+ * @brief Get the descriptor to be filled out and published next.
+ *
+ * Producer only. Returns the same descriptor until it is published.
+ *
+ * @param pRing Pointer to the ring.
+ * @return The descriptor or NULL if the ring is full.
+ *//*********************************************************************/
+struct FrameDesc* FrameRing_Claim(struct FrameRing *pRing);
+
+/*********************************************************************//*!
+ * @brief Hand the claimed descriptor to the consumers.
+ *
+ * Producer only.
+ *
+ * @param pRing Pointer to the ring.
+ *//*********************************************************************/
+void FrameRing_Publish(struct FrameRing *pRing);
+
+/*********************************************************************//*!
+ * @brief Get the number of published frames not yet released by all
+ * consumers.
+ *
+ * Producer only. A frame buffer may be reused when the frame it holds
+ * has been released.
+ *
+ * @param pRing Pointer to the ring.
+ * @return Number of frames in use.
+ *//*********************************************************************/
+uint32 FrameRing_InUse(const struct FrameRing *pRing);
+
+/*********************************************************************//*!
+ * @brief Get the oldest frame a consumer has not released yet.
+ *
+ * @param pRing Pointer to the ring.
+ * @param consumer Index of the consumer.
+ * @return The descriptor or NULL if there is no new frame.
+ *//*********************************************************************/
+struct FrameDesc* FrameRing_Peek(struct FrameRing *pRing, uint32 consumer);
+
+/*********************************************************************//*!
+ * @brief Release the frame returned by FrameRing_Peek.
+ *
+ * The descriptor and the frame buffer must not be accessed by the consumer
+ * afterwards.
+ *
+ * @param pRing Pointer to the ring.
+ * @param consumer Index of the consumer.
+ *//*********************************************************************/
+void FrameRing_Release(struct FrameRing *pRing, uint32 consumer);
+
+#endif /* FRAMERING_H */
@@ -21,12 +21,16 @@
  * code.
  */
 
+/* For the CPU affinity interface. */
+#define _GNU_SOURCE
+
 #include "rich-view.h"
 #include <string.h>
 #include <sched.h>
 #include <errno.h>
 #include <unistd.h>
 #include <stdlib.h>
+#include <sys/mman.h>
 
 /*! @brief The "configuration register file" of this program. */
 struct CBP_PARAM regfile[] =
@@ -39,7 +43,109 @@ struct CBP_PARAM regfile[] =
 					1: External triggering */
 	{REG_ID_EXP_TIME, 15000},    /* Exposure time in us. */
 	{REG_ID_MAC_ADDR, 0},        /* MAC address. */
-	{REG_ID_EXP_DELAY, 1}        /* Exposure delay (indXcam only) */
+	{REG_ID_EXP_DELAY, 1},       /* Exposure delay (indXcam only) */
+	{REG_ID_FEED_CONTENT, DEFAULT_FEED_CONTENT}, /* Feed content
+					 Bit 0: Image data
+					 Bit 1: Statistics record
+					 Bit 2: Regions of interest */
+	{REG_ID_STAT_ROI_POS(0), 0}, /* Statistics ROIs: x << 16 | y */
+	{REG_ID_STAT_ROI_SIZE(0), 0},/* and width << 16 | height. */
+	{REG_ID_STAT_ROI_POS(1), 0},
+	{REG_ID_STAT_ROI_SIZE(1), 0},
+	{REG_ID_STAT_ROI_POS(2), 0},
+	{REG_ID_STAT_ROI_SIZE(2), 0},
+	{REG_ID_STAT_ROI_POS(3), 0},
+	{REG_ID_STAT_ROI_SIZE(3), 0},
+	{REG_ID_FEED_RENDITIONS, 1 << REND_FULL}, /* Renditions sent
+					 Bit 0: Full resolution
+					 Bit 1: 1/4 size
+					 Bit 2: 1/16 size */
+	{REG_ID_REND_DIVISOR(REND_FULL), 1},      /* Frame rate divisors */
+	{REG_ID_REND_DIVISOR(REND_QUARTER), 1},   /* of the renditions. */
+	{REG_ID_REND_DIVISOR(REND_SIXTEENTH), 1},
+	{REG_ID_FRAME_RATE, 0},      /* Target frame rate (internal trigger)
+					in frames per 1000 s, 0: maximum. */
+	{REG_ID_FEED_PROFILE, FEED_PROFILE_DEFAULT}, /* Feed transport
+					 0: System defaults
+					 1: Low latency
+					 2: Maximum throughput
+					 3: Constrained link */
+	{REG_ID_FEED_RETAIN_BYTES, 0}, /* Byte budget of the feed retention
+					  window, 0: disabled. */
+	{REG_ID_SYNTH_PATTERN, SYNTH_OFF}, /* Synthetic frame source
+					 0: Off (camera)
+					 1: Moving gradient
+					 2: Noise
+					 3: Static scene */
+	{REG_ID_SYNTH_SIZE, OSC_CAM_MAX_IMAGE_WIDTH << 16 | OSC_CAM_MAX_IMAGE_HEIGHT},
+	{REG_ID_SYNTH_PIX_FMT, V4L2_PIX_FMT_GREY},
+	{REG_ID_SYNTH_RATE, 0},      /* Synthetic frames per 1000 s, 0: one
+					per trigger. */
+	{REG_ID_CHANGE_THRESHOLD, 0}, /* Changed share of the frame above
+					 which it is sent (per mille), 0:
+					 every frame. */
+	{REG_ID_CHANGE_HEARTBEAT, 0}, /* Longest time without a frame sent
+					 (ms), 0: none. */
+	{REG_ID_SENSOR_WIN_POS, 0},  /* Read-out window of the sensor: */
+	{REG_ID_SENSOR_WIN_SIZE, OSC_CAM_MAX_IMAGE_WIDTH << 16 | OSC_CAM_MAX_IMAGE_HEIGHT},
+					/* x << 16 | y, width << 16 | height. */
+	{REG_ID_FEED_ROI_POS(0), 0}, /* Feed ROIs: x << 16 | y */
+	{REG_ID_FEED_ROI_SIZE(0), 0},/* and width << 16 | height. */
+	{REG_ID_FEED_ROI_POS(1), 0},
+	{REG_ID_FEED_ROI_SIZE(1), 0},
+	{REG_ID_FEED_ROI_POS(2), 0},
+	{REG_ID_FEED_ROI_SIZE(2), 0},
+	{REG_ID_FEED_ROI_POS(3), 0},
+	{REG_ID_FEED_ROI_SIZE(3), 0},
+	{REG_ID_FEED_ROI_POS(4), 0},
+	{REG_ID_FEED_ROI_SIZE(4), 0},
+	{REG_ID_FEED_ROI_POS(5), 0},
+	{REG_ID_FEED_ROI_SIZE(5), 0},
+	{REG_ID_FEED_ROI_POS(6), 0},
+	{REG_ID_FEED_ROI_SIZE(6), 0},
+	{REG_ID_FEED_ROI_POS(7), 0},
+	{REG_ID_FEED_ROI_SIZE(7), 0},
+	{REG_ID_FEED_RATE_CAP, 0},   /* Bandwidth cap of the feed in bytes/s,
+					0: none, */
+	{REG_ID_FEED_BURST, FEED_CAP_DEFAULT_BURST}, /* with bursts of up
+					to this many bytes. */
+	{REG_ID_QOS_ENABLE, 0},      /* Images sent chosen by the target. */
+	{REG_ID_PIPE_ENABLE, (1 << PIPE_MAX_STAGES) - 1}, /* All processing
+					stages enabled. */
+	{REG_ID_FEED_BATCH_BYTES, 0}, /* Small feed messages batched up to */
+	{REG_ID_FEED_BATCH_US, FEED_BATCH_DEFAULT_US}, /* this many bytes
+					and us, 0: not batched. */
+	{REG_ID_STATUS_FPS, 0},      /* Achieved frame rate (read only)
+					in frames per 1000 s. */
+	{REG_ID_STATUS_TRIG_JITTER_MEAN, 0}, /* Self-trigger jitter (read */
+	{REG_ID_STATUS_TRIG_JITTER_MAX, 0},  /* only), mean and max in us. */
+	{REG_ID_STATUS_FRAME_DEV_MEAN, 0},   /* Deviation of the frame and */
+	{REG_ID_STATUS_FRAME_DEV_MAX, 0},    /* send intervals from the */
+	{REG_ID_STATUS_SEND_DEV_MEAN, 0},    /* target frame rate (read */
+	{REG_ID_STATUS_SEND_DEV_MAX, 0},     /* only), mean and max in us. */
+	{REG_ID_STATUS_SKIPPED_SLOTS, 0},    /* Skipped frame slots (read only). */
+	{REG_ID_STATUS_FEED_KBPS, 0},        /* Feed link (read only): */
+	{REG_ID_STATUS_FEED_RTT, 0},         /* throughput in kB/s, round */
+	{REG_ID_STATUS_FEED_SNDBUF, 0},      /* trip time in us, send buffer */
+	{REG_ID_STATUS_FEED_RETRANS, 0},     /* in bytes, retransmissions. */
+	{REG_ID_STATUS_SUPPRESSED, 0},       /* Frames suppressed and change */
+	{REG_ID_STATUS_CHANGE, 0},           /* of the last frame (read only). */
+	{REG_ID_STATUS_LOOP_LATE_MEAN, 0},   /* Lateness of the main loop */
+	{REG_ID_STATUS_LOOP_LATE_MAX, 0},    /* (read only), mean and max in us. */
+	{REG_ID_STATUS_FEED_CAP_DROPPED, 0}, /* Feed messages dropped by the
+						bandwidth cap (read only). */
+	{REG_ID_STATUS_QOS_MODE, 0},         /* Quality of service mode and */
+	{REG_ID_STATUS_QOS_LOAD, 0},         /* feed load (read only). */
+	{REG_ID_STATUS_PIPE_US(0), 0},       /* Mean time of the processing */
+	{REG_ID_STATUS_PIPE_US(1), 0},       /* stages in us (read only). */
+	{REG_ID_STATUS_PIPE_US(2), 0},
+	{REG_ID_STATUS_PIPE_US(3), 0},
+	{REG_ID_STATUS_PIPE_US(4), 0},
+	{REG_ID_STATUS_PIPE_US(5), 0},
+	{REG_ID_STATUS_PIPE_US(6), 0},
+	{REG_ID_STATUS_PIPE_US(7), 0},
+	{REG_ID_STATUS_FEED_BATCHES, 0},     /* Batches of small feed messages */
+	{REG_ID_STATUS_FEED_BATCHED_MSGS, 0} /* and messages in them (read only). */
 };
        
 /*! @brief This stores all variables needed by the algorithm. */
@@ -78,6 +184,90 @@ OSC_ERR GetVersionString( char *hVersion)
 	return SUCCESS;
 }
 
+OSC_ERR SetupFrameBuffers(uint32 width, uint32 height)
+{
+	OSC_ERR err;
+	uint8 multiBufferIds[NR_FRAME_BUFFERS];
+	/* 8 bits per pixel, greyscale or bayer. */
+	uint32 i, size = width*height;
+	void *pBuf;
+
+	Synth_ClearFrameBuffers(&data.synth);
+	for(i = 0; i < NR_FRAME_BUFFERS; i++)
+	{
+		free(data.pFrameBuffers[i]);
+		data.pFrameBuffers[i] = NULL;
+	}
+	data.frameBufSize = 0;
+	data.pLatest = NULL;
+
+	for(i = 0; i < NR_FRAME_BUFFERS; i++)
+	{
+		/* The frames are written by DMA, so the buffers are cache line
+		 * aligned for the cache to be invalidated. */
+		if(posix_memalign(&pBuf, CACHE_LINE_SIZE, size) != 0)
+		{
+			OscLog(ERROR, "%s: Unable to allocate frame buffer %d (%d bytes)!\n",
+			       __func__, i, size);
+			return -EOUT_OF_MEMORY;
+		}
+		data.pFrameBuffers[i] = pBuf;
+
+		err = OscCamSetFrameBuffer(i, size, pBuf, TRUE);
+		if (err != SUCCESS)
+		{
+			OscLog(ERROR, "%s: Unable to set up frame buffer %d!\n", __func__, i);
+			return err;
+		}
+		Synth_AddFrameBuffer(&data.synth, pBuf, size);
+		multiBufferIds[i] = i;
+	}
+	
+	/* Create a multi buffer from the frame buffers initilalized above.*/
+	err = OscCamCreateMultiBuffer(NR_FRAME_BUFFERS, multiBufferIds);
+	if (err != SUCCESS)
+	{
+		OscLog(ERROR, "%s: Unable to set up multi buffer!\n", __func__);
+		return err;
+	}
+	data.frameBufSize = size;
+
+	/* The synthetic frames have to fit into the frame buffers. */
+	if(data.synth.width*data.synth.height > size)
+	{
+		Synth_SetSize(&data.synth, width, height);
+	}
+	return SUCCESS;
+}
+
+/*********************************************************************//*!
+ * @brief Log how much memory the subsystems use.
+ *//*********************************************************************/
+static void ReportMemory(void)
+{
+	uint32 frameBufs = NR_FRAME_BUFFERS*data.frameBufSize;
+	uint32 statistics = sizeof(data.statRois) + sizeof(data.statAccu) + sizeof(data.stats);
+	uint32 comm = sizeof(data.comm) + sizeof(struct MsgHdr) + data.comm.cmdBodySize;
+	uint32 other = sizeof(struct DATA) - sizeof(data.frames) - sizeof(data.rends) -
+		sizeof(data.change) - sizeof(data.synth) - sizeof(data.comm) -
+		sizeof(data.statRois) - sizeof(data.statAccu) - sizeof(data.stats);
+
+	OscLog(INFO, "Memory use (bytes):\n");
+	OscLog(INFO, "  frame buffers    %8d (%d x %d)\n",
+	       frameBufs, NR_FRAME_BUFFERS, data.frameBufSize);
+	OscLog(INFO, "  frame ring       %8d\n", (uint32)sizeof(data.frames));
+	OscLog(INFO, "  renditions       %8d\n", (uint32)sizeof(data.rends));
+	OscLog(INFO, "  statistics       %8d\n", statistics);
+	OscLog(INFO, "  change detection %8d\n", (uint32)sizeof(data.change));
+	OscLog(INFO, "  synthetic source %8d\n", (uint32)sizeof(data.synth));
+	OscLog(INFO, "  communication    %8d (feed retention %d more)\n",
+	       comm, data.comm.retain.size);
+	OscLog(INFO, "  other            %8d\n", other);
+	OscLog(INFO, "  total            %8d\n",
+	       (uint32)(sizeof(struct DATA) + sizeof(struct MsgHdr)) + frameBufs +
+	       data.comm.cmdBodySize + data.comm.retain.size);
+}
+
 /*********************************************************************//*!
  * @brief Initialize everything so the application is fully operable
  * after a call to this function.
@@ -87,10 +277,10 @@ OSC_ERR GetVersionString( char *hVersion)
 static OSC_ERR init(const int argc, const char * argv[])
 {
     OSC_ERR err = SUCCESS;
-    uint8 multiBufferIds[2] = {0, 1};
     char strVersion[15]; 
     struct CFG_KEY configKey;
     struct CFG_VAL_STR strCfg;
+    uint32 i;
 #ifdef HAS_CPLD
     uint16 exposureDelay;
 #endif /* HAS_CPLD */	
@@ -121,6 +311,9 @@ static OSC_ERR init(const int argc, const char * argv[])
     OscLogSetConsoleLogLevel(INFO);
     OscLogSetFileLogLevel(DEBUG);
 
+    /* Determine the frequency of the cycle counter for time measurements. */
+    Timing_Init();
+
     /* Print framework version */
     OscGetVersionString( strVersion);    
     OscLog(INFO, "Oscar framework version: %s\n", strVersion);
@@ -235,30 +428,51 @@ static OSC_ERR init(const int argc, const char * argv[])
 		goto cam_err;
 	}
 	
-	/* Set up two frame buffers with enough space for the maximum
-	 * camera resolution in cached memory. */
-	err = OscCamSetFrameBuffer(0, IMAGE_AERA, data.u8FrameBuffers[0], TRUE);
+	/* The synthetic frame source uses the same frame buffers. */
+	Synth_Init(&data.synth,
+		   OSC_CAM_MAX_IMAGE_WIDTH,
+		   OSC_CAM_MAX_IMAGE_HEIGHT,
+		   V4L2_PIX_FMT_GREY);
+
+	/* The sensor starts out with its full resolution. */
+	data.sensorWin.width = OSC_CAM_MAX_IMAGE_WIDTH;
+	data.sensorWin.height = OSC_CAM_MAX_IMAGE_HEIGHT;
+	data.sensorWinReq = data.sensorWin;
+	err = SetupFrameBuffers(data.sensorWin.width, data.sensorWin.height);
 	if (err != SUCCESS)
 	{
-		OscLog(ERROR, "%s: Unable to set up first frame buffer!\n", __func__);
-		goto cam_err;
+		goto fb_err;
 	}
-	err = OscCamSetFrameBuffer(1, IMAGE_AERA, data.u8FrameBuffers[1], TRUE);
+	
+	OscCamSetupPerspective( data.perspective);
+
+	data.feedContent = DEFAULT_FEED_CONTENT;
+	Rend_Init(&data.rends);
+	Chg_Init(&data.change);
+	Roi_Init(&data.rois);
+	Qos_Init(&data.qos);
+	Pipe_Init(&data.pipe);
+	err = SetupPipeline();
 	if (err != SUCCESS)
 	{
-		OscLog(ERROR, "%s: Unable to set up second frame buffer!\n", __func__);
-		goto cam_err;
+		OscLog(ERROR, "Processing pipeline setup failed.\n");
+		goto pool_err;
 	}
-	
-	/* Create a double-buffer from the frame buffers initilalized above.*/
-	err = OscCamCreateMultiBuffer(2, multiBufferIds);
+	Trig_Init(&data.trig, VERTICAL_BLANK_US, MAIN_LOOP_POLL_US);
+	err = FrameRing_Init(&data.frames, NR_FRAME_CONSUMERS);
 	if (err != SUCCESS)
 	{
-		OscLog(ERROR, "%s: Unable to set up multi buffer!\n", __func__);
-		goto mb_err;
+		OscLog(ERROR, "Frame ring initialization failed.\n");
+		goto pool_err;
+	}
+
+	/* Start the workers processing the images in tiles (host only). */
+	err = Pool_Init(0);
+	if (err != SUCCESS)
+	{
+		OscLog(ERROR, "Worker pool initialization failed.\n");
+		goto pool_err;
 	}
-	
-	OscCamSetupPerspective( data.perspective);
 
 	/* Make the register file known to the communication protocol. */
 	data.comm.pRegFile = regfile;
@@ -271,15 +485,27 @@ static OSC_ERR init(const int argc, const char * argv[])
 		OscLog(ERROR, "Communication initialization failed.\n");
 		goto comm_err;		
 	}	
-	
+
+	ReportMemory();
 	return SUCCESS;
 	
 comm_err:    
+	Pool_DeInit();
+pool_err:
+	Roi_DeInit(&data.rois);
+	Pipe_DeInit(&data.pipe);
+fb_err:
+	/* Also the buffers set up before SetupFrameBuffers failed. */
+	Synth_ClearFrameBuffers(&data.synth);
+	for(i = 0; i < NR_FRAME_BUFFERS; i++)
+	{
+		free(data.pFrameBuffers[i]);
+		data.pFrameBuffers[i] = NULL;
+	}
 cfg_err:
 #ifdef HAS_CPLD	
 cpld_err:
 #endif /* HAS_CPLD */
-mb_err:
 cam_err:
     OscUnloadDependencies(data.hFramework,
             deps,
@@ -292,6 +518,8 @@ dep_err:
 
 OSC_ERR Unload()
 {
+	uint32 i;
+
 	/******** Unload the framework module dependencies **********/
 	OscUnloadDependencies(data.hFramework, deps, sizeof(deps)/sizeof(struct OSC_DEPENDENCY));
 	
@@ -299,6 +527,18 @@ OSC_ERR Unload()
 	
 	/* Close all communication */
 	Comm_DeInit(&data.comm);
+	Roi_DeInit(&data.rois);
+	Pipe_DeInit(&data.pipe);
+
+	/* The frame capture device driver is gone, so are its buffers. */
+	Synth_ClearFrameBuffers(&data.synth);
+	for(i = 0; i < NR_FRAME_BUFFERS; i++)
+	{
+		free(data.pFrameBuffers[i]);
+	}
+
+	/* Stop the worker threads. */
+	Pool_DeInit();
 
 	/* Clear global data fields. */
 	memset(&data, 0, sizeof(struct DATA));
@@ -315,6 +555,96 @@ void Terminate()
     return;
 }
 
+/*********************************************************************//*!
+ * @brief Touch every page of a memory range, so no page fault occurs on
+ * the first access in the main loop.
+ *
+ * @param pMem Start of the memory range.
+ * @param size Size of the memory range.
+ *//*********************************************************************/
+static void Prefault(volatile uint8 *pMem, uint32 size)
+{
+	uint32 pageSize = sysconf(_SC_PAGESIZE);
+	uint32 i;
+
+	for(i = 0; i < size; i += pageSize)
+	{
+		pMem[i] = pMem[i];
+	}
+}
+
+/*********************************************************************//*!
+ * @brief Run the main loop with the real-time properties configured.
+ *
+ * Reads the configuration keys
+ * - RTP: Priority under SCHED_FIFO (1..99), normal scheduling if missing
+ *   or 0.
+ * - CPU: Index of the CPU the main loop is pinned to, not pinned if
+ *   missing.
+ * - MLK: If 1, all memory is locked into RAM and the application data
+ *   and the stack of the main loop are pre-faulted.
+ *
+ * Applies to the calling thread only, the workers of the pool keep their
+ * scheduling. A property that cannot be set is logged and skipped.
+ *//*********************************************************************/
+static void SetupRealTime(void)
+{
+	struct CFG_KEY configKey;
+	struct sched_param param;
+	uint32 val;
+	uint8 stack[PREFAULT_STACK_SIZE];
+#ifdef CPU_SET
+	cpu_set_t cpus;
+#endif /* CPU_SET */
+
+	configKey.strSection = NULL;
+	configKey.strTag = "MLK";
+	if(OscCfgGetUInt32(data.hConfig, &configKey, &val) == SUCCESS && val == 1)
+	{
+		if(mlockall(MCL_CURRENT | MCL_FUTURE) != 0)
+		{
+			OscLog(WARN, "%s: Unable to lock the memory (%s).\n",
+			       __func__, strerror(errno));
+		}
+		Prefault((volatile uint8*)&data, sizeof(struct DATA));
+		Prefault(stack, sizeof(stack));
+		OscLog(INFO, "%s: Memory locked.\n", __func__);
+	}
+
+	configKey.strTag = "CPU";
+	if(OscCfgGetUInt32(data.hConfig, &configKey, &val) == SUCCESS)
+	{
+#ifdef CPU_SET
+		CPU_ZERO(&cpus);
+		CPU_SET(val, &cpus);
+		if(sched_setaffinity(0, sizeof(cpus), &cpus) != 0)
+		{
+			OscLog(WARN, "%s: Unable to pin the main loop to CPU %d (%s).\n",
+			       __func__, val, strerror(errno));
+		} else {
+			OscLog(INFO, "%s: Main loop pinned to CPU %d.\n", __func__, val);
+		}
+#else
+		OscLog(WARN, "%s: CPU affinity not supported.\n", __func__);
+#endif /* CPU_SET */
+	}
+
+	configKey.strTag = "RTP";
+	if(OscCfgGetUInt32(data.hConfig, &configKey, &val) == SUCCESS && val != 0)
+	{
+		memset(&param, 0, sizeof(param));
+		param.sched_priority = val;
+		if(sched_setscheduler(0, SCHED_FIFO, &param) != 0)
+		{
+			OscLog(WARN, "%s: Unable to set real-time priority %d (%s).\n",
+			       __func__, val, strerror(errno));
+		} else {
+			OscLog(INFO, "%s: Main loop runs at real-time priority %d.\n",
+			       __func__, val);
+		}
+	}
+}
+
 /*********************************************************************//*!
  * @brief Program entry
  * 
@@ -337,6 +667,7 @@ int main(const int argc, const char * argv[])
 	OscLog(INFO, "CPLD Firmware (Version: %d)\n", (int)data.firmwareRevision);
 #endif /* HAS_CPLD */
 	
+	SetupRealTime();
 	StateControl();
 	
 	Unload();
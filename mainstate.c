@@ -23,6 +23,7 @@
  */
 #include "rich-view.h"
 #include "mainstate.h"
+#include "trace.h"
 #include <string.h>
 #include <stdlib.h>
 #include <unistd.h>
@@ -40,6 +41,12 @@ const Msg mainStateMsg[] = {
 OSC_ERR SelfTrigger(void)
 {
   OSC_ERR err;
+
+  if(Synth_Enabled(&data.synth))
+    {
+      Synth_Trigger(&data.synth);
+      return SUCCESS;
+    }
 #ifdef HAS_CPLD
   err = OscLgxTriggerImage();
 #else
@@ -62,7 +69,56 @@ OSC_ERR SelfTrigger(void)
 static inline void ThrowEvent(struct MainState *pHsm, unsigned int evt)
 {
 	const Msg *pMsg = &mainStateMsg[evt];
+	const State *pPrev = ((Hsm*)pHsm)->curr;
+	const State *pCurr;
+
+	Trace_Add(TRACE_HSM_EVENT, evt);
 	HsmOnEvent((Hsm*)pHsm, pMsg);
+
+	pCurr = ((Hsm*)pHsm)->curr;
+	if(pCurr != pPrev)
+	{
+		Trace_Add(TRACE_HSM_STATE,
+			  pCurr == &pHsm->idle ? TRACE_ST_IDLE :
+			  pCurr == &pHsm->capture ? TRACE_ST_CAPTURE :
+			  pCurr == &pHsm->internal ? TRACE_ST_INTERNAL : TRACE_ST_EXTERNAL);
+	}
+}
+
+/*********************************************************************//*!
+ * @brief Set up the next capture of the frame source (camera or
+ * synthetic source).
+ *
+ * @return SUCCESS or an appropriate error code.
+ *//*********************************************************************/
+static OSC_ERR SetupCapture(void)
+{
+	OSC_ERR err;
+
+	if(Synth_Enabled(&data.synth))
+	{
+		err = Synth_SetupCapture(&data.synth);
+	} else {
+		err = OscCamSetupCapture(OSC_CAM_MULTI_BUFFER);
+	}
+	Trace_Add(TRACE_CAPTURE, err);
+	return err;
+}
+
+/*********************************************************************//*!
+ * @brief Read the frame of the capture set up from the frame source.
+ *
+ * @param ppPic The frame buffer holding the frame.
+ * @return SUCCESS, -ETIMEOUT, -ENO_CAPTURE_STARTED or an appropriate
+ *         error code.
+ *//*********************************************************************/
+static OSC_ERR ReadPicture(uint8 **ppPic)
+{
+	if(Synth_Enabled(&data.synth))
+	{
+		return Synth_ReadPicture(&data.synth, ppPic, CAMERA_TIMEOUT);
+	}
+	return OscCamReadPicture(OSC_CAM_MULTI_BUFFER, ppPic, 0, CAMERA_TIMEOUT);
 }
 
 
@@ -73,6 +129,8 @@ OSC_ERR SetConfigRegister(void *pMainState, struct CBP_PARAM *pReg)
 	struct CFG_KEY configKey;
 	struct CFG_VAL_STR strCfg;
 	struct MainState *pHsm = (struct MainState *)pMainState;
+	struct StatRoi *pRoi;
+	uint32 roi;
 #ifdef HAS_CPLD
 	uint8 cpldReg;
 	int exposureDelay;
@@ -254,7 +312,206 @@ OSC_ERR SetConfigRegister(void *pMainState, struct CBP_PARAM *pReg)
 	
 		break;
 #endif /* HAS_CPLD */
+	case REG_ID_FRAME_RATE:
+		Trig_SetFrameRate(&data.trig, pReg->val);
+		return SUCCESS;
+	case REG_ID_FEED_RENDITIONS:
+		if(pReg->val >= (1 << REND_COUNT))
+		{
+			OscLog(ERROR, "%s: Invalid renditions (%#x)!\n", __func__, pReg->val);
+			return -EINVALID_PARAMETER;
+		}
+		data.rends.subscribed = pReg->val;
+		return SUCCESS;
+	case REG_ID_FEED_PROFILE:
+		err = Comm_SetFeedProfile(&data.comm, pReg->val);
+		if(err != SUCCESS)
+		{
+			OscLog(ERROR, "%s: Invalid feed profile (%d)!\n", __func__, pReg->val);
+		}
+		return err;
+	case REG_ID_SYNTH_PATTERN:
+		/* The frame source cannot be changed under a running
+		 * capture. */
+		if(((Hsm*)pHsm)->curr != &pHsm->idle)
+		{
+			OscLog(ERROR, "%s: The frame source can only be changed in idle mode!\n",
+			       __func__);
+			return -EUNSUPPORTED;
+		}
+		err = Synth_SetPattern(&data.synth, pReg->val);
+		if(err != SUCCESS)
+		{
+			OscLog(ERROR, "%s: Invalid synthetic pattern (%d)!\n", __func__, pReg->val);
+		}
+		return err;
+	case REG_ID_SYNTH_SIZE:
+		err = Synth_SetSize(&data.synth, pReg->val >> 16, pReg->val & 0xffff);
+		if(err != SUCCESS)
+		{
+			OscLog(ERROR, "%s: Invalid synthetic frame size (%#x)!\n", __func__, pReg->val);
+		}
+		return err;
+	case REG_ID_SYNTH_PIX_FMT:
+		if(pReg->val != V4L2_PIX_FMT_GREY && pReg->val != V4L2_PIX_FMT_SBGGR8)
+		{
+			OscLog(ERROR, "%s: Invalid synthetic pixel format (%#x)!\n", __func__, pReg->val);
+			return -EINVALID_PARAMETER;
+		}
+		data.synth.pixFmt = pReg->val;
+		return SUCCESS;
+	case REG_ID_SYNTH_RATE:
+		Synth_SetRate(&data.synth, pReg->val);
+		return SUCCESS;
+	case REG_ID_CHANGE_THRESHOLD:
+		if(pReg->val > 1000)
+		{
+			OscLog(ERROR, "%s: Invalid change threshold (%d)!\n", __func__, pReg->val);
+			return -EINVALID_PARAMETER;
+		}
+		data.change.threshold = pReg->val;
+		return SUCCESS;
+	case REG_ID_CHANGE_HEARTBEAT:
+		data.change.heartbeatMs = pReg->val;
+		return SUCCESS;
+	case REG_ID_SENSOR_WIN_POS:
+		if(((pReg->val >> 16) & 1) || (pReg->val & 1) ||
+		   (pReg->val >> 16) >= OSC_CAM_MAX_IMAGE_WIDTH ||
+		   (pReg->val & 0xffff) >= OSC_CAM_MAX_IMAGE_HEIGHT)
+		{
+			OscLog(ERROR, "%s: Invalid sensor window position (%#x)!\n",
+			       __func__, pReg->val);
+			return -EINVALID_PARAMETER;
+		}
+		data.sensorWinReq.x = pReg->val >> 16;
+		data.sensorWinReq.y = pReg->val & 0xffff;
+		data.bSensorWinPending = TRUE;
+		return SUCCESS;
+	case REG_ID_SENSOR_WIN_SIZE:
+		/* Only checked on its own, the window is clipped to the sensor
+		 * when it is applied. */
+		if(((pReg->val >> 16) & 1) || (pReg->val & 1) ||
+		   (pReg->val >> 16) > OSC_CAM_MAX_IMAGE_WIDTH ||
+		   (pReg->val & 0xffff) > OSC_CAM_MAX_IMAGE_HEIGHT)
+		{
+			OscLog(ERROR, "%s: Invalid sensor window size (%#x)!\n",
+			       __func__, pReg->val);
+			return -EINVALID_PARAMETER;
+		}
+		data.sensorWinReq.width = pReg->val >> 16;
+		data.sensorWinReq.height = pReg->val & 0xffff;
+		data.bSensorWinPending = TRUE;
+		return SUCCESS;
+	case REG_ID_FEED_RATE_CAP:
+		err = Comm_SetFeedCap(&data.comm, pReg->val, data.comm.feedCap.burst);
+		if(err != SUCCESS)
+		{
+			OscLog(ERROR, "%s: Invalid feed rate cap (%d)!\n", __func__, pReg->val);
+		}
+		return err;
+	case REG_ID_FEED_BURST:
+		err = Comm_SetFeedCap(&data.comm, data.comm.feedCap.rate, pReg->val);
+		if(err != SUCCESS)
+		{
+			OscLog(ERROR, "%s: Invalid feed burst size (%d)!\n", __func__, pReg->val);
+		}
+		return err;
+	case REG_ID_QOS_ENABLE:
+		if(pReg->val > 1)
+		{
+			OscLog(ERROR, "%s: Invalid quality of service setting (%d)!\n",
+			       __func__, pReg->val);
+			return -EINVALID_PARAMETER;
+		}
+		Qos_Enable(&data.qos, pReg->val);
+		return SUCCESS;
+	case REG_ID_PIPE_ENABLE:
+		if(pReg->val >> data.pipe.nStages != 0)
+		{
+			OscLog(ERROR, "%s: Invalid pipeline stages (%#x)!\n",
+			       __func__, pReg->val);
+			return -EINVALID_PARAMETER;
+		}
+		data.pipe.enabled = pReg->val;
+		return SUCCESS;
+	case REG_ID_FEED_BATCH_BYTES:
+		err = Comm_SetFeedBatch(&data.comm, pReg->val, data.comm.batchMaxUs);
+		if(err != SUCCESS)
+		{
+			OscLog(ERROR, "%s: Unable to set the feed batch size (%d)!\n",
+			       __func__, err);
+		}
+		return err;
+	case REG_ID_FEED_BATCH_US:
+		return Comm_SetFeedBatch(&data.comm, data.comm.batchSize, pReg->val);
+	case REG_ID_FEED_RETAIN_BYTES:
+		err = Comm_SetRetention(&data.comm, pReg->val);
+		if(err != SUCCESS)
+		{
+			OscLog(ERROR, "%s: Unable to set the feed retention budget (%d)!\n",
+			       __func__, err);
+		}
+		return err;
+	case REG_ID_FEED_CONTENT:
+		if((pReg->val & ~(FEED_CONTENT_IMAGE | FEED_CONTENT_STATS |
+				  FEED_CONTENT_ROIS)) != 0)
+		{
+			OscLog(ERROR, "%s: Invalid feed content (%#x)!\n", __func__, pReg->val);
+			return -EINVALID_PARAMETER;
+		}
+		data.feedContent = pReg->val;
+		return SUCCESS;
 	default:
+		if(pReg->id >= REG_ID_STAT_ROI_POS(0) &&
+		   pReg->id <= REG_ID_STAT_ROI_SIZE(STAT_MAX_ROIS - 1))
+		{
+			/* Regions are clipped to the image when the statistics
+			 * are computed. */
+			roi = (pReg->id - REG_ID_STAT_ROI_POS(0))/2;
+			pRoi = &data.statRois[roi];
+			if(pReg->id == REG_ID_STAT_ROI_POS(roi))
+			{
+				pRoi->x = pReg->val >> 16;
+				pRoi->y = pReg->val & 0xffff;
+			} else {
+				pRoi->width = pReg->val >> 16;
+				pRoi->height = pReg->val & 0xffff;
+			}
+			return SUCCESS;
+		}
+		if(pReg->id >= REG_ID_FEED_ROI_POS(0) &&
+		   pReg->id <= REG_ID_FEED_ROI_SIZE(ROI_MAX - 1))
+		{
+			/* Clipped to the image when they are packed. */
+			roi = (pReg->id - REG_ID_FEED_ROI_POS(0))/2;
+			pRoi = &data.rois.rects[roi];
+			if(pReg->id == REG_ID_FEED_ROI_POS(roi))
+			{
+				pRoi->x = pReg->val >> 16;
+				pRoi->y = pReg->val & 0xffff;
+			} else {
+				pRoi->width = pReg->val >> 16;
+				pRoi->height = pReg->val & 0xffff;
+			}
+			return SUCCESS;
+		}
+		if(pReg->id >= REG_ID_REND_DIVISOR(0) &&
+		   pReg->id < REG_ID_REND_DIVISOR(REND_COUNT))
+		{
+			if(pReg->val == 0)
+			{
+				OscLog(ERROR, "%s: Invalid frame rate divisor (%d)!\n",
+				       __func__, pReg->val);
+				return -EINVALID_PARAMETER;
+			}
+			data.rends.rend[pReg->id - REG_ID_REND_DIVISOR(0)].divisor = pReg->val;
+			return SUCCESS;
+		}
+		if(pReg->id >= REG_ID_STATUS_FIRST)
+		{
+			OscLog(WARN, "%s: Register %d is read only!\n", __func__, pReg->id);
+			return -EUNSUPPORTED;
+		}
 		OscLog(WARN, "%s: Invalid register (%#x)!\n", __func__, pReg->id);
 		return -EUNSUPPORTED;
 
@@ -274,6 +531,36 @@ OSC_ERR SetConfigRegister(void *pMainState, struct CBP_PARAM *pReg)
 	}
 }
 
+/*********************************************************************//*!
+ * @brief Fill out the feed header of a frame that has just been read.
+ *
+ * @param pFrame The frame.
+ *//*********************************************************************/
+static void DescribeFrame(struct FrameDesc *pFrame)
+{
+	data.comm.feedHdr.seqNr++;
+	Trace_Add(TRACE_FRAME, data.comm.feedHdr.seqNr);
+	/* We need the uptime in milliseconds. */
+	data.comm.feedHdr.timeStamp = (uint32)(OscSupCycToMilliSecs(OscSupCycGet64()));
+
+	if(Synth_Enabled(&data.synth))
+	{
+		data.comm.feedHdr.imgWidth = data.synth.width;
+		data.comm.feedHdr.imgHeight = data.synth.height;
+		data.comm.feedHdr.pixFmt = data.synth.pixFmt;
+	} else {
+		data.comm.feedHdr.imgWidth = data.sensorWin.width;
+		data.comm.feedHdr.imgHeight = data.sensorWin.height;
+#ifdef TARGET_TYPE_LEANXCAM
+		data.comm.feedHdr.pixFmt = V4L2_PIX_FMT_GREY;
+#endif /* TARGET_TYPE_LEANXCAM */
+#ifdef TARGET_TYPE_INDXCAM
+		data.comm.feedHdr.pixFmt = V4L2_PIX_FMT_SBGGR8;
+#endif /* TARGET_TYPE_INDXCAM */
+	}
+	pFrame->feedHdr = data.comm.feedHdr;
+}
+
 Msg const *MainState_top(MainState *me, Msg *msg)
 {
 	switch (msg->evt)
@@ -299,11 +586,8 @@ Msg const *MainState_idle(MainState *me, Msg *msg)
 #endif /* !HAS_CPLD */
 		return 0;
 	case FRAMESEQ_EVT:
-		/* Sleep here for a short while in order not to violate the vertical
-		 * blank time of the camera sensor when triggering a new image
-		 * right after receiving the old one. This can be removed if some
-		 * heavy calculations are done here. */
-		usleep(1000);
+		/* A frame captured on demand for a snapshot. */
+		DescribeFrame(data.pFrame);
 		return 0;
 	case FRAMEPAR_EVT:		
 		return 0;
@@ -339,11 +623,220 @@ Msg const *MainState_idle(MainState *me, Msg *msg)
 	return msg;
 }
 
+/*********************************************************************//*!
+ * @brief Send the renditions of a frame that are due over the feed.
+ *
+ * @param pFrame The frame; its feed header describes the raw image.
+ * @param suppressed Number of frames not sent before this one.
+ *//*********************************************************************/
+static void SendRenditions(const struct FrameDesc *pFrame, uint32 suppressed)
+{
+	struct FeedHdr feedHdr;
+	FeedData_Params feedParams;
+	const struct Rendition *pRend;
+	uint32 due, i, imgSize, rendition;
+	bool bSent = FALSE;
+
+	if(data.qos.mode != QOS_OFF)
+	{
+		/* The controller overrides the subscription. */
+		due = 0;
+		if(Qos_Select(&data.qos, pFrame->feedHdr.seqNr, &rendition))
+		{
+			due = 1 << rendition;
+		}
+	} else {
+		due = Rend_Due(&data.rends, pFrame->feedHdr.seqNr);
+	}
+	Rend_Produce(&data.rends,
+		     pFrame->pImg,
+		     pFrame->feedHdr.imgWidth,
+		     pFrame->feedHdr.imgHeight,
+		     due);
+
+	memset(&feedParams, 0, sizeof(feedParams));
+	feedParams.suppressed = suppressed;
+	feedParams.qosMode = data.qos.mode;
+	for(i = 0; i < REND_COUNT; i++)
+	{
+		if((due & (1 << i)) == 0)
+		{
+			continue;
+		}
+
+		pRend = &data.rends.rend[i];
+		feedHdr = pFrame->feedHdr;
+		feedParams.rendition = i;
+		/* Send the image to the host (8 bit per pixel). */
+		imgSize = feedHdr.imgWidth*feedHdr.imgHeight;
+		if(i != REND_FULL)
+		{
+			/* Reduced renditions are always greyscale. */
+			feedHdr.imgWidth = pRend->width;
+			feedHdr.imgHeight = pRend->height;
+			feedHdr.pixFmt = V4L2_PIX_FMT_GREY;
+			imgSize = pRend->width*pRend->height;
+		}
+		if(Comm_SendFeedMsg(&data.comm,
+				     MSG_FEED_DATA,
+				     &feedParams,
+				     &feedHdr,
+				     pRend->pImg,
+				     imgSize) == SUCCESS)
+		{
+			bSent = TRUE;
+		}
+	}
+
+	if(bSent && data.qos.mode != QOS_OFF)
+	{
+		Qos_FrameSent(&data.qos, OscSupCycGet64());
+	}
+}
+
+/*********************************************************************//*!
+ * @brief Pipeline stage: Send the statistics record of the frame.
+ *
+ * @param pArg Unused.
+ * @param pFrame The frame.
+ * @param pIn The raw image.
+ * @param pOut Unused.
+ * @return SUCCESS
+ *//*********************************************************************/
+static OSC_ERR StageStats(void *pArg,
+			  const struct FrameDesc *pFrame,
+			  const struct PipeImage *pIn,
+			  struct PipeImage *pOut)
+{
+	if((data.feedContent & FEED_CONTENT_STATS) == 0)
+	{
+		return SUCCESS;
+	}
+	Stat_Compute(&data.stats,
+		     data.statAccu,
+		     pIn->pData,
+		     pIn->width,
+		     pIn->height,
+		     data.statRois);
+	Comm_SendFeedMsg(&data.comm,
+			 MSG_FEED_STATS,
+			 NULL,
+			 &pFrame->feedHdr,
+			 &data.stats,
+			 sizeof(struct FeedStats));
+	return SUCCESS;
+}
+
+/*********************************************************************//*!
+ * @brief Pipeline stage: Send the regions of interest of the frame, all
+ * in one message.
+ *
+ * @param pArg Unused.
+ * @param pFrame The frame.
+ * @param pIn The raw image.
+ * @param pOut Unused.
+ * @return SUCCESS or an appropriate error code.
+ *//*********************************************************************/
+static OSC_ERR StageRois(void *pArg,
+			 const struct FrameDesc *pFrame,
+			 const struct PipeImage *pIn,
+			 struct PipeImage *pOut)
+{
+	OSC_ERR err;
+
+	if((data.feedContent & FEED_CONTENT_ROIS) == 0)
+	{
+		return SUCCESS;
+	}
+	err = Roi_Pack(&data.rois,
+		       pIn->pData,
+		       pIn->width,
+		       pIn->height,
+		       pIn->pixFmt == V4L2_PIX_FMT_SBGGR8);
+	if(err != SUCCESS)
+	{
+		return err;
+	}
+	if(data.rois.len != 0)
+	{
+		Comm_SendFeedMsg(&data.comm,
+				 MSG_FEED_ROIS,
+				 NULL,
+				 &pFrame->feedHdr,
+				 data.rois.pBuf,
+				 data.rois.len);
+	}
+	return SUCCESS;
+}
+
+/*********************************************************************//*!
+ * @brief Pipeline stage: Check whether the image of the frame is to be
+ * sent and end the pipeline if not.
+ *
+ * @param pArg Pointer to the number of frames suppressed before this one.
+ * @param pFrame The frame.
+ * @param pIn The raw image.
+ * @param pOut Unused.
+ * @return SUCCESS or PIPE_END.
+ *//*********************************************************************/
+static OSC_ERR StageChange(void *pArg,
+			   const struct FrameDesc *pFrame,
+			   const struct PipeImage *pIn,
+			   struct PipeImage *pOut)
+{
+	if((data.feedContent & FEED_CONTENT_IMAGE) == 0 ||
+	   !Chg_Check(&data.change,
+		      pIn->pData,
+		      pIn->width,
+		      pIn->height,
+		      pFrame->feedHdr.timeStamp,
+		      (uint32*)pArg))
+	{
+		return PIPE_END;
+	}
+	return SUCCESS;
+}
+
+/*********************************************************************//*!
+ * @brief Pipeline stage: Send the renditions of the frame that are due.
+ *
+ * @param pArg Pointer to the number of frames suppressed before this one,
+ *        reset once it has been sent.
+ * @param pFrame The frame.
+ * @param pIn The raw image.
+ * @param pOut Unused.
+ * @return SUCCESS
+ *//*********************************************************************/
+static OSC_ERR StageImage(void *pArg,
+			  const struct FrameDesc *pFrame,
+			  const struct PipeImage *pIn,
+			  struct PipeImage *pOut)
+{
+	uint32 *pSuppressed = (uint32*)pArg;
+
+	SendRenditions(pFrame, *pSuppressed);
+	/* Not set again while the change detection is disabled. */
+	*pSuppressed = 0;
+	return SUCCESS;
+}
+
+OSC_ERR SetupPipeline(void)
+{
+	/* Set by the change detection for the renditions. */
+	static uint32 suppressed;
+	OSC_ERR err;
+
+	err = Pipe_AddStage(&data.pipe, "stats", StageStats, NULL, PIPE_INPUT_RAW, 0);
+	err |= Pipe_AddStage(&data.pipe, "rois", StageRois, NULL, PIPE_INPUT_RAW, 0);
+	err |= Pipe_AddStage(&data.pipe, "change", StageChange, &suppressed, PIPE_INPUT_RAW, 0);
+	err |= Pipe_AddStage(&data.pipe, "image", StageImage, &suppressed, PIPE_INPUT_RAW, 0);
+	return err;
+}
+
 Msg const *MainState_capture(MainState *me, Msg *msg)
 {
         OSC_ERR err;
 	uint8 *pDummyImg = NULL;
-	uint32 imgSize;
 
 	switch (msg->evt)
 	{
@@ -356,35 +849,22 @@ Msg const *MainState_capture(MainState *me, Msg *msg)
 #endif /* !HAS_CPLD */
 
 		OscLog(INFO, "Setup capture\n");
-		err = OscCamSetupCapture( OSC_CAM_MULTI_BUFFER);
+		err = SetupCapture();
 		if (err != SUCCESS)
 		{
 			OscLog(ERROR, "%s: Unable to setup initial capture (%d)!\n", __func__, err);
 		}
 		return 0;
 	case FRAMESEQ_EVT:
-		/* Fill out the feed header. */
-		data.comm.feedHdr.seqNr++;
-		/* We need the uptime in milliseconds. */
-		data.comm.feedHdr.timeStamp = (uint32)(OscSupCycToMilliSecs(OscSupCycGet64()));
-		
-		data.comm.feedHdr.imgWidth = OSC_CAM_MAX_IMAGE_WIDTH;
-		data.comm.feedHdr.imgHeight = OSC_CAM_MAX_IMAGE_HEIGHT;
-#ifdef TARGET_TYPE_LEANXCAM
-		data.comm.feedHdr.pixFmt = V4L2_PIX_FMT_GREY;
-		imgSize = data.comm.feedHdr.imgWidth * data.comm.feedHdr.imgHeight * 1;
-#endif /* TARGET_TYPE_LEANXCAM */
-#ifdef TARGET_TYPE_INDXCAM
-		data.comm.feedHdr.pixFmt = V4L2_PIX_FMT_SBGGR8;
-		imgSize = data.comm.feedHdr.imgWidth * data.comm.feedHdr.imgHeight * 1;
-#endif /* TARGET_TYPE_INDXCAM */
-		/* Send the image to the host. */
-	  	Comm_SendImage(&data.comm, 
-			       data.pCurRawImg, 
-			       imgSize,
-			       &data.comm.feedHdr);
+		/* Only do what has to happen before the next capture is set up
+		 * here, everything else belongs to FRAMEPAR_EVT. */
+		DescribeFrame(data.pFrame);
 		return 0;
-	case FRAMEPAR_EVT:	
+	case FRAMEPAR_EVT:
+		/* The next capture is already running into another frame
+		 * buffer, the one of this frame is not reused before the frame
+		 * has been released. */
+		Pipe_Run(&data.pipe, data.pFrame);
 		return 0;
 	case CMD_GO_IDLE_EVT:
 		/* Read picture until no more capture is active.Always use self-trigg*/
@@ -392,7 +872,7 @@ Msg const *MainState_capture(MainState *me, Msg *msg)
 		while(err != -ENO_CAPTURE_STARTED)
 		{
 			SelfTrigger();
-			err = OscCamReadPicture(OSC_CAM_MULTI_BUFFER, &pDummyImg, 0, CAMERA_TIMEOUT);
+			err = ReadPicture(&pDummyImg);
 			OscLog(DEBUG, "%s: Removed picture from queue! (%d)\n", __func__, err);
 		} 
 		STATE_TRAN(me, &me->idle);
@@ -412,9 +892,11 @@ Msg const *MainState_capture(MainState *me, Msg *msg)
 		while(err != -ENO_CAPTURE_STARTED)
 		{
 			SelfTrigger();
-			err = OscCamReadPicture(OSC_CAM_MULTI_BUFFER, &pDummyImg, 0, CAMERA_TIMEOUT);
+			err = ReadPicture(&pDummyImg);
 			OscLog(DEBUG, "%s: Removed picture from queue! (%d)\n", __func__, err);
 		} 
+		/* The frame buffers have been overwritten. */
+		data.pLatest = NULL;
 		return 0;
 	}
 	return msg;
@@ -427,11 +909,27 @@ Msg const *MainState_internal(MainState *me, Msg *msg)
 	case ENTRY_EVT:
 		OscLog(INFO, "Enter internal capture mode.\n");
 		/* Initiate manual triggering. Target dependet. */
+		data.trig.bArmed = FALSE;
 		SelfTrigger();
+		Trig_Fired(&data.trig, OscSupCycGet64());
 		return 0;
+	case FRAMESEQ_EVT:
+		/* Plan the trigger of the capture that is set up next. The frame
+		 * itself is handled by the capture state. */
+		Trig_FrameReceived(&data.trig, data.pFrame->frameCyc);
+		Trig_Arm(&data.trig, data.pFrame->frameCyc);
+		return msg;
+	case FRAMEPAR_EVT:
+		Trig_SendStarted(&data.trig, OscSupCycGet64());
+		return msg;
 	case TRIGGER_EVT:
-		/* Initiate manual triggering. Target dependet. */
-		SelfTrigger();
+		/* Initiate manual triggering when the scheduler says so.
+		 * Target dependet. */
+		if(Trig_Poll(&data.trig))
+		{
+			SelfTrigger();
+			Trig_Fired(&data.trig, OscSupCycGet64());
+		}
 		return 0;
 	}
 	return msg;
@@ -472,11 +970,267 @@ void MainStateConstruct(MainState *me)
 		&me->capture, (EvtHndlr)MainState_external);
 }
 
+/*********************************************************************//*!
+ * @brief Update the status registers at the end of a measurement window.
+ *
+ * @param pFpsMeter Pointer to the frame rate meter.
+ *//*********************************************************************/
+static void UpdateStatusRegs(const struct RateMeter *pFpsMeter)
+{
+	struct FeedLinkStats link;
+	const struct PipeStage *pStage;
+	uint32 i;
+
+	Comm_UpdateReg(&data.comm, REG_ID_STATUS_FPS, pFpsMeter->milliHz);
+	Comm_UpdateReg(&data.comm, REG_ID_STATUS_TRIG_JITTER_MEAN,
+		       Timing_DevMean(&data.trig.jitter));
+	Comm_UpdateReg(&data.comm, REG_ID_STATUS_TRIG_JITTER_MAX,
+		       data.trig.jitter.maxUs);
+	Comm_UpdateReg(&data.comm, REG_ID_STATUS_FRAME_DEV_MEAN,
+		       Timing_DevMean(&data.trig.frameDev));
+	Comm_UpdateReg(&data.comm, REG_ID_STATUS_FRAME_DEV_MAX,
+		       data.trig.frameDev.maxUs);
+	Comm_UpdateReg(&data.comm, REG_ID_STATUS_SEND_DEV_MEAN,
+		       Timing_DevMean(&data.trig.sendDev));
+	Comm_UpdateReg(&data.comm, REG_ID_STATUS_SEND_DEV_MAX,
+		       data.trig.sendDev.maxUs);
+	Comm_UpdateReg(&data.comm, REG_ID_STATUS_SKIPPED_SLOTS,
+		       data.trig.nSkipped);
+	Comm_UpdateReg(&data.comm, REG_ID_STATUS_SUPPRESSED,
+		       data.change.nSuppressedTotal);
+	Comm_UpdateReg(&data.comm, REG_ID_STATUS_CHANGE,
+		       data.change.lastChange);
+	Comm_UpdateReg(&data.comm, REG_ID_STATUS_LOOP_LATE_MEAN,
+		       Timing_DevMean(&data.loopLate));
+	Comm_UpdateReg(&data.comm, REG_ID_STATUS_LOOP_LATE_MAX,
+		       data.loopLate.maxUs);
+
+	/* Adapt the feed socket to the measured link. */
+	Comm_TuneFeed(&data.comm, &link);
+	Comm_UpdateReg(&data.comm, REG_ID_STATUS_FEED_KBPS, link.kBps);
+	Comm_UpdateReg(&data.comm, REG_ID_STATUS_FEED_RTT, link.rttUs);
+	Comm_UpdateReg(&data.comm, REG_ID_STATUS_FEED_SNDBUF, link.sndBuf);
+	Comm_UpdateReg(&data.comm, REG_ID_STATUS_FEED_RETRANS, link.retrans);
+	Comm_UpdateReg(&data.comm, REG_ID_STATUS_FEED_CAP_DROPPED,
+		       data.comm.nCapDropped);
+	Comm_UpdateReg(&data.comm, REG_ID_STATUS_QOS_MODE, data.qos.mode);
+	Comm_UpdateReg(&data.comm, REG_ID_STATUS_QOS_LOAD, data.qos.load);
+	for(i = 0; i < data.pipe.nStages; i++)
+	{
+		Comm_UpdateReg(&data.comm, REG_ID_STATUS_PIPE_US(i),
+			       Pipe_MeanUs(&data.pipe.stages[i]));
+	}
+	Comm_UpdateReg(&data.comm, REG_ID_STATUS_FEED_BATCHES, data.comm.nBatches);
+	Comm_UpdateReg(&data.comm, REG_ID_STATUS_FEED_BATCHED_MSGS,
+		       data.comm.nBatchedMsgs);
+
+	/* The feed load is relative to the configured frame period. The rate
+	 * achieved is no measure of it: A frame is only read when the feed
+	 * has released the one before, so the feed throttles it itself. */
+	if(data.enTriggerMode == TRIG_MODE_INTERNAL && data.trig.periodCyc != 0)
+	{
+		data.qos.periodUs = Timing_CycToUs(data.trig.periodCyc);
+	} else if(Synth_Enabled(&data.synth) && data.synth.periodCyc != 0)
+	{
+		data.qos.periodUs = Timing_CycToUs(data.synth.periodCyc);
+	} else {
+		data.qos.periodUs = 0;
+	}
+	OscLog(DEBUG, "%s: %d.%03d fps, trigger jitter %d us mean, %d us max\n",
+	       __func__, pFpsMeter->milliHz/1000, pFpsMeter->milliHz % 1000,
+	       Timing_DevMean(&data.trig.jitter), data.trig.jitter.maxUs);
+	OscLog(DEBUG, "%s: frame deviation %d/%d us, send deviation %d/%d us "
+	       "(mean/max), %d slots skipped\n", __func__,
+	       Timing_DevMean(&data.trig.frameDev), data.trig.frameDev.maxUs,
+	       Timing_DevMean(&data.trig.sendDev), data.trig.sendDev.maxUs,
+	       data.trig.nSkipped);
+	OscLog(DEBUG, "%s: feed %d kB/s, rtt %d us, send buffer %d bytes, "
+	       "%d retransmissions\n", __func__, link.kBps, link.rttUs,
+	       link.sndBuf, link.retrans);
+	if(data.comm.feedCap.rate != 0)
+	{
+		OscLog(DEBUG, "%s: feed capped to %d kB/s, %d messages dropped\n",
+		       __func__, data.comm.feedCap.rate/1024, data.comm.nCapDropped);
+	}
+	if(data.comm.batchSize != 0)
+	{
+		OscLog(DEBUG, "%s: %d feed messages sent in %d batches\n",
+		       __func__, data.comm.nBatchedMsgs, data.comm.nBatches);
+	}
+
+	OscLog(DEBUG, "%s: main loop late by %d us mean, %d us max\n",
+	       __func__, Timing_DevMean(&data.loopLate), data.loopLate.maxUs);
+	for(i = 0; i < data.pipe.nStages; i++)
+	{
+		pStage = &data.pipe.stages[i];
+		OscLog(DEBUG, "%s: stage %s %d runs, %d us mean, %d us max\n",
+		       __func__, pStage->strName, pStage->nRuns,
+		       Pipe_MeanUs(pStage), Timing_CycToUs(pStage->maxCyc));
+	}
+
+	Trig_ResetStats(&data.trig);
+	Pipe_ResetStats(&data.pipe);
+	memset(&data.loopLate, 0, sizeof(data.loopLate));
+}
+
+/*********************************************************************//*!
+ * @brief Answer the snapshot request with a frame.
+ *
+ * The requested region is copied out of the frame buffer, so the frame is
+ * not held while the reply is sent.
+ *
+ * @param pFrame The frame.
+ *//*********************************************************************/
+static void ServeSnapshot(const struct FrameDesc *pFrame)
+{
+	const SnapshotReq_Params *pReq = &Comm_SnapshotRequest(&data.comm)->msgParams.snapshotReq;
+	const struct FeedHdr *pSrc = &pFrame->feedHdr;
+	struct FeedHdr feedHdr = *pSrc;
+	SnapshotReply_Params params;
+	uint32 x, y, width, height, scale;
+	bool bBayer = pSrc->pixFmt == V4L2_PIX_FMT_SBGGR8;
+	uint8 *pImg;
+
+	x = MIN(pReq->pos >> 16, pSrc->imgWidth);
+	y = MIN(pReq->pos & 0xffff, pSrc->imgHeight);
+	if(bBayer)
+	{
+		/* Keep the bayer pattern. */
+		x &= ~1;
+		y &= ~1;
+	}
+	width = pSrc->imgWidth - x;
+	height = pSrc->imgHeight - y;
+	if(pReq->size != 0)
+	{
+		width = MIN(pReq->size >> 16, width);
+		height = MIN(pReq->size & 0xffff, height);
+	}
+	scale = pReq->scale == 0 ? 1 : pReq->scale;
+
+	feedHdr.imgWidth = width/scale;
+	feedHdr.imgHeight = height/scale;
+	if(scale > 1)
+	{
+		feedHdr.pixFmt = V4L2_PIX_FMT_GREY;
+	} else if(bBayer)
+	{
+		feedHdr.imgWidth &= ~1;
+		feedHdr.imgHeight &= ~1;
+	}
+	if(feedHdr.imgWidth == 0 || feedHdr.imgHeight == 0)
+	{
+		OscLog(WARN, "%s: Snapshot region outside of the frame.\n", __func__);
+		Comm_SnapshotReply(&data.comm, NULL, NULL);
+		return;
+	}
+
+	params.pos = x << 16 | y;
+	params.size = (feedHdr.imgWidth*scale) << 16 | (feedHdr.imgHeight*scale);
+	params.scale = scale;
+	params.unused3 = 0;
+	pImg = Comm_SnapshotReply(&data.comm, &params, &feedHdr);
+	if(pImg != NULL)
+	{
+		Rend_Extract(pFrame->pImg, pSrc->imgWidth, x, y,
+			     feedHdr.imgWidth*scale, feedHdr.imgHeight*scale,
+			     scale, pImg);
+	}
+}
+
+/*********************************************************************//*!
+ * @brief Set the read-out window of the sensor and allocate frame buffers
+ * of its size.
+ *
+ * No capture may be set up.
+ *
+ * @param pWin The window.
+ * @return SUCCESS or an appropriate error code.
+ *//*********************************************************************/
+static OSC_ERR SetSensorWindow(const struct SensorWindow *pWin)
+{
+	OSC_ERR err;
+
+	err = OscCamSetAreaOfInterest(pWin->x, pWin->y, pWin->width, pWin->height);
+	if(err != SUCCESS)
+	{
+		OscLog(ERROR, "%s: Unable to set the area of interest (%d)!\n",
+		       __func__, err);
+		return err;
+	}
+	err = SetupFrameBuffers(pWin->width, pWin->height);
+	if(err != SUCCESS)
+	{
+		return err;
+	}
+	data.sensorWin = *pWin;
+	return SUCCESS;
+}
+
+/*********************************************************************//*!
+ * @brief Apply the read-out window of the sensor set by the registers.
+ *
+ * A running acquisition is stopped for the frame buffers to be replaced
+ * and restarted afterwards, so no frame buffer may be in use.
+ *
+ * @param pHsm Pointer to the state machine.
+ *//*********************************************************************/
+static void ApplySensorWindow(struct MainState *pHsm)
+{
+	struct SensorWindow win = data.sensorWinReq, prev = data.sensorWin;
+	bool bCapturing = ((Hsm*)pHsm)->curr != &pHsm->idle;
+
+	data.bSensorWinPending = FALSE;
+	if(win.width == 0 || win.x + win.width > OSC_CAM_MAX_IMAGE_WIDTH)
+	{
+		win.width = OSC_CAM_MAX_IMAGE_WIDTH - win.x;
+	}
+	if(win.height == 0 || win.y + win.height > OSC_CAM_MAX_IMAGE_HEIGHT)
+	{
+		win.height = OSC_CAM_MAX_IMAGE_HEIGHT - win.y;
+	}
+	if(memcmp(&win, &prev, sizeof(win)) == 0)
+	{
+		return;
+	}
+
+	if(bCapturing)
+	{
+		ThrowEvent(pHsm, CMD_GO_IDLE_EVT);
+	}
+	if(SetSensorWindow(&win) == SUCCESS)
+	{
+		OscLog(INFO, "%s: Sensor window %dx%d at %d/%d.\n",
+		       __func__, win.width, win.height, win.x, win.y);
+	} else if(SetSensorWindow(&prev) != SUCCESS)
+	{
+		OscLog(ERROR, "%s: Unable to restore the sensor window!\n", __func__);
+	}
+
+	/* Show the window actually used. */
+	Comm_UpdateReg(&data.comm, REG_ID_SENSOR_WIN_POS,
+		       data.sensorWin.x << 16 | data.sensorWin.y);
+	Comm_UpdateReg(&data.comm, REG_ID_SENSOR_WIN_SIZE,
+		       data.sensorWin.width << 16 | data.sensorWin.height);
+	Comm_UpdateReg(&data.comm, REG_ID_SYNTH_SIZE,
+		       data.synth.width << 16 | data.synth.height);
+	if(bCapturing)
+	{
+		ThrowEvent(pHsm, CMD_GO_ACQ_EVT);
+	}
+}
+
 OSC_ERR StateControl( void)
 {
 	OSC_ERR err;
 	MainState mainState;
 	uint8 *pCurRawImg = NULL;
+	struct RateMeter fpsMeter;
+	uint64 parStart, pollCyc, dueCyc, lastPollCyc = 0;
+	bool bFeedBusy, bIdle, bOneShot = FALSE;
+	const struct MsgHdr *pSnapReq;
+
+	memset(&fpsMeter, 0, sizeof(fpsMeter));
 
 	/* Setup main state machine. Start with idle mode. */
 	MainStateConstruct(&mainState);
@@ -490,15 +1244,32 @@ OSC_ERR StateControl( void)
 		{
 		  /*----------- Alternating 	a) check for new connections
 		   *                            b) check for commands (and do process) 
-		   * 				c) check for available picture */
-			err = Comm_AcceptConnections(&data.comm, ACCEPT_CONNS_TIMEOUT);
+		   *				c) send feed data until a command arrives
+		   * 				d) check for available picture
+		   * Do not wait in a) and b) while there is feed data to send. */
+			/* No iteration should take longer than the timeouts
+			 * add up to; an earlier one is not late at all. */
+			pollCyc = OscSupCycGet64();
+			if(lastPollCyc != 0)
+			{
+				dueCyc = lastPollCyc + Timing_UsToCyc(MAIN_LOOP_POLL_US);
+				Timing_DevAdd(&data.loopLate, pollCyc, MIN(pollCyc, dueCyc));
+			}
+			lastPollCyc = pollCyc;
+
+			Trace_Add(TRACE_PHASE, TRACE_PH_ACCEPT);
+			bFeedBusy = Comm_FeedBusy(&data.comm);
+			err = Comm_AcceptConnections(&data.comm,
+						     bFeedBusy ? 0 : ACCEPT_CONNS_TIMEOUT);
 			if(err != SUCCESS && err != -ETIMEOUT)
 			{
 				OscLog(ERROR, "%s: Error accepting new connections (%d)!\n",
 				       __func__, err);
 			}
 
-			err = Comm_HandleCommands(&data.comm, &mainState, GET_CMDS_TIMEOUT);
+			Trace_Add(TRACE_PHASE, TRACE_PH_COMMANDS);
+			err = Comm_HandleCommands(&data.comm, &mainState,
+						  bFeedBusy ? 0 : GET_CMDS_TIMEOUT);
 			if(err != SUCCESS && err != -ETIMEOUT)
 			{
 				OscLog(ERROR, "%s: Error handling commands (%d)!\n",
@@ -507,9 +1278,74 @@ OSC_ERR StateControl( void)
 			{
 				OscLog(INFO, "Command received.\n");		
 			}
-			
-			 
-			err = OscCamReadPicture(OSC_CAM_MULTI_BUFFER, &pCurRawImg, 0, CAMERA_TIMEOUT);
+
+			/* A snapshot of the latest frame is taken right away,
+			 * otherwise when the next frame has been read. In idle
+			 * mode, that frame is captured on demand. */
+			bIdle = ((Hsm*)&mainState)->curr == &mainState.idle;
+			pSnapReq = Comm_SnapshotRequest(&data.comm);
+			if(pSnapReq != NULL)
+			{
+				Trace_Add(TRACE_PHASE, TRACE_PH_SNAPSHOT);
+				if(pSnapReq->msgParams.snapshotReq.mode == SNAPSHOT_LATEST &&
+				   data.pLatest != NULL)
+				{
+					ServeSnapshot(data.pLatest);
+				} else if(bIdle && !bOneShot)
+				{
+					SetupCapture();
+					SelfTrigger();
+					bOneShot = TRUE;
+				}
+			}
+
+			Trace_Add(TRACE_PHASE, TRACE_PH_FEED);
+			err = Comm_SendRegChanges(&data.comm);
+			if(err != SUCCESS && err != -ETRY_AGAIN)
+			{
+				OscLog(ERROR, "%s: Error sending the register changes (%d)!\n",
+				       __func__, err);
+			}
+
+			err = Comm_PumpFeed(&data.comm, FEED_PUMP_TIMEOUT);
+			if(err != SUCCESS && err != -ETIMEOUT && err != -ETRY_AGAIN)
+			{
+				OscLog(ERROR, "%s: Error sending feed data (%d)!\n",
+				       __func__, err);
+			}
+
+			if(Qos_Measuring(&data.qos) && Comm_FeedDrained(&data.comm))
+			{
+				Qos_FrameDelivered(&data.qos, OscSupCycGet64());
+			}
+
+			/* The feed keeps its frame until all of it has been sent
+			 * (replayed messages are copies). */
+			if(!Comm_FeedUsesData(&data.comm) &&
+			   FrameRing_Peek(&data.frames, FRAME_CONSUMER_FEED) != NULL)
+			{
+				FrameRing_Release(&data.frames, FRAME_CONSUMER_FEED);
+			}
+
+			/* The frame buffers are replaced for a new sensor window
+			 * when none of them holds a frame or is set up for a
+			 * capture on demand. */
+			if(data.bSensorWinPending && !bOneShot &&
+			   FrameRing_InUse(&data.frames) == 0)
+			{
+				ApplySensorWindow(&mainState);
+			}
+
+			/* A frame is only taken when the buffer the next capture goes
+			 * to has been released by all consumers. Otherwise it waits
+			 * in its buffer and the loop keeps serving commands. */
+			if(FrameRing_InUse(&data.frames) <= NR_FRAME_BUFFERS - 2)
+			{
+				Trace_Add(TRACE_PHASE, TRACE_PH_READ);
+				err = ReadPicture(&pCurRawImg);
+			} else {
+				err = -ETIMEOUT;
+			}
 			if ((err != -ETIMEOUT) ||(err != -ENO_CAPTURE_STARTED) )
 			{
 				/* Anything other than a timeout or no pending capture  means that we should
@@ -519,8 +1355,21 @@ OSC_ERR StateControl( void)
 		}		
 		if( err == SUCCESS) /* only if breaked due to CamReadPic() */
 		{
-		    data.pCurRawImg = pCurRawImg;
+		    /* Processing a frame is not lateness. */
+		    lastPollCyc = 0;
+		    /* Cannot fail: Frames are only read while a frame buffer is
+		     * free, and the ring holds more frames than there are frame
+		     * buffers. */
+		    data.pFrame = FrameRing_Claim(&data.frames);
+		    data.pFrame->pImg = pCurRawImg;
+		    data.pFrame->frameCyc = OscSupCycGet64();
+		    bOneShot = FALSE;
 		    OscLog(DEBUG, "---image available\n");
+
+		    if(Timing_RateMark(&fpsMeter, data.pFrame->frameCyc))
+		    {
+			    UpdateStatusRegs(&fpsMeter);
+		    }
 		}
 		else
 		{
@@ -530,13 +1379,20 @@ OSC_ERR StateControl( void)
 		/*----------- process frame by state engine (pre-setup) Sequentially with next capture */
 		if( pCurRawImg)
 		{
+		    Trace_Add(TRACE_PHASE, TRACE_PH_FRAMESEQ);
 		    ThrowEvent(&mainState, FRAMESEQ_EVT);
+		    FrameRing_Publish(&data.frames);
+		    data.pLatest = data.pFrame;
 		}
 		
-		/*----------- prepare next capture */
-		if( pCurRawImg)
+		Trace_Add(TRACE_PHASE, TRACE_PH_SETUP);
+		/*----------- prepare next capture. The capture goes to the frame
+		 * buffer of the oldest frame, which all consumers have released
+		 * before the frame has been read. In idle mode, frames are only
+		 * captured on demand. */
+		if( pCurRawImg && !bIdle)
 		{
-		    err = OscCamSetupCapture( OSC_CAM_MULTI_BUFFER);
+		    err = SetupCapture();
 		    if (err != SUCCESS)
 			{
 				OscLog(ERROR, "%s: Unable to setup capture (%d)!\n", __func__, err);
@@ -551,7 +1407,20 @@ OSC_ERR StateControl( void)
 		/*----------- process frame by state engine (post-setup) Parallel with next capture */
 		if( pCurRawImg)
 		{
+			Trace_Add(TRACE_PHASE, TRACE_PH_FRAMEPAR);
+			parStart = OscSupCycGet64();
+			/* The feed is a consumer of the frame ring. The frame is
+			 * released when the feed messages are sent. */
+			data.pFrame = FrameRing_Peek(&data.frames, FRAME_CONSUMER_FEED);
 			ThrowEvent(&mainState, FRAMEPAR_EVT);
+			/* The trigger scheduler needs to know how long it is not
+			 * polled. */
+			Trig_SetBusy(&data.trig, OscSupCycGet64() - parStart);
+
+			if(Comm_SnapshotRequest(&data.comm) != NULL)
+			{
+				ServeSnapshot(data.pLatest);
+			}
 		}
 	
 	} /* end while ever */
@@ -0,0 +1,367 @@
+/*	Target side application for the Rich Viewer.
+	Copyright (C) 2008 Supercomputing Systems AG
+
+	This library is free software; you can redistribute it and/or modify it
+	under the terms of the GNU Lesser General Public License as published by
+	the Free Software Foundation; either version 2.1 of the License, or (at
+	your option) any later version.
+
+	This library is distributed in the hope that it will be useful, but
+	WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser
+	General Public License for more details.
+
+	You should have received a copy of the GNU Lesser General Public License
+	along with this library; if not, write to the Free Software Foundation,
+	Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+
+/*! @file pipeline.c
+ * @brief Processing pipeline implementation.
+ */
+
+#include "pipeline.h"
+#include "timing.h"
+#include <stdlib.h>
+#include <string.h>
+
+void Pipe_Init(struct Pipeline *pPipe)
+{
+	memset(pPipe, 0, sizeof(struct Pipeline));
+	pPipe->enabled = (1 << PIPE_MAX_STAGES) - 1;
+	pPipe->bStrips = TRUE;
+}
+
+void Pipe_DeInit(struct Pipeline *pPipe)
+{
+	uint32 i;
+
+	for(i = 0; i < pPipe->nStages; i++)
+	{
+		free(pPipe->stages[i].out.pData);
+		pPipe->stages[i].out.pData = NULL;
+		pPipe->stages[i].outSize = 0;
+	}
+}
+
+OSC_ERR Pipe_AddStage(struct Pipeline *pPipe,
+		      const char *strName,
+		      PipeStageFn pfnRun,
+		      void *pArg,
+		      uint32 input,
+		      uint32 outBpp)
+{
+	struct PipeStage *pStage;
+
+	if(pPipe->nStages == PIPE_MAX_STAGES)
+	{
+		return -EOUT_OF_MEMORY;
+	}
+	if(input != PIPE_INPUT_RAW &&
+	   (input >= pPipe->nStages || pPipe->stages[input].outBpp == 0))
+	{
+		return -EINVALID_PARAMETER;
+	}
+
+	pStage = &pPipe->stages[pPipe->nStages++];
+	memset(pStage, 0, sizeof(struct PipeStage));
+	pStage->strName = strName;
+	pStage->pfnRun = pfnRun;
+	pStage->pArg = pArg;
+	pStage->input = input;
+	pStage->outBpp = outBpp;
+	pStage->rowDiv = 1;
+	return SUCCESS;
+}
+
+OSC_ERR Pipe_AddStripStage(struct Pipeline *pPipe,
+			   const char *strName,
+			   PipeStripFn pfnStrip,
+			   void *pArg,
+			   uint32 input,
+			   uint32 outBpp,
+			   uint32 rowDiv)
+{
+	OSC_ERR err;
+
+	if(rowDiv == 0)
+	{
+		return -EINVALID_PARAMETER;
+	}
+	err = Pipe_AddStage(pPipe, strName, NULL, pArg, input, outBpp);
+	if(err != SUCCESS)
+	{
+		return err;
+	}
+	pPipe->stages[pPipe->nStages - 1].pfnStrip = pfnStrip;
+	pPipe->stages[pPipe->nStages - 1].rowDiv = rowDiv;
+	return SUCCESS;
+}
+
+/*********************************************************************//*!
+ * @brief Get the input of a stage for the current frame.
+ *
+ * @param pPipe Pointer to the pipeline.
+ * @param i Index of the stage.
+ * @param pRaw The raw image.
+ * @return The input or NULL if the stage is disabled or its input is not
+ *         available.
+ *//*********************************************************************/
+static const struct PipeImage* Pipe_Input(const struct Pipeline *pPipe,
+					  uint32 i,
+					  const struct PipeImage *pRaw)
+{
+	const struct PipeStage *pStage = &pPipe->stages[i];
+
+	if((pPipe->enabled & (1 << i)) == 0)
+	{
+		return NULL;
+	}
+	if(pStage->input == PIPE_INPUT_RAW)
+	{
+		return pRaw;
+	}
+	if(pPipe->stages[pStage->input].bDone)
+	{
+		return &pPipe->stages[pStage->input].out;
+	}
+	return NULL;
+}
+
+/*********************************************************************//*!
+ * @brief Preset the output of a stage for an input and make sure its
+ * buffer is large enough.
+ *
+ * @param pStage Pointer to the stage.
+ * @param pIn The input.
+ * @return SUCCESS or -EOUT_OF_MEMORY.
+ *//*********************************************************************/
+static OSC_ERR Pipe_Prepare(struct PipeStage *pStage, const struct PipeImage *pIn)
+{
+	uint8 *pBuf;
+	uint32 size;
+
+	if(pStage->outBpp == 0)
+	{
+		return SUCCESS;
+	}
+	pStage->out.width = pIn->width/pStage->rowDiv;
+	pStage->out.height = pIn->height/pStage->rowDiv;
+	pStage->out.pixFmt = pIn->pixFmt;
+
+	size = pStage->out.width*pStage->out.height*pStage->outBpp;
+	if(pStage->pfnStrip == NULL)
+	{
+		/* The output of a whole frame stage may be larger. */
+		size = pIn->width*pIn->height*pStage->outBpp;
+	}
+	if(size <= pStage->outSize)
+	{
+		return SUCCESS;
+	}
+	pBuf = malloc(size);
+	if(pBuf == NULL)
+	{
+		OscLog(ERROR, "%s: Unable to allocate the output of stage %s!\n",
+		       __func__, pStage->strName);
+		return -EOUT_OF_MEMORY;
+	}
+	free(pStage->out.pData);
+	pStage->out.pData = pBuf;
+	pStage->outSize = size;
+	return SUCCESS;
+}
+
+/*********************************************************************//*!
+ * @brief Add a run to the statistics of a stage.
+ *
+ * @param pStage Pointer to the stage.
+ * @param cyc Cycles of the run.
+ *//*********************************************************************/
+static void Pipe_Account(struct PipeStage *pStage, uint64 cyc)
+{
+	pStage->nRuns++;
+	pStage->sumCyc += cyc;
+	if(cyc > pStage->maxCyc)
+	{
+		pStage->maxCyc = cyc;
+	}
+}
+
+/*********************************************************************//*!
+ * @brief Run a range of strip stages, strip by strip if there are
+ * several.
+ *
+ * @param pPipe Pointer to the pipeline.
+ * @param pFrame The frame.
+ * @param pRaw The raw image.
+ * @param first Index of the first stage.
+ * @param end Index after the last stage.
+ *//*********************************************************************/
+static void Pipe_RunStrips(struct Pipeline *pPipe,
+			   const struct FrameDesc *pFrame,
+			   const struct PipeImage *pRaw,
+			   uint32 first,
+			   uint32 end)
+{
+	const struct PipeImage *pIns[PIPE_MAX_STAGES];
+	uint64 cyc[PIPE_MAX_STAGES];
+	uint32 rows[PIPE_MAX_STAGES];
+	struct PipeStage *pStage;
+	uint32 i, k, y0, y1, inBpp, nStrips;
+	uint32 maxRows = 1, bytes = 0;
+	uint64 start;
+
+	for(i = first; i < end; i++)
+	{
+		pStage = &pPipe->stages[i];
+		pIns[i] = Pipe_Input(pPipe, i, pRaw);
+		if(pIns[i] == NULL || Pipe_Prepare(pStage, pIns[i]) != SUCCESS)
+		{
+			pIns[i] = NULL;
+			continue;
+		}
+		/* The output is complete before any later stage uses it. */
+		pStage->bDone = TRUE;
+		rows[i] = pIns[i]->height/pStage->rowDiv;
+		cyc[i] = 0;
+		if(rows[i] > maxRows)
+		{
+			maxRows = rows[i];
+		}
+		inBpp = pStage->input == PIPE_INPUT_RAW ? 1 : pPipe->stages[pStage->input].outBpp;
+		bytes += pIns[i]->width*pIns[i]->height*inBpp +
+			pStage->out.width*pStage->out.height*pStage->outBpp;
+	}
+
+	nStrips = 1;
+	if(end - first > 1)
+	{
+		nStrips = (bytes + PIPE_STRIP_BYTES - 1)/PIPE_STRIP_BYTES;
+		if(nStrips > maxRows)
+		{
+			nStrips = maxRows;
+		}
+	}
+	pPipe->nStrips = nStrips;
+
+	/* Every stage gets the same fraction of its rows per strip. As a
+	 * stage has rowDiv input rows per output row, the rows a stage reads
+	 * have always been written by the stage before it. */
+	for(k = 0; k < nStrips; k++)
+	{
+		for(i = first; i < end; i++)
+		{
+			if(pIns[i] == NULL)
+			{
+				continue;
+			}
+			y0 = k*rows[i]/nStrips;
+			y1 = (k + 1)*rows[i]/nStrips;
+			if(y0 == y1 && k + 1 < nStrips)
+			{
+				continue;
+			}
+			pStage = &pPipe->stages[i];
+			start = OscSupCycGet64();
+			pStage->pfnStrip(pStage->pArg,
+					 pFrame,
+					 pIns[i],
+					 pStage->outBpp != 0 ? &pStage->out : NULL,
+					 y0,
+					 y1);
+			cyc[i] += OscSupCycGet64() - start;
+		}
+	}
+
+	for(i = first; i < end; i++)
+	{
+		if(pIns[i] != NULL)
+		{
+			Pipe_Account(&pPipe->stages[i], cyc[i]);
+		}
+	}
+}
+
+void Pipe_Run(struct Pipeline *pPipe, const struct FrameDesc *pFrame)
+{
+	struct PipeImage raw;
+	const struct PipeImage *pIn;
+	struct PipeStage *pStage;
+	uint64 start;
+	uint32 i, end;
+	OSC_ERR err;
+
+	raw.pData = pFrame->pImg;
+	raw.width = pFrame->feedHdr.imgWidth;
+	raw.height = pFrame->feedHdr.imgHeight;
+	raw.pixFmt = pFrame->feedHdr.pixFmt;
+
+	for(i = 0; i < pPipe->nStages; i++)
+	{
+		pPipe->stages[i].bDone = FALSE;
+	}
+
+	for(i = 0; i < pPipe->nStages; i = end)
+	{
+		pStage = &pPipe->stages[i];
+		end = i + 1;
+		if(pStage->pfnStrip != NULL)
+		{
+			if(pPipe->bStrips)
+			{
+				while(end < pPipe->nStages && pPipe->stages[end].pfnStrip != NULL)
+				{
+					end++;
+				}
+			}
+			Pipe_RunStrips(pPipe, pFrame, &raw, i, end);
+			continue;
+		}
+
+		pIn = Pipe_Input(pPipe, i, &raw);
+		if(pIn == NULL || Pipe_Prepare(pStage, pIn) != SUCCESS)
+		{
+			continue;
+		}
+		start = OscSupCycGet64();
+		err = pStage->pfnRun(pStage->pArg,
+				     pFrame,
+				     pIn,
+				     pStage->outBpp != 0 ? &pStage->out : NULL);
+		Pipe_Account(pStage, OscSupCycGet64() - start);
+
+		if(err == PIPE_END)
+		{
+			break;
+		}
+		if(err != SUCCESS)
+		{
+			OscLog(WARN, "%s: Stage %s failed (%d)!\n", __func__, pStage->strName, err);
+			continue;
+		}
+		pStage->bDone = TRUE;
+	}
+}
+
+uint32 Pipe_MeanUs(const struct PipeStage *pStage)
+{
+	if(pStage->nRuns == 0)
+	{
+		return 0;
+	}
+	return Timing_CycToUs(pStage->sumCyc/pStage->nRuns);
+}
+
+void Pipe_ResetStats(struct Pipeline *pPipe)
+{
+	uint32 i;
+
+	for(i = 0; i < pPipe->nStages; i++)
+	{
+		pPipe->stages[i].nRuns = 0;
+		pPipe->stages[i].sumCyc = 0;
+		pPipe->stages[i].maxCyc = 0;
+	}
+}
@@ -0,0 +1,257 @@
+/*	Target side application for the Rich Viewer.
+	Copyright (C) 2008 Supercomputing Systems AG
+
+	This library is free software; you can redistribute it and/or modify it
+	under the terms of the GNU Lesser General Public License as published by
+	the Free Software Foundation; either version 2.1 of the License, or (at
+	your option) any later version.
+
+	This library is distributed in the hope that it will be useful, but
+	WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser
+	General Public License for more details.
+
+	You should have received a copy of the GNU Lesser General Public License
+	along with this library; if not, write to the Free Software Foundation,
+	Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+
+/*! @file pipeline.h
+ * @brief Pipeline of the processing stages every captured frame passes.
+ *
+ * The stages are registered at startup and run in the order they have
+ * been registered. Each stage reads either the raw image of the frame or
+ * the output of an earlier stage, and may write an output image for the
+ * later stages into a buffer the pipeline allocates. Stages without an
+ * output are sinks, e.g. sending something over the feed. A stage may end
+ * the pipeline for a frame, e.g. if the scene has not changed.
+ *
+ * Every stage can be enabled and disabled on its own and has its own
+ * statistics of the cycles it takes.
+ *
+ * Pixel stages that compute every output row from a fixed band of input
+ * rows (e.g. a look-up table, a 2x2 decimation or debayering) can be
+ * registered as strip stages. Consecutive strip stages are fused: they
+ * are run strip by strip, every stage on the rows the stages before it
+ * have just written, so a strip stays in the cache through all stages
+ * instead of every stage walking the whole frame. With strip mining
+ * disabled, or for a single strip stage, every stage processes the whole
+ * frame in one go instead. Stages needing rows outside their band, e.g. an
+ * interpolating debayer, have to be whole frame stages.
+ */
+
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include "inc/oscar.h"
+#include "framering.h"
+
+/*! @brief Maximum number of stages. */
+#define PIPE_MAX_STAGES 8
+/*! @brief Input of a stage: the raw image of the frame. */
+#define PIPE_INPUT_RAW 0xffffffff
+/*! @brief Returned by a stage to skip the remaining stages for the
+  frame. */
+#define PIPE_END 1
+/*! @brief Bytes of image data the fused strip stages touch per strip
+  (half of the 32 kB L1 data cache of the target). */
+#define PIPE_STRIP_BYTES (16*1024)
+
+/*! @brief An image passed between the stages. */
+struct PipeImage
+{
+	/*! @brief The pixels, row after row. */
+	uint8 *pData;
+	/*! @brief Width of the image. */
+	uint32 width;
+	/*! @brief Height of the image. */
+	uint32 height;
+	/*! @brief Pixel format (V4L2_PIX_FMT_*). */
+	uint32 pixFmt;
+};
+
+/*********************************************************************//*!
+ * @brief Function of a stage.
+ *
+ * The output is preset to the geometry and pixel format of the input; a
+ * stage writing a smaller or different image updates it.
+ *
+ * @param pArg The argument the stage was registered with.
+ * @param pFrame The frame.
+ * @param pIn The input image.
+ * @param pOut The output image or NULL if the stage has none.
+ * @return SUCCESS, PIPE_END or an appropriate error code, in which case
+ *         the output of the stage is not used.
+ *//*********************************************************************/
+typedef OSC_ERR (*PipeStageFn)(void *pArg,
+			       const struct FrameDesc *pFrame,
+			       const struct PipeImage *pIn,
+			       struct PipeImage *pOut);
+
+/*********************************************************************//*!
+ * @brief Function of a strip stage.
+ *
+ * The function is called for consecutive strips of output rows in order,
+ * starting with row 0 and ending with the last row, so it can set up on
+ * the first strip and finish on the last one. Output row y is computed
+ * from input rows rowDiv*y .. rowDiv*(y+1)-1; the output of a sink has
+ * pIn->height/rowDiv rows as well. The output is preset to the input
+ * geometry divided by rowDiv and its pixel format; the pixel format may
+ * be changed on the first strip.
+ *
+ * @param pArg The argument the stage was registered with.
+ * @param pFrame The frame.
+ * @param pIn The input image.
+ * @param pOut The output image or NULL if the stage has none.
+ * @param yStart First output row of the strip.
+ * @param yEnd Output row after the last row of the strip.
+ *//*********************************************************************/
+typedef void (*PipeStripFn)(void *pArg,
+			    const struct FrameDesc *pFrame,
+			    const struct PipeImage *pIn,
+			    struct PipeImage *pOut,
+			    uint32 yStart,
+			    uint32 yEnd);
+
+/*! @brief A stage of the pipeline. */
+struct PipeStage
+{
+	/*! @brief Name of the stage, for the log. */
+	const char *strName;
+	/*! @brief Function of a whole frame stage or NULL. */
+	PipeStageFn pfnRun;
+	/*! @brief Function of a strip stage or NULL. */
+	PipeStripFn pfnStrip;
+	/*! @brief Input rows (and columns) per output row of a strip
+	  stage. */
+	uint32 rowDiv;
+	/*! @brief Argument passed to the function. */
+	void *pArg;
+	/*! @brief Index of the stage whose output is the input, or
+	  PIPE_INPUT_RAW. */
+	uint32 input;
+	/*! @brief Bytes per input pixel the output needs at most, 0 if the
+	  stage has no output. */
+	uint32 outBpp;
+	/*! @brief The output of the current frame. */
+	struct PipeImage out;
+	/*! @brief Size of the output buffer (bytes). */
+	uint32 outSize;
+	/*! @brief TRUE if the output of the current frame is valid. */
+	bool bDone;
+
+	/*! @brief Number of runs since the statistics were reset. */
+	uint32 nRuns;
+	/*! @brief Sum of the cycles of the runs. */
+	uint64 sumCyc;
+	/*! @brief Most cycles of a run. */
+	uint64 maxCyc;
+};
+
+/*! @brief The pipeline. */
+struct Pipeline
+{
+	/*! @brief The stages, in the order they are run. */
+	struct PipeStage stages[PIPE_MAX_STAGES];
+	/*! @brief Number of stages. */
+	uint32 nStages;
+	/*! @brief Bit i is set if stage i is enabled. */
+	uint32 enabled;
+	/*! @brief TRUE to fuse consecutive strip stages, FALSE to run every
+	  stage on the whole frame. */
+	bool bStrips;
+	/*! @brief Number of strips of the last fused run. */
+	uint32 nStrips;
+};
+
+/*********************************************************************//*!
+ * @brief Initialize a pipeline without stages.
+ *
+ * Strip mining is enabled.
+ *
+ * @param pPipe Pointer to the pipeline.
+ *//*********************************************************************/
+void Pipe_Init(struct Pipeline *pPipe);
+
+/*********************************************************************//*!
+ * @brief Free the output buffers of the stages.
+ *
+ * @param pPipe Pointer to the pipeline.
+ *//*********************************************************************/
+void Pipe_DeInit(struct Pipeline *pPipe);
+
+/*********************************************************************//*!
+ * @brief Append a stage.
+ *
+ * The stage is enabled.
+ *
+ * @param pPipe Pointer to the pipeline.
+ * @param strName Name of the stage.
+ * @param pfnRun Function of the stage.
+ * @param pArg Argument passed to the function.
+ * @param input Index of the stage whose output is the input, or
+ *              PIPE_INPUT_RAW.
+ * @param outBpp Bytes per input pixel the output needs at most, 0 for no
+ *               output.
+ * @return SUCCESS, -EOUT_OF_MEMORY if there are too many stages or
+ *         -EINVALID_PARAMETER if the input has no output.
+ *//*********************************************************************/
+OSC_ERR Pipe_AddStage(struct Pipeline *pPipe,
+		      const char *strName,
+		      PipeStageFn pfnRun,
+		      void *pArg,
+		      uint32 input,
+		      uint32 outBpp);
+
+/*********************************************************************//*!
+ * @brief Append a strip stage.
+ *
+ * The stage is enabled.
+ *
+ * @param pPipe Pointer to the pipeline.
+ * @param strName Name of the stage.
+ * @param pfnStrip Function of the stage.
+ * @param pArg Argument passed to the function.
+ * @param input Index of the stage whose output is the input, or
+ *              PIPE_INPUT_RAW.
+ * @param outBpp Bytes per output pixel, 0 for no output.
+ * @param rowDiv Input rows and columns per output row and column (1 or
+ *               more).
+ * @return SUCCESS, -EOUT_OF_MEMORY if there are too many stages or
+ *         -EINVALID_PARAMETER.
+ *//*********************************************************************/
+OSC_ERR Pipe_AddStripStage(struct Pipeline *pPipe,
+			   const char *strName,
+			   PipeStripFn pfnStrip,
+			   void *pArg,
+			   uint32 input,
+			   uint32 outBpp,
+			   uint32 rowDiv);
+
+/*********************************************************************//*!
+ * @brief Run the enabled stages on a frame.
+ *
+ * A stage whose input stage is disabled or failed is skipped.
+ *
+ * @param pPipe Pointer to the pipeline.
+ * @param pFrame The frame.
+ *//*********************************************************************/
+void Pipe_Run(struct Pipeline *pPipe, const struct FrameDesc *pFrame);
+
+/*********************************************************************//*!
+ * @brief Get the mean time of the runs of a stage.
+ *
+ * @param pStage Pointer to the stage.
+ * @return The mean time (us) or 0 if the stage has not run.
+ *//*********************************************************************/
+uint32 Pipe_MeanUs(const struct PipeStage *pStage);
+
+/*********************************************************************//*!
+ * @brief Reset the statistics of all stages.
+ *
+ * @param pPipe Pointer to the pipeline.
+ *//*********************************************************************/
+void Pipe_ResetStats(struct Pipeline *pPipe);
+
+#endif /* PIPELINE_H */
@@ -0,0 +1,132 @@
+/*	Target side application for the Rich Viewer.
+	Copyright (C) 2008 Supercomputing Systems AG
+
+	This library is free software; you can redistribute it and/or modify it
+	under the terms of the GNU Lesser General Public License as published by
+	the Free Software Foundation; either version 2.1 of the License, or (at
+	your option) any later version.
+
+	This library is distributed in the hope that it will be useful, but
+	WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser
+	General Public License for more details.
+
+	You should have received a copy of the GNU Lesser General Public License
+	along with this library; if not, write to the Free Software Foundation,
+	Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+
+/*! @file pixops.c
+ * @brief Pixel operations implementation.
+ */
+
+#include "pixops.h"
+#include "rendition.h"
+#include "communication.h"
+
+void Pix_LutStrip(void *pArg,
+		  const struct FrameDesc *pFrame,
+		  const struct PipeImage *pIn,
+		  struct PipeImage *pOut,
+		  uint32 yStart,
+		  uint32 yEnd)
+{
+	const uint8 *lut = ((const struct PixLut*)pArg)->lut;
+	const uint8 *pSrc = pIn->pData + yStart*pIn->width;
+	uint8 *pDst = pOut->pData + yStart*pOut->width;
+	uint32 i, n = (yEnd - yStart)*pIn->width;
+
+	for(i = 0; i + 4 <= n; i += 4)
+	{
+		pDst[i] = lut[pSrc[i]];
+		pDst[i + 1] = lut[pSrc[i + 1]];
+		pDst[i + 2] = lut[pSrc[i + 2]];
+		pDst[i + 3] = lut[pSrc[i + 3]];
+	}
+	for(; i < n; i++)
+	{
+		pDst[i] = lut[pSrc[i]];
+	}
+}
+
+void Pix_DecimateStrip(void *pArg,
+		       const struct FrameDesc *pFrame,
+		       const struct PipeImage *pIn,
+		       struct PipeImage *pOut,
+		       uint32 yStart,
+		       uint32 yEnd)
+{
+	uint32 y;
+
+	if(yStart == 0)
+	{
+		pOut->pixFmt = V4L2_PIX_FMT_GREY;
+	}
+	for(y = yStart; y < yEnd; y++)
+	{
+		Rend_HalveRows(pIn->pData + 2*y*pIn->width,
+			       pIn->pData + (2*y + 1)*pIn->width,
+			       pOut->pData + y*pOut->width,
+			       pIn->width);
+	}
+}
+
+void Pix_DebayerStrip(void *pArg,
+		      const struct FrameDesc *pFrame,
+		      const struct PipeImage *pIn,
+		      struct PipeImage *pOut,
+		      uint32 yStart,
+		      uint32 yEnd)
+{
+	const uint8 *pRow0, *pRow1;
+	uint8 *pDst;
+	uint32 x, y;
+
+	if(yStart == 0)
+	{
+		pOut->pixFmt = V4L2_PIX_FMT_RGB24;
+	}
+	for(y = yStart; y < yEnd; y++)
+	{
+		/* B G / G R */
+		pRow0 = pIn->pData + 2*y*pIn->width;
+		pRow1 = pRow0 + pIn->width;
+		pDst = pOut->pData + 3*y*pOut->width;
+		for(x = 0; x < pOut->width; x++)
+		{
+			pDst[0] = pRow1[1];
+			pDst[1] = (uint8)((pRow0[1] + pRow1[0] + 1) >> 1);
+			pDst[2] = pRow0[0];
+			pDst += 3;
+			pRow0 += 2;
+			pRow1 += 2;
+		}
+	}
+}
+
+void Pix_StatsStrip(void *pArg,
+		    const struct FrameDesc *pFrame,
+		    const struct PipeImage *pIn,
+		    struct PipeImage *pOut,
+		    uint32 yStart,
+		    uint32 yEnd)
+{
+	struct PixStats *pStats = (struct PixStats*)pArg;
+
+	if(yStart == 0)
+	{
+		Stat_Clear(&pStats->accu);
+	}
+	Stat_AccumulateRows(&pStats->accu,
+			    pIn->pData,
+			    pIn->width,
+			    pIn->height,
+			    yStart,
+			    yEnd,
+			    pStats->rois);
+	if(yEnd == pIn->height)
+	{
+		Stat_Finish(&pStats->stats, &pStats->accu, pIn->width, pIn->height, pStats->rois);
+	}
+}
@@ -0,0 +1,131 @@
+/*	Target side application for the Rich Viewer.
+	Copyright (C) 2008 Supercomputing Systems AG
+
+	This library is free software; you can redistribute it and/or modify it
+	under the terms of the GNU Lesser General Public License as published by
+	the Free Software Foundation; either version 2.1 of the License, or (at
+	your option) any later version.
+
+	This library is distributed in the hope that it will be useful, but
+	WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser
+	General Public License for more details.
+
+	You should have received a copy of the GNU Lesser General Public License
+	along with this library; if not, write to the Free Software Foundation,
+	Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+
+/*! @file pixops.h
+ * @brief Pixel operations as strip stages of the processing pipeline.
+ *
+ * Every operation computes an output row from a fixed band of input rows,
+ * so it can be fused with the other strip stages (see pipeline.h).
+ */
+
+#ifndef PIXOPS_H
+#define PIXOPS_H
+
+#include "inc/oscar.h"
+#include "pipeline.h"
+#include "statistics.h"
+
+/*! @brief Argument of the look-up table stage. */
+struct PixLut
+{
+	/*! @brief Output value of every input value. */
+	uint8 lut[256];
+};
+
+/*! @brief Argument of the statistics stage. */
+struct PixStats
+{
+	/*! @brief The regions of interest. */
+	struct StatRoi rois[STAT_MAX_ROIS];
+	/*! @brief Intermediate sums. */
+	struct StatAccu accu;
+	/*! @brief The statistics of the last frame. */
+	struct FeedStats stats;
+};
+
+/*********************************************************************//*!
+ * @brief Strip stage: Map every pixel through a look-up table.
+ *
+ * Register with an output of 1 byte per pixel and rowDiv 1.
+ *
+ * @param pArg Pointer to the PixLut.
+ * @param pFrame Unused.
+ * @param pIn The input image (8 bit per pixel).
+ * @param pOut The output image.
+ * @param yStart First row of the strip.
+ * @param yEnd Row after the last row of the strip.
+ *//*********************************************************************/
+void Pix_LutStrip(void *pArg,
+		  const struct FrameDesc *pFrame,
+		  const struct PipeImage *pIn,
+		  struct PipeImage *pOut,
+		  uint32 yStart,
+		  uint32 yEnd);
+
+/*********************************************************************//*!
+ * @brief Strip stage: Halve the image in both dimensions (2x2 box
+ * filter), resulting in a greyscale image.
+ *
+ * Register with an output of 1 byte per pixel and rowDiv 2.
+ *
+ * @param pArg Unused.
+ * @param pFrame Unused.
+ * @param pIn The input image (8 bit per pixel).
+ * @param pOut The output image.
+ * @param yStart First output row of the strip.
+ * @param yEnd Output row after the last row of the strip.
+ *//*********************************************************************/
+void Pix_DecimateStrip(void *pArg,
+		       const struct FrameDesc *pFrame,
+		       const struct PipeImage *pIn,
+		       struct PipeImage *pOut,
+		       uint32 yStart,
+		       uint32 yEnd);
+
+/*********************************************************************//*!
+ * @brief Strip stage: Debayer a BGGR bayer image into an RGB image of
+ * half the width and height, one pixel per 2x2 cell.
+ *
+ * Register with an output of 3 bytes per pixel and rowDiv 2.
+ *
+ * @param pArg Unused.
+ * @param pFrame Unused.
+ * @param pIn The input image (V4L2_PIX_FMT_SBGGR8).
+ * @param pOut The output image (V4L2_PIX_FMT_RGB24).
+ * @param yStart First output row of the strip.
+ * @param yEnd Output row after the last row of the strip.
+ *//*********************************************************************/
+void Pix_DebayerStrip(void *pArg,
+		      const struct FrameDesc *pFrame,
+		      const struct PipeImage *pIn,
+		      struct PipeImage *pOut,
+		      uint32 yStart,
+		      uint32 yEnd);
+
+/*********************************************************************//*!
+ * @brief Strip stage: Compute the statistics of the image.
+ *
+ * Register without an output and with rowDiv 1. The statistics are
+ * complete after the last strip.
+ *
+ * @param pArg Pointer to the PixStats.
+ * @param pFrame Unused.
+ * @param pIn The input image (8 bit per pixel).
+ * @param pOut Unused.
+ * @param yStart First row of the strip.
+ * @param yEnd Row after the last row of the strip.
+ *//*********************************************************************/
+void Pix_StatsStrip(void *pArg,
+		    const struct FrameDesc *pFrame,
+		    const struct PipeImage *pIn,
+		    struct PipeImage *pOut,
+		    uint32 yStart,
+		    uint32 yEnd);
+
+#endif /* PIXOPS_H */
@@ -0,0 +1,162 @@
+/*	Target side application for the Rich Viewer.
+	Copyright (C) 2008 Supercomputing Systems AG
+
+	This library is free software; you can redistribute it and/or modify it
+	under the terms of the GNU Lesser General Public License as published by
+	the Free Software Foundation; either version 2.1 of the License, or (at
+	your option) any later version.
+
+	This library is distributed in the hope that it will be useful, but
+	WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser
+	General Public License for more details.
+
+	You should have received a copy of the GNU Lesser General Public License
+	along with this library; if not, write to the Free Software Foundation,
+	Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+
+/*! @file qos.c
+ * @brief Quality of service controller implementation.
+ */
+
+#include "qos.h"
+#include "rendition.h"
+#include "timing.h"
+#include <string.h>
+
+/*! @brief What is sent in a mode. */
+struct QosLevel
+{
+	/*! @brief The rendition sent (REND_*). */
+	uint32 rendition;
+	/*! @brief Every divisor-th frame is sent. */
+	uint32 divisor;
+	/*! @brief Bandwidth relative to QOS_FULL (1/1024). */
+	uint32 cost;
+};
+
+/*! @brief The modes, indexed by EnQosMode. */
+static const struct QosLevel qosLevels[QOS_MODE_COUNT] = {
+	{REND_FULL, 1, 1024},		/* QOS_OFF, unused */
+	{REND_FULL, 1, 1024},
+	{REND_QUARTER, 1, 256},
+	{REND_SIXTEENTH, 1, 64},
+	{REND_SIXTEENTH, 2, 32},
+	{REND_SIXTEENTH, 4, 16}
+};
+
+/*********************************************************************//*!
+ * @brief Switch to another mode.
+ *
+ * @param pQos Pointer to the controller.
+ * @param mode The new mode.
+ *//*********************************************************************/
+static void Qos_Change(struct QosCtrl *pQos, uint32 mode)
+{
+	pQos->bSteppedUp = mode < pQos->mode;
+	pQos->mode = mode;
+	pQos->nOver = 0;
+	pQos->nUnder = 0;
+	pQos->nSinceChange = 0;
+}
+
+/*********************************************************************//*!
+ * @brief Adapt the mode to the load of a frame.
+ *
+ * @param pQos Pointer to the controller.
+ * @param load The load (per mille).
+ *//*********************************************************************/
+static void Qos_Update(struct QosCtrl *pQos, uint32 load)
+{
+	uint32 mode = pQos->mode;
+
+	pQos->load = load;
+	pQos->nSinceChange++;
+	if(load > QOS_HIGH)
+	{
+		pQos->nUnder = 0;
+		if(++pQos->nOver >= QOS_DOWN_FRAMES && mode < QOS_MODE_COUNT - 1)
+		{
+			if(pQos->bSteppedUp && pQos->nSinceChange < pQos->upFrames)
+			{
+				/* The step up did not work out; wait longer for the
+				 * next one. */
+				pQos->upFrames *= 2;
+				if(pQos->upFrames > QOS_UP_FRAMES_MAX)
+				{
+					pQos->upFrames = QOS_UP_FRAMES_MAX;
+				}
+			}
+			Qos_Change(pQos, mode + 1);
+		}
+		return;
+	}
+
+	pQos->nOver = 0;
+	if(pQos->bSteppedUp && pQos->nSinceChange >= pQos->upFrames)
+	{
+		/* The step up has held. */
+		pQos->bSteppedUp = FALSE;
+		pQos->upFrames = QOS_UP_FRAMES;
+	}
+	if(mode > QOS_FULL &&
+	   load*qosLevels[mode - 1].cost/qosLevels[mode].cost < QOS_LOW)
+	{
+		if(++pQos->nUnder >= pQos->upFrames)
+		{
+			Qos_Change(pQos, mode - 1);
+		}
+	} else {
+		pQos->nUnder = 0;
+	}
+}
+
+void Qos_Init(struct QosCtrl *pQos)
+{
+	memset(pQos, 0, sizeof(struct QosCtrl));
+	pQos->upFrames = QOS_UP_FRAMES;
+}
+
+void Qos_Enable(struct QosCtrl *pQos, bool bEnable)
+{
+	uint32 periodUs = pQos->periodUs;
+
+	Qos_Init(pQos);
+	pQos->periodUs = periodUs;
+	if(bEnable)
+	{
+		pQos->mode = QOS_FULL;
+	}
+}
+
+bool Qos_Select(const struct QosCtrl *pQos, uint32 seqNr, uint32 *pRendition)
+{
+	*pRendition = qosLevels[pQos->mode].rendition;
+	return seqNr % qosLevels[pQos->mode].divisor == 0;
+}
+
+void Qos_FrameSent(struct QosCtrl *pQos, uint64 now)
+{
+	if(Qos_Measuring(pQos))
+	{
+		Qos_FrameDelivered(pQos, now);
+	}
+	pQos->sentCyc = now;
+}
+
+void Qos_FrameDelivered(struct QosCtrl *pQos, uint64 now)
+{
+	uint64 load;
+
+	if(pQos->mode != QOS_OFF && pQos->periodUs != 0)
+	{
+		/* The frames sent are divisor periods apart. */
+		load = ((uint64)Timing_CycToUs(now - pQos->sentCyc)*1000)/
+			(pQos->periodUs*qosLevels[pQos->mode].divisor);
+		/* Far beyond overload, which is all that matters. */
+		Qos_Update(pQos, load > 100000 ? 100000 : (uint32)load);
+	}
+	pQos->sentCyc = 0;
+}
@@ -0,0 +1,153 @@
+/*	Target side application for the Rich Viewer.
+	Copyright (C) 2008 Supercomputing Systems AG
+
+	This library is free software; you can redistribute it and/or modify it
+	under the terms of the GNU Lesser General Public License as published by
+	the Free Software Foundation; either version 2.1 of the License, or (at
+	your option) any later version.
+
+	This library is distributed in the hope that it will be useful, but
+	WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser
+	General Public License for more details.
+
+	You should have received a copy of the GNU Lesser General Public License
+	along with this library; if not, write to the Free Software Foundation,
+	Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+
+/*! @file qos.h
+ * @brief Closed-loop quality of service control of the image feed.
+ *
+ * Instead of the renditions subscribed by the host, one rendition per
+ * frame is sent, chosen from a ladder of modes of decreasing bandwidth.
+ * The controller measures for every frame how long the feed takes to
+ * deliver it (until the send queue of the socket has drained) relative to
+ * the frame period, the load. The frame period is the configured one (the
+ * rate of the internal trigger or of the synthetic source); without one,
+ * no load is measured and the mode is kept. The controller steps one mode
+ * down when the load stays above QOS_HIGH and one mode up when the load
+ * predicted for the better mode stays below QOS_LOW. Stepping down
+ * reacts within a few frames, stepping up waits much longer, and longer
+ * again after each step up that had to be undone, so the mode does not
+ * oscillate.
+ */
+
+#ifndef QOS_H
+#define QOS_H
+
+#include "inc/oscar.h"
+
+/*! @brief Load above which the mode is stepped down (per mille of the
+  frame period). */
+#define QOS_HIGH		900
+/*! @brief Predicted load below which the mode is stepped up (per
+  mille). */
+#define QOS_LOW			700
+/*! @brief Number of frames the load has to stay above QOS_HIGH. */
+#define QOS_DOWN_FRAMES		3
+/*! @brief Number of frames the predicted load has to stay below QOS_LOW
+  at least. */
+#define QOS_UP_FRAMES		30
+/*! @brief Number of frames the predicted load has to stay below QOS_LOW
+  at most (after failed steps up). */
+#define QOS_UP_FRAMES_MAX	960
+
+/*! @brief Modes of the feed, from the best to the least bandwidth. */
+enum EnQosMode
+{
+	/*! @brief The controller is disabled. */
+	QOS_OFF,
+	/*! @brief The full resolution image of every frame. */
+	QOS_FULL,
+	/*! @brief The 1/4 size rendition of every frame. */
+	QOS_QUARTER,
+	/*! @brief The 1/16 size rendition of every frame. */
+	QOS_SIXTEENTH,
+	/*! @brief The 1/16 size rendition of every second frame. */
+	QOS_SIXTEENTH_HALF_RATE,
+	/*! @brief The 1/16 size rendition of every fourth frame. */
+	QOS_SIXTEENTH_QUARTER_RATE,
+	/*! @brief Number of modes. */
+	QOS_MODE_COUNT
+};
+
+/*! @brief State of the quality of service controller. */
+struct QosCtrl
+{
+	/*! @brief Current mode (EnQosMode). */
+	uint32 mode;
+	/*! @brief Configured frame period the load is relative to (us), 0
+	  if there is none. */
+	uint32 periodUs;
+	/*! @brief Load of the frame measured last (per mille). */
+	uint32 load;
+	/*! @brief Cycle count at which the frame being measured was sent, 0
+	  if none is. */
+	uint64 sentCyc;
+	/*! @brief Number of consecutive frames above QOS_HIGH. */
+	uint32 nOver;
+	/*! @brief Number of consecutive frames the better mode would have
+	  fit in. */
+	uint32 nUnder;
+	/*! @brief Number of frames nUnder has to reach for a step up. */
+	uint32 upFrames;
+	/*! @brief Number of frames measured since the last change of the
+	  mode. */
+	uint32 nSinceChange;
+	/*! @brief TRUE if the last change of the mode was a step up. */
+	bool bSteppedUp;
+};
+
+/*********************************************************************//*!
+ * @brief Initialize a disabled controller.
+ *
+ * @param pQos Pointer to the controller.
+ *//*********************************************************************/
+void Qos_Init(struct QosCtrl *pQos);
+
+/*********************************************************************//*!
+ * @brief Enable or disable the controller.
+ *
+ * Enabled, the controller starts with the best mode.
+ *
+ * @param pQos Pointer to the controller.
+ * @param bEnable TRUE to enable.
+ *//*********************************************************************/
+void Qos_Enable(struct QosCtrl *pQos, bool bEnable);
+
+/*********************************************************************//*!
+ * @brief Get the rendition to be sent for a frame in the current mode.
+ *
+ * @param pQos Pointer to the controller (enabled).
+ * @param seqNr Sequence number of the frame.
+ * @param pRendition The rendition (REND_*).
+ * @return TRUE if the frame is sent, FALSE if it is skipped.
+ *//*********************************************************************/
+bool Qos_Select(const struct QosCtrl *pQos, uint32 seqNr, uint32 *pRendition);
+
+/*********************************************************************//*!
+ * @brief Start measuring a frame that has been queued for the feed.
+ *
+ * If the frame measured before has not been delivered yet, its load is
+ * taken as it is now.
+ *
+ * @param pQos Pointer to the controller.
+ * @param now Current cycle count.
+ *//*********************************************************************/
+void Qos_FrameSent(struct QosCtrl *pQos, uint64 now);
+
+/*********************************************************************//*!
+ * @brief Complete the measurement of a frame when the feed has delivered
+ * it and adapt the mode.
+ *
+ * @param pQos Pointer to the controller.
+ * @param now Current cycle count.
+ *//*********************************************************************/
+void Qos_FrameDelivered(struct QosCtrl *pQos, uint64 now);
+
+/*! @brief Check whether a frame is being measured. */
+#define Qos_Measuring(pQos) ((pQos)->sentCyc != 0)
+
+#endif /* QOS_H */
@@ -0,0 +1,226 @@
+/*	Target side application for the Rich Viewer.
+	Copyright (C) 2008 Supercomputing Systems AG
+
+	This library is free software; you can redistribute it and/or modify it
+	under the terms of the GNU Lesser General Public License as published by
+	the Free Software Foundation; either version 2.1 of the License, or (at
+	your option) any later version.
+
+	This library is distributed in the hope that it will be useful, but
+	WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser
+	General Public License for more details.
+
+	You should have received a copy of the GNU Lesser General Public License
+	along with this library; if not, write to the Free Software Foundation,
+	Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+/*! @file rendition.c
+ * @brief Reduced resolution renditions implementation.
+ */
+
+#include "rendition.h"
+#include <string.h>
+
+/*! @brief Number of rows of the 1/4 rendition per tile when the renditions
+ * are produced by the worker pool. Has to be even, so every row pair of
+ * the 1/16 rendition lies within one tile. */
+#define REND_TILE_ROWS 16
+
+/*! @brief Arguments of the tiles of Rend_Produce. */
+struct RendJob
+{
+	/*! @brief The rendition set. */
+	struct RendSet *pSet;
+	/*! @brief The raw image. */
+	const uint8 *pRaw;
+	/*! @brief Width of the raw image. */
+	uint32 width;
+	/*! @brief Renditions to produce. */
+	uint32 mask;
+};
+
+void Rend_HalveRows(const uint8 *pRow0,
+		    const uint8 *pRow1,
+		    uint8 *pDst,
+		    uint32 srcWidth)
+{
+	const uint32 *pWord0, *pWord1;
+	uint32 w0, w1, lanes, nWords;
+	uint32 x = 0;
+
+	if((((unsigned long)pRow0 | (unsigned long)pRow1) & 3) == 0)
+	{
+		pWord0 = (const uint32*)pRow0;
+		pWord1 = (const uint32*)pRow1;
+		nWords = srcWidth >> 2;
+		while(nWords-- > 0)
+		{
+			w0 = *pWord0++;
+			w1 = *pWord1++;
+			/* Lane 0: p0 + p1, lane 1: p2 + p3 of both rows. */
+			lanes = (w0 & 0x00ff00ff) + ((w0 >> 8) & 0x00ff00ff) +
+				(w1 & 0x00ff00ff) + ((w1 >> 8) & 0x00ff00ff) +
+				0x00020002;
+			lanes >>= 2;
+			*pDst++ = (uint8)lanes;
+			*pDst++ = (uint8)(lanes >> 16);
+		}
+		x = srcWidth & ~3;
+	}
+
+	for(; x + 1 < srcWidth; x += 2)
+	{
+		*pDst++ = (uint8)((pRow0[x] + pRow0[x + 1] +
+				   pRow1[x] + pRow1[x + 1] + 2) >> 2);
+	}
+}
+
+/*********************************************************************//*!
+ * @brief Produce the reduced renditions for a range of 1/4 rendition rows.
+ *
+ * @param pArg Pointer to the RendJob.
+ * @param worker Index of the worker (unused).
+ * @param yStart First row of the 1/4 rendition (even).
+ * @param yEnd Row after the last row of the 1/4 rendition.
+ *//*********************************************************************/
+static void Rend_Tile(void *pArg, uint32 worker, uint32 yStart, uint32 yEnd)
+{
+	struct RendJob *pJob = (struct RendJob*)pArg;
+	struct RendSet *pSet = pJob->pSet;
+	uint32 quarterWidth = pSet->rend[REND_QUARTER].width;
+	uint32 width = pJob->width;
+	uint8 *pRow;
+	uint32 y;
+
+	/* The 1/16 rendition is built from the 1/4 rendition, every time a
+	 * pair of its rows has been written and is still in the cache. */
+	for(y = yStart; y < yEnd; y++)
+	{
+		pRow = pSet->quarterImg + y*quarterWidth;
+		Rend_HalveRows(pJob->pRaw + 2*y*width,
+			       pJob->pRaw + (2*y + 1)*width,
+			       pRow,
+			       width);
+
+		if((pJob->mask & (1 << REND_SIXTEENTH)) && (y & 1))
+		{
+			Rend_HalveRows(pRow - quarterWidth,
+				       pRow,
+				       pSet->sixteenthImg + (y/2)*pSet->rend[REND_SIXTEENTH].width,
+				       quarterWidth);
+		}
+	}
+}
+
+void Rend_Init(struct RendSet *pSet)
+{
+	uint32 i;
+
+	memset(pSet->rend, 0, sizeof(pSet->rend));
+	for(i = 0; i < REND_COUNT; i++)
+	{
+		pSet->rend[i].scale = 1 << i;
+		pSet->rend[i].divisor = 1;
+	}
+	pSet->rend[REND_QUARTER].pImg = pSet->quarterImg;
+	pSet->rend[REND_SIXTEENTH].pImg = pSet->sixteenthImg;
+	pSet->subscribed = 1 << REND_FULL;
+}
+
+uint32 Rend_Due(const struct RendSet *pSet, uint32 seqNr)
+{
+	uint32 i, mask = 0;
+
+	for(i = 0; i < REND_COUNT; i++)
+	{
+		if((pSet->subscribed & (1 << i)) &&
+		   seqNr % pSet->rend[i].divisor == 0)
+		{
+			mask |= 1 << i;
+		}
+	}
+	return mask;
+}
+
+void Rend_Produce(struct RendSet *pSet,
+		  const uint8 *pRaw,
+		  uint32 width,
+		  uint32 height,
+		  uint32 mask)
+{
+	struct Rendition *pQuarter = &pSet->rend[REND_QUARTER];
+	struct Rendition *pSixteenth = &pSet->rend[REND_SIXTEENTH];
+	struct RendJob job;
+	struct TileJob tiles;
+
+	pSet->rend[REND_FULL].width = width;
+	pSet->rend[REND_FULL].height = height;
+	pSet->rend[REND_FULL].pImg = pRaw;
+	pQuarter->width = width/2;
+	pQuarter->height = height/2;
+	pSixteenth->width = pQuarter->width/2;
+	pSixteenth->height = pQuarter->height/2;
+
+	if((mask & (1 << REND_QUARTER | 1 << REND_SIXTEENTH)) == 0)
+	{
+		return;
+	}
+
+	job.pSet = pSet;
+	job.pRaw = pRaw;
+	job.width = width;
+	job.mask = mask;
+	tiles.pfTile = Rend_Tile;
+	tiles.pArg = &job;
+	tiles.nRows = pQuarter->height;
+	tiles.tileRows = REND_TILE_ROWS;
+	Pool_Run(&tiles);
+}
+
+void Rend_Extract(const uint8 *pRaw,
+		  uint32 stride,
+		  uint32 x,
+		  uint32 y,
+		  uint32 width,
+		  uint32 height,
+		  uint32 scale,
+		  uint8 *pDst)
+{
+	uint32 dstWidth = width/scale, dstHeight = height/scale;
+	uint32 area = scale*scale;
+	uint32 dx, dy, i, j, sum;
+	const uint8 *pBlock;
+
+	pRaw += y*stride + x;
+	if(scale == 1)
+	{
+		for(dy = 0; dy < dstHeight; dy++)
+		{
+			memcpy(pDst, pRaw, dstWidth);
+			pDst += dstWidth;
+			pRaw += stride;
+		}
+		return;
+	}
+
+	for(dy = 0; dy < dstHeight; dy++)
+	{
+		for(dx = 0; dx < dstWidth; dx++)
+		{
+			pBlock = pRaw + dx*scale;
+			sum = 0;
+			for(j = 0; j < scale; j++)
+			{
+				for(i = 0; i < scale; i++)
+				{
+					sum += pBlock[i];
+				}
+				pBlock += stride;
+			}
+			*pDst++ = (uint8)((sum + area/2)/area);
+		}
+		pRaw += scale*stride;
+	}
+}
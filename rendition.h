@@ -0,0 +1,149 @@
+/*	Target side application for the Rich Viewer.
+	Copyright (C) 2008 Supercomputing Systems AG
+
+	This library is free software; you can redistribute it and/or modify it
+	under the terms of the GNU Lesser General Public License as published by
+	the Free Software Foundation; either version 2.1 of the License, or (at
+	your option) any later version.
+
+	This library is distributed in the hope that it will be useful, but
+	WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser
+	General Public License for more details.
+
+	You should have received a copy of the GNU Lesser General Public License
+	along with this library; if not, write to the Free Software Foundation,
+	Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+/*! @file rendition.h
+ * @brief Reduced resolution renditions of the captured frames.
+ *
+ * Besides the full resolution image, a 1/4 and a 1/16 size version of
+ * each frame can be sent over the feed. Both are produced in a single pass
+ * over the raw image, split into strips that are processed by the worker
+ * pool. Every rendition has its own frame rate divisor.
+ */
+
+#ifndef RENDITION_H
+#define RENDITION_H
+
+#include "inc/oscar.h"
+#include "workpool.h"
+
+/*! @brief Index of the full resolution rendition (the raw image). */
+#define REND_FULL	0
+/*! @brief Index of the rendition with half the width and height. */
+#define REND_QUARTER	1
+/*! @brief Index of the rendition with a quarter of the width and height. */
+#define REND_SIXTEENTH	2
+/*! @brief Number of renditions. */
+#define REND_COUNT	3
+
+/*! @brief One rendition of the current frame. */
+struct Rendition
+{
+	/*! @brief Down scaling factor of the width and height. */
+	uint32 scale;
+	/*! @brief The rendition is produced for every divisor-th frame. */
+	uint32 divisor;
+	/*! @brief Width of the rendition. */
+	uint32 width;
+	/*! @brief Height of the rendition. */
+	uint32 height;
+	/*! @brief The image data. Points to the raw image for REND_FULL. */
+	const uint8 *pImg;
+};
+
+/*! @brief All renditions and the buffers of the reduced ones. */
+struct RendSet
+{
+	/*! @brief The renditions, indexed by REND_*. */
+	struct Rendition rend[REND_COUNT];
+	/*! @brief Bit i is set if rendition i is sent over the feed. */
+	uint32 subscribed;
+	/*! @brief Buffer of the REND_QUARTER rendition. */
+	uint8 quarterImg[(OSC_CAM_MAX_IMAGE_WIDTH/2)*(OSC_CAM_MAX_IMAGE_HEIGHT/2)];
+	/*! @brief Buffer of the REND_SIXTEENTH rendition. */
+	uint8 sixteenthImg[(OSC_CAM_MAX_IMAGE_WIDTH/4)*(OSC_CAM_MAX_IMAGE_HEIGHT/4)];
+};
+
+/*********************************************************************//*!
+ * @brief Initialize the renditions.
+ *
+ * Only REND_FULL is subscribed and all divisors are set to 1.
+ *
+ * @param pSet Pointer to the rendition set.
+ *//*********************************************************************/
+void Rend_Init(struct RendSet *pSet);
+
+/*********************************************************************//*!
+ * @brief Get the renditions to be sent for a frame.
+ *
+ * @param pSet Pointer to the rendition set.
+ * @param seqNr Sequence number of the frame.
+ * @return Bit i is set if rendition i is subscribed and due.
+ *//*********************************************************************/
+uint32 Rend_Due(const struct RendSet *pSet, uint32 seqNr);
+
+/*********************************************************************//*!
+ * @brief Produce the requested renditions of a frame.
+ *
+ * The reduced renditions are box filtered. A bayer image therefore
+ * becomes a greyscale image. The raw image is read only once, however
+ * many renditions are requested.
+ *
+ * @param pSet Pointer to the rendition set.
+ * @param pRaw Pointer to the raw image.
+ * @param width Width of the raw image.
+ * @param height Height of the raw image.
+ * @param mask Renditions to produce (bit i for rendition i).
+ *//*********************************************************************/
+void Rend_Produce(struct RendSet *pSet,
+		  const uint8 *pRaw,
+		  uint32 width,
+		  uint32 height,
+		  uint32 mask);
+
+/*********************************************************************//*!
+ * @brief Halve a pair of rows in both dimensions (2x2 box filter).
+ *
+ * If both source rows are word aligned, two output pixels are computed
+ * per 32 bit word in two 16 bit lanes. This assumes a little endian CPU.
+ *
+ * @param pRow0 Pointer to the upper source row.
+ * @param pRow1 Pointer to the lower source row.
+ * @param pDst Pointer to the destination row (srcWidth/2 pixels).
+ * @param srcWidth Width of the source rows.
+ *//*********************************************************************/
+void Rend_HalveRows(const uint8 *pRow0,
+		    const uint8 *pRow1,
+		    uint8 *pDst,
+		    uint32 srcWidth);
+
+/*********************************************************************//*!
+ * @brief Cut a region out of an image and scale it down.
+ *
+ * The region is box filtered by the scale factor in both dimensions, so
+ * with a factor above 1 a bayer image becomes a greyscale image. The
+ * result is (width/scale)x(height/scale) pixels.
+ *
+ * @param pRaw Pointer to the image.
+ * @param stride Width of the image.
+ * @param x Left column of the region.
+ * @param y Top row of the region.
+ * @param width Width of the region (within the image).
+ * @param height Height of the region (within the image).
+ * @param scale Down scaling factor (1 .. 16).
+ * @param pDst Pointer to the destination buffer.
+ *//*********************************************************************/
+void Rend_Extract(const uint8 *pRaw,
+		  uint32 stride,
+		  uint32 x,
+		  uint32 y,
+		  uint32 width,
+		  uint32 height,
+		  uint32 scale,
+		  uint8 *pDst);
+
+#endif /* RENDITION_H */
@@ -0,0 +1,334 @@
+/*	Target side application for the Rich Viewer.
+	Copyright (C) 2008 Supercomputing Systems AG
+
+	This library is free software; you can redistribute it and/or modify it
+	under the terms of the GNU Lesser General Public License as published by
+	the Free Software Foundation; either version 2.1 of the License, or (at
+	your option) any later version.
+
+	This library is distributed in the hope that it will be useful, but
+	WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser
+	General Public License for more details.
+
+	You should have received a copy of the GNU Lesser General Public License
+	along with this library; if not, write to the Free Software Foundation,
+	Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+/*! @file resumecheck.c
+ * @brief Host tool checking the replay of the feed after a reconnect of a
+ * running rich-view.
+ *
+ * The synthetic frame source is enabled with feed retention, and the full
+ * resolution image of every frame is sent. The feed is read, dropped and
+ * reconnected, then resumed with MSG_CMD_RESUME_FEED after the last frame
+ * received, a little later as a real host would. The sequence numbers of the frames have to increase strictly
+ * over both connections: frames may be lost, but none may arrive twice or
+ * out of order.
+ *
+ * Usage: rich-view-resumecheck_host [-a address] [-n frames]
+ *        [-p pause ms] [-d resume delay ms] [-s synthetic pattern]
+ */
+
+#include "rich-view.h"
+#include <arpa/inet.h>
+
+/*! @brief Default number of frames read per connection. */
+#define RESUMECHECK_FRAMES 200
+/*! @brief Default time the feed stays disconnected (ms). */
+#define RESUMECHECK_PAUSE_MS 100
+/*! @brief Default time between reconnecting the feed and resuming it
+  (ms). */
+#define RESUMECHECK_DELAY_MS 50
+/*! @brief Frame rate of the synthetic frame source (frames per 1000 s). */
+#define RESUMECHECK_RATE 100000
+/*! @brief Frame size of the synthetic frame source (width << 16 |
+  height). */
+#define RESUMECHECK_SIZE (160 << 16 | 120)
+/*! @brief Byte budget of the retention window. */
+#define RESUMECHECK_RETAIN_BYTES (1024*1024)
+
+/*! @brief Result of the check. */
+struct SeqCheck
+{
+	/*! @brief Sequence number of the last frame received. */
+	uint32 lastSeqNr;
+	/*! @brief TRUE if a frame has been received. */
+	bool bStarted;
+	/*! @brief Number of frames received. */
+	uint32 nFrames;
+	/*! @brief Number of frames lost. */
+	uint32 nLost;
+	/*! @brief Number of frames received twice or out of order. */
+	uint32 nBad;
+};
+
+/*********************************************************************//*!
+ * @brief Connect to a port of the target.
+ *
+ * @param strAddr IP address of the target.
+ * @param port Port number.
+ * @return The connected socket or -1.
+ *//*********************************************************************/
+static int Connect(const char *strAddr, int port)
+{
+	int sock;
+	struct sockaddr_in addr;
+
+	sock = socket(PF_INET, SOCK_STREAM, 0);
+	if(sock < 0)
+	{
+		return -1;
+	}
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons(port);
+	addr.sin_addr.s_addr = inet_addr(strAddr);
+	if(connect(sock, (struct sockaddr*)&addr, sizeof(addr)) != 0)
+	{
+		close(sock);
+		return -1;
+	}
+	return sock;
+}
+
+/*********************************************************************//*!
+ * @brief Receive exactly len bytes.
+ *
+ * @param sock The socket.
+ * @param pBuf Buffer to receive into.
+ * @param len Number of bytes.
+ * @return SUCCESS or -EDEVICE.
+ *//*********************************************************************/
+static OSC_ERR RecvAll(int sock, void *pBuf, uint32 len)
+{
+	uint8 *p = (uint8*)pBuf;
+	int retval;
+
+	while(len > 0)
+	{
+		retval = recv(sock, p, len, 0);
+		if(retval <= 0)
+		{
+			return -EDEVICE;
+		}
+		p += retval;
+		len -= retval;
+	}
+	return SUCCESS;
+}
+
+/*********************************************************************//*!
+ * @brief Send a command and wait for the reply.
+ *
+ * @param sock The command socket.
+ * @param pMsg The command; replaced by the reply.
+ * @return SUCCESS or an appropriate error code.
+ *//*********************************************************************/
+static OSC_ERR Command(int sock, struct CommMsg *pMsg)
+{
+	uint32 len = sizeof(struct MsgHdr) + pMsg->hdr.bodyLength;
+
+	pMsg->hdr.status = STATUS_REQUEST;
+	if(send(sock, pMsg, len, 0) != (int)len)
+	{
+		return -EDEVICE;
+	}
+	if(RecvAll(sock, &pMsg->hdr, sizeof(struct MsgHdr)) != SUCCESS ||
+	   pMsg->hdr.bodyLength > MAX_MSG_BODY_LENGTH ||
+	   RecvAll(sock, pMsg->body, pMsg->hdr.bodyLength) != SUCCESS)
+	{
+		return -EDEVICE;
+	}
+	return pMsg->hdr.status == STATUS_REPLY_SUCC ? SUCCESS : -EDEVICE;
+}
+
+/*********************************************************************//*!
+ * @brief Write one register.
+ *
+ * @param sock The command socket.
+ * @param pMsg Buffer for the command and the reply.
+ * @param id ID of the register.
+ * @param val The new value.
+ * @return SUCCESS or an appropriate error code.
+ *//*********************************************************************/
+static OSC_ERR SetReg(int sock, struct CommMsg *pMsg, uint32 id, uint32 val)
+{
+	struct CBP_PARAM param;
+
+	memset(&pMsg->hdr, 0, sizeof(pMsg->hdr));
+	pMsg->hdr.msgType = MSG_CMD_SET_CONFIG;
+	pMsg->hdr.bodyLength = sizeof(param);
+	param.id = id;
+	param.val = val;
+	memcpy(pMsg->body, &param, sizeof(param));
+	return Command(sock, pMsg);
+}
+
+/*********************************************************************//*!
+ * @brief Read frames from the feed and check their sequence numbers.
+ *
+ * Only the full resolution images are counted; the other feed messages
+ * are skipped.
+ *
+ * @param sock The feed socket.
+ * @param pBody Buffer for the message bodies.
+ * @param nFrames Number of frames to read.
+ * @param pCheck The result, updated.
+ * @return SUCCESS or -EDEVICE.
+ *//*********************************************************************/
+static OSC_ERR ReadFrames(int sock, uint8 *pBody, uint32 nFrames, struct SeqCheck *pCheck)
+{
+	struct MsgHdr hdr;
+	struct FeedHdr *pFeedHdr = (struct FeedHdr*)pBody;
+	uint32 n = 0;
+
+	while(n < nFrames)
+	{
+		if(RecvAll(sock, &hdr, sizeof(hdr)) != SUCCESS ||
+		   hdr.bodyLength > MAX_MSG_BODY_LENGTH ||
+		   RecvAll(sock, pBody, hdr.bodyLength) != SUCCESS)
+		{
+			return -EDEVICE;
+		}
+		if(hdr.msgType != MSG_FEED_DATA ||
+		   hdr.msgParams.feedDataParams.rendition != REND_FULL)
+		{
+			continue;
+		}
+
+		/* Sequence numbers wrap around. */
+		if(pCheck->bStarted && (int32)(pFeedHdr->seqNr - pCheck->lastSeqNr) <= 0)
+		{
+			fprintf(stderr, "Frame %d after frame %d.\n",
+				pFeedHdr->seqNr, pCheck->lastSeqNr);
+			pCheck->nBad++;
+		} else {
+			if(pCheck->bStarted)
+			{
+				pCheck->nLost += pFeedHdr->seqNr - pCheck->lastSeqNr - 1;
+			}
+			pCheck->lastSeqNr = pFeedHdr->seqNr;
+			pCheck->bStarted = TRUE;
+		}
+		pCheck->nFrames++;
+		n++;
+	}
+	return SUCCESS;
+}
+
+/*********************************************************************//*!
+ * @brief Program entry.
+ *
+ * @param argc Command line argument count.
+ * @param argv Command line argument strings.
+ * @return 0 if the check passed.
+ *//*********************************************************************/
+int main(const int argc, const char * argv[])
+{
+	const char *strAddr = "127.0.0.1";
+	uint32 nFrames = RESUMECHECK_FRAMES, pauseMs = RESUMECHECK_PAUSE_MS;
+	uint32 delayMs = RESUMECHECK_DELAY_MS;
+	uint32 pattern = SYNTH_GRADIENT;
+	struct SeqCheck check;
+	struct CommMsg *pMsg;
+	uint8 *pBody;
+	int i, ctrlSock, feedSock;
+	OSC_ERR err;
+
+	for(i = 1; i + 1 < argc; i += 2)
+	{
+		if(strcmp(argv[i], "-a") == 0)
+		{
+			strAddr = argv[i + 1];
+		} else if(strcmp(argv[i], "-n") == 0)
+		{
+			nFrames = atoi(argv[i + 1]);
+		} else if(strcmp(argv[i], "-p") == 0)
+		{
+			pauseMs = atoi(argv[i + 1]);
+		} else if(strcmp(argv[i], "-d") == 0)
+		{
+			delayMs = atoi(argv[i + 1]);
+		} else if(strcmp(argv[i], "-s") == 0)
+		{
+			pattern = atoi(argv[i + 1]);
+		} else {
+			break;
+		}
+	}
+	if(i < argc || nFrames == 0 || pattern == SYNTH_OFF ||
+	   pattern >= SYNTH_PATTERN_COUNT)
+	{
+		fprintf(stderr, "Usage: %s [-a address] [-n frames] [-p pause ms] "
+			"[-d resume delay ms] [-s synthetic pattern]\n", argv[0]);
+		return 1;
+	}
+
+	pMsg = malloc(sizeof(struct CommMsg));
+	pBody = malloc(MAX_MSG_BODY_LENGTH);
+	ctrlSock = Connect(strAddr, TCP_CMD_PORT);
+	if(pMsg == NULL || pBody == NULL || ctrlSock < 0)
+	{
+		fprintf(stderr, "Unable to connect to %s:%d.\n", strAddr, TCP_CMD_PORT);
+		return 1;
+	}
+	if(SetReg(ctrlSock, pMsg, REG_ID_AQUISITION_MODE, 0) != SUCCESS ||
+	   SetReg(ctrlSock, pMsg, REG_ID_SYNTH_PATTERN, pattern) != SUCCESS ||
+	   SetReg(ctrlSock, pMsg, REG_ID_SYNTH_SIZE, RESUMECHECK_SIZE) != SUCCESS ||
+	   SetReg(ctrlSock, pMsg, REG_ID_SYNTH_PIX_FMT, V4L2_PIX_FMT_GREY) != SUCCESS ||
+	   SetReg(ctrlSock, pMsg, REG_ID_SYNTH_RATE, RESUMECHECK_RATE) != SUCCESS ||
+	   SetReg(ctrlSock, pMsg, REG_ID_FEED_CONTENT, FEED_CONTENT_IMAGE) != SUCCESS ||
+	   SetReg(ctrlSock, pMsg, REG_ID_FEED_RENDITIONS, 1 << REND_FULL) != SUCCESS ||
+	   SetReg(ctrlSock, pMsg, REG_ID_CHANGE_THRESHOLD, 0) != SUCCESS ||
+	   SetReg(ctrlSock, pMsg, REG_ID_FEED_RETAIN_BYTES, RESUMECHECK_RETAIN_BYTES) != SUCCESS)
+	{
+		fprintf(stderr, "Unable to configure the target.\n");
+		return 1;
+	}
+
+	memset(&check, 0, sizeof(check));
+	feedSock = Connect(strAddr, TCP_FEED_PORT);
+	if(feedSock < 0 || SetReg(ctrlSock, pMsg, REG_ID_AQUISITION_MODE, 1) != SUCCESS)
+	{
+		fprintf(stderr, "Unable to start the feed.\n");
+		return 1;
+	}
+	err = ReadFrames(feedSock, pBody, nFrames, &check);
+
+	/* The target keeps retaining the frames while the host is away. */
+	close(feedSock);
+	usleep(pauseMs*1000);
+	feedSock = Connect(strAddr, TCP_FEED_PORT);
+	usleep(delayMs*1000);
+	memset(&pMsg->hdr, 0, sizeof(pMsg->hdr));
+	pMsg->hdr.msgType = MSG_CMD_RESUME_FEED;
+	pMsg->hdr.msgParams.resumeFeedReq.lastSeqNr = check.lastSeqNr;
+	if(err != SUCCESS || feedSock < 0 || Command(ctrlSock, pMsg) != SUCCESS)
+	{
+		fprintf(stderr, "Unable to resume the feed.\n");
+		return 1;
+	}
+	printf("Resumed after frame %d, replaying %d messages from frame %d on.\n",
+	       check.lastSeqNr, pMsg->hdr.msgParams.resumeFeedReply.nMsgs,
+	       pMsg->hdr.msgParams.resumeFeedReply.firstSeqNr);
+	err = ReadFrames(feedSock, pBody, nFrames, &check);
+
+	SetReg(ctrlSock, pMsg, REG_ID_AQUISITION_MODE, 0);
+	SetReg(ctrlSock, pMsg, REG_ID_FEED_RETAIN_BYTES, 0);
+	SetReg(ctrlSock, pMsg, REG_ID_SYNTH_PATTERN, SYNTH_OFF);
+	close(feedSock);
+	close(ctrlSock);
+	free(pMsg);
+	free(pBody);
+	if(err != SUCCESS)
+	{
+		fprintf(stderr, "Feed connection lost.\n");
+		return 1;
+	}
+
+	printf("%d frames, %d lost, %d repeated or out of order.\n",
+	       check.nFrames, check.nLost, check.nBad);
+	return check.nBad == 0 ? 0 : 1;
+}
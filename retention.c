@@ -0,0 +1,270 @@
+/*	Target side application for the Rich Viewer.
+	Copyright (C) 2008 Supercomputing Systems AG
+
+	This library is free software; you can redistribute it and/or modify it
+	under the terms of the GNU Lesser General Public License as published by
+	the Free Software Foundation; either version 2.1 of the License, or (at
+	your option) any later version.
+
+	This library is distributed in the hope that it will be useful, but
+	WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser
+	General Public License for more details.
+
+	You should have received a copy of the GNU Lesser General Public License
+	along with this library; if not, write to the Free Software Foundation,
+	Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+/*! @file retention.c
+ * @brief Retention window implementation.
+ *
+ * The records are stored back to back in the arena. A record never wraps
+ * around the end of the arena; if it does not fit in at the end, it is
+ * written to the start and the end is left unused (see wrapAt).
+ */
+
+#include "retention.h"
+#include <stdlib.h>
+#include <string.h>
+
+/*! @brief Header of a record in the arena, followed by the message. */
+struct RetRecord
+{
+	/*! @brief Size of the record including this header and the padding
+	  (bytes). */
+	uint32 size;
+	/*! @brief Sequence number of the frame of the message. */
+	uint32 seqNr;
+	/*! @brief Length of the message. */
+	uint32 msgLen;
+};
+
+/*! @brief Get the record at an offset of the arena. */
+#define RET_RECORD(pRet, off) ((struct RetRecord*)((pRet)->pArena + (off)))
+
+/*! @brief Round up to the alignment of the records. */
+#define RET_ALIGN(n) (((n) + 3) & ~3)
+
+/*********************************************************************//*!
+ * @brief Discard all records.
+ *
+ * @param pRet Pointer to the retention window.
+ *//*********************************************************************/
+static void Ret_Clear(struct Retention *pRet)
+{
+	pRet->head = 0;
+	pRet->tail = 0;
+	pRet->bWrapped = FALSE;
+	pRet->nRecords = 0;
+	pRet->cursor = RET_NONE;
+	pRet->pinned = RET_NONE;
+	pRet->bReplaying = FALSE;
+}
+
+/*********************************************************************//*!
+ * @brief Get the offset of the record following another one.
+ *
+ * @param pRet Pointer to the retention window.
+ * @param off Offset of the record.
+ * @return Offset of the next record or RET_NONE if it is the newest.
+ *//*********************************************************************/
+static uint32 Ret_After(const struct Retention *pRet, uint32 off)
+{
+	off += RET_RECORD(pRet, off)->size;
+	if(pRet->bWrapped && off == pRet->wrapAt)
+	{
+		off = 0;
+	}
+	return off == pRet->tail ? RET_NONE : off;
+}
+
+/*********************************************************************//*!
+ * @brief Evict the oldest record.
+ *
+ * @param pRet Pointer to the retention window.
+ *//*********************************************************************/
+static void Ret_Evict(struct Retention *pRet)
+{
+	uint32 next = Ret_After(pRet, pRet->head);
+
+	if(pRet->cursor == pRet->head)
+	{
+		/* The host misses this message. */
+		pRet->cursor = next;
+	}
+	pRet->nRecords--;
+	if(next == RET_NONE)
+	{
+		pRet->head = 0;
+		pRet->tail = 0;
+		pRet->bWrapped = FALSE;
+	} else {
+		if(next < pRet->head)
+		{
+			pRet->bWrapped = FALSE;
+		}
+		pRet->head = next;
+	}
+}
+
+/*********************************************************************//*!
+ * @brief Find free space for a record.
+ *
+ * @param pRet Pointer to the retention window.
+ * @param size Size of the record.
+ * @param pOff Offset at which the record can be written.
+ * @return TRUE if there is enough free space.
+ *//*********************************************************************/
+static bool Ret_FindSpace(const struct Retention *pRet, uint32 size, uint32 *pOff)
+{
+	if(pRet->nRecords == 0)
+	{
+		*pOff = 0;
+		return size <= pRet->size;
+	}
+	if(pRet->bWrapped)
+	{
+		/* Free is only the gap between the newest and the oldest. */
+		*pOff = pRet->tail;
+		return pRet->tail + size <= pRet->head;
+	}
+	if(pRet->tail + size <= pRet->size)
+	{
+		*pOff = pRet->tail;
+		return TRUE;
+	}
+	*pOff = 0;
+	return size <= pRet->head;
+}
+
+OSC_ERR Ret_SetBudget(struct Retention *pRet, uint32 budget)
+{
+	uint8 *pArena = NULL;
+
+	if(budget > RET_MAX_BYTES)
+	{
+		return -EINVALID_PARAMETER;
+	}
+	if(budget != 0)
+	{
+		pArena = malloc(budget);
+		if(pArena == NULL)
+		{
+			return -EOUT_OF_MEMORY;
+		}
+	}
+	free(pRet->pArena);
+	pRet->pArena = pArena;
+	pRet->size = budget & ~3;
+	Ret_Clear(pRet);
+	return SUCCESS;
+}
+
+OSC_ERR Ret_Add(struct Retention *pRet,
+		uint32 seqNr,
+		const void *pHdr,
+		uint32 hdrLen,
+		const void *pData,
+		uint32 len)
+{
+	struct RetRecord *pRec;
+	uint32 size, off;
+
+	if(pRet->pArena == NULL)
+	{
+		return SUCCESS;
+	}
+
+	size = RET_ALIGN(sizeof(struct RetRecord) + hdrLen + len);
+	while(!Ret_FindSpace(pRet, size, &off))
+	{
+		if(pRet->nRecords == 0 || pRet->pinned == pRet->head)
+		{
+			pRet->nDropped++;
+			return -ETRY_AGAIN;
+		}
+		Ret_Evict(pRet);
+	}
+
+	if(pRet->nRecords != 0 && off < pRet->tail)
+	{
+		pRet->bWrapped = TRUE;
+		pRet->wrapAt = pRet->tail;
+	}
+	pRec = RET_RECORD(pRet, off);
+	pRec->size = size;
+	pRec->seqNr = seqNr;
+	pRec->msgLen = hdrLen + len;
+	memcpy((uint8*)(pRec + 1), pHdr, hdrLen);
+	memcpy((uint8*)(pRec + 1) + hdrLen, pData, len);
+	pRet->tail = off + size;
+	pRet->nRecords++;
+
+	if(pRet->cursor == RET_NONE && pRet->bReplaying)
+	{
+		/* The replay has caught up; continue with this record. */
+		pRet->cursor = off;
+	}
+	return SUCCESS;
+}
+
+uint32 Ret_Seek(struct Retention *pRet, uint32 lastSeqNr, uint32 *pFirstSeqNr)
+{
+	uint32 off, n = 0;
+
+	pRet->cursor = RET_NONE;
+	pRet->bReplaying = TRUE;
+	*pFirstSeqNr = lastSeqNr + 1;
+	if(pRet->nRecords == 0)
+	{
+		return 0;
+	}
+
+	for(off = pRet->head; off != RET_NONE; off = Ret_After(pRet, off))
+	{
+		/* Sequence numbers wrap around. */
+		if((int32)(RET_RECORD(pRet, off)->seqNr - lastSeqNr) <= 0)
+		{
+			continue;
+		}
+		if(pRet->cursor == RET_NONE)
+		{
+			pRet->cursor = off;
+			*pFirstSeqNr = RET_RECORD(pRet, off)->seqNr;
+		}
+		n++;
+	}
+	return n;
+}
+
+bool Ret_Next(struct Retention *pRet, const uint8 **ppMsg, uint32 *pLen)
+{
+	struct RetRecord *pRec;
+
+	if(pRet->cursor == RET_NONE)
+	{
+		pRet->pinned = RET_NONE;
+		pRet->bReplaying = FALSE;
+		return FALSE;
+	}
+
+	pRec = RET_RECORD(pRet, pRet->cursor);
+	*ppMsg = (const uint8*)(pRec + 1);
+	*pLen = pRec->msgLen;
+	pRet->pinned = pRet->cursor;
+	pRet->cursor = Ret_After(pRet, pRet->cursor);
+	return TRUE;
+}
+
+void Ret_Unpin(struct Retention *pRet)
+{
+	pRet->pinned = RET_NONE;
+}
+
+void Ret_StopReplay(struct Retention *pRet)
+{
+	pRet->cursor = RET_NONE;
+	pRet->pinned = RET_NONE;
+	pRet->bReplaying = FALSE;
+}
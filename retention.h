@@ -0,0 +1,138 @@
+/*	Target side application for the Rich Viewer.
+	Copyright (C) 2008 Supercomputing Systems AG
+
+	This library is free software; you can redistribute it and/or modify it
+	under the terms of the GNU Lesser General Public License as published by
+	the Free Software Foundation; either version 2.1 of the License, or (at
+	your option) any later version.
+
+	This library is distributed in the hope that it will be useful, but
+	WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser
+	General Public License for more details.
+
+	You should have received a copy of the GNU Lesser General Public License
+	along with this library; if not, write to the Free Software Foundation,
+	Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+/*! @file retention.h
+ * @brief Retention window of the most recent feed messages.
+ *
+ * Copies of the feed messages are kept in a circular arena of a fixed
+ * byte budget; the oldest messages are evicted to make room for new ones.
+ * After a reconnect, the messages the host has missed can be replayed from
+ * a cursor. The message the cursor returned last is pinned until it has
+ * been sent and is never evicted.
+ */
+
+#ifndef RETENTION_H
+#define RETENTION_H
+
+#include "inc/oscar.h"
+
+/*! @brief Largest byte budget of the retention window. */
+#define RET_MAX_BYTES (8*1024*1024)
+
+/*! @brief The retention window. */
+struct Retention
+{
+	/*! @brief The arena holding the records or NULL if disabled. */
+	uint8 *pArena;
+	/*! @brief Size of the arena (bytes). */
+	uint32 size;
+	/*! @brief Offset of the oldest record. */
+	uint32 head;
+	/*! @brief Offset at which the next record is written. */
+	uint32 tail;
+	/*! @brief If TRUE, the records from head run up to wrapAt and
+	  continue at the start of the arena. */
+	bool bWrapped;
+	/*! @brief End of the records at the end of the arena if bWrapped. */
+	uint32 wrapAt;
+	/*! @brief Number of records. */
+	uint32 nRecords;
+	/*! @brief Offset of the next record to be replayed or RET_NONE. */
+	uint32 cursor;
+	/*! @brief Offset of the record being sent or RET_NONE. */
+	uint32 pinned;
+	/*! @brief TRUE from Ret_Seek until Ret_Next has returned all
+	  records. */
+	bool bReplaying;
+	/*! @brief Number of messages that could not be retained. */
+	uint32 nDropped;
+};
+
+/*! @brief Offset value meaning "no record". */
+#define RET_NONE 0xffffffff
+
+/*********************************************************************//*!
+ * @brief Set the byte budget of the retention window.
+ *
+ * All retained messages are discarded and a replay is stopped. Must not
+ * be called while a message is pinned.
+ *
+ * @param pRet Pointer to the retention window.
+ * @param budget Byte budget (0 .. RET_MAX_BYTES), 0 disables retention.
+ * @return SUCCESS, -EINVALID_PARAMETER or -EOUT_OF_MEMORY.
+ *//*********************************************************************/
+OSC_ERR Ret_SetBudget(struct Retention *pRet, uint32 budget);
+
+/*********************************************************************//*!
+ * @brief Retain a copy of a message.
+ *
+ * @param pRet Pointer to the retention window.
+ * @param seqNr Sequence number of the frame of the message.
+ * @param pHdr Pointer to the headers of the message.
+ * @param hdrLen Length of the headers.
+ * @param pData Pointer to the data of the message.
+ * @param len Length of the data.
+ * @return SUCCESS, or -ETRY_AGAIN if the message does not fit in.
+ *//*********************************************************************/
+OSC_ERR Ret_Add(struct Retention *pRet,
+		uint32 seqNr,
+		const void *pHdr,
+		uint32 hdrLen,
+		const void *pData,
+		uint32 len);
+
+/*********************************************************************//*!
+ * @brief Position the replay cursor after the frame the host saw last.
+ *
+ * @param pRet Pointer to the retention window.
+ * @param lastSeqNr Sequence number of the last frame the host received.
+ * @param pFirstSeqNr Sequence number of the first frame to be replayed.
+ * @return Number of messages to be replayed.
+ *//*********************************************************************/
+uint32 Ret_Seek(struct Retention *pRet, uint32 lastSeqNr, uint32 *pFirstSeqNr);
+
+/*********************************************************************//*!
+ * @brief Get the next message to be replayed and pin it.
+ *
+ * Messages retained after Ret_Seek are replayed as well. Releases the
+ * message pinned before.
+ *
+ * @param pRet Pointer to the retention window.
+ * @param ppMsg The message (headers followed by the data).
+ * @param pLen Length of the message.
+ * @return TRUE if there was a message, FALSE if the replay is complete.
+ *//*********************************************************************/
+bool Ret_Next(struct Retention *pRet, const uint8 **ppMsg, uint32 *pLen);
+
+/*********************************************************************//*!
+ * @brief Release the message pinned by Ret_Next.
+ *
+ * @param pRet Pointer to the retention window.
+ *//*********************************************************************/
+void Ret_Unpin(struct Retention *pRet);
+
+/*********************************************************************//*!
+ * @brief Stop a replay, e.g. because the connection has been lost.
+ *
+ * Releases the pinned message; the retained messages are kept.
+ *
+ * @param pRet Pointer to the retention window.
+ *//*********************************************************************/
+void Ret_StopReplay(struct Retention *pRet);
+
+#endif /* RETENTION_H */
@@ -31,6 +31,17 @@
 #include "inc/oscar.h"
 #include "inc/oscar_target_type.h"
 #include "communication.h"
+#include "statistics.h"
+#include "rendition.h"
+#include "timing.h"
+#include "trigger.h"
+#include "workpool.h"
+#include "framering.h"
+#include "synthcam.h"
+#include "change.h"
+#include "roi.h"
+#include "qos.h"
+#include "pipeline.h"
 #include "version.h"
 #include <stdio.h>
 
@@ -40,8 +51,22 @@
 #endif /* TARGET_TYPE_INDXCAM */
 
 /*--------------------------- Settings ------------------------------*/
-/*! @brief The number of frame buffers used. */
+/*! @brief The number of frame buffers used.
+ *
+ * A frame is processed and sent while the next capture already runs, so
+ * at least two buffers are required. */
 #define NR_FRAME_BUFFERS 2
+#if NR_FRAME_BUFFERS < 2
+	#error "Processing in parallel to the next capture needs two frame buffers."
+#endif
+#if NR_FRAME_BUFFERS > FRAME_RING_SIZE
+	#error "The frame ring has to be able to describe all frame buffers."
+#endif
+
+/*! @brief Consumer index of the feed in the frame ring. */
+#define FRAME_CONSUMER_FEED 0
+/*! @brief Number of consumers of the frame ring. */
+#define NR_FRAME_CONSUMERS 1
 
 /*! @brief Timeout (ms) when waiting for a new picture. */
 #define CAMERA_TIMEOUT 1
@@ -52,10 +77,22 @@
 /*! @brief Timeout (ms) when waiting for new commands. */
 #define GET_CMDS_TIMEOUT 1
 
+/*! @brief Timeout (ms) when waiting for the feed to accept more data. */
+#define FEED_PUMP_TIMEOUT 1
+
+/*! @brief Size of the stack pre-faulted for the main loop (bytes). */
+#define PREFAULT_STACK_SIZE (64*1024)
+
 /*! @brief defines the timeout for CMOS sensor */
 #define TIMEOUT 100
-/*! @brief defines the time constant for time-outs (CPU speed dependent) */
-#define VERTICAL_BLANK_CYCLES 763000 /* Vertical blank time (1.42 ms) converted to CPU cycles. */
+/*! @brief Vertical blank time of the sensor (us). No trigger may be fired
+ * within this time after the end of a frame. */
+#define VERTICAL_BLANK_US 1420
+
+/*! @brief Longest time between two iterations of the main loop when no
+ * frame is processed (us). */
+#define MAIN_LOOP_POLL_US ((ACCEPT_CONNS_TIMEOUT + GET_CMDS_TIMEOUT + \
+			    FEED_PUMP_TIMEOUT + CAMERA_TIMEOUT)*1000)
 
 /*! @brief File name of the configuration */
 #define CONFIG_FILE_NAME	"config" 
@@ -70,6 +107,9 @@
 	#define DEFAULT_EXPOSURE_DELAY 0
 #endif /* HAS_CPLD */
 
+/*! @brief Default content of the feed (see REG_ID_FEED_CONTENT). */
+#define DEFAULT_FEED_CONTENT FEED_CONTENT_IMAGE
+
 /*--------------------------- Commands ------------------------------*/
 /*! @brief command to start live-view mode */
 #define CmdLiveMode		76			/* 'L' = Live-Mode Start (self triggering) */
@@ -113,6 +153,156 @@
 /*! @brief A write to this register stores the exposure delay at the
   current position. */
 #define REG_ID_STORE_CUR_EXP_DELAY 6
+/*! @brief Register ID for the content of the feed (FEED_CONTENT_* bits). */
+#define REG_ID_FEED_CONTENT	7
+/*! @brief Register ID for the renditions sent over the feed (bit i for
+  rendition i, see REND_*). */
+#define REG_ID_FEED_RENDITIONS	8
+/*! @brief Register ID for the target frame rate in internal trigger mode
+  (frames per 1000 s, 0 to run as fast as possible). */
+#define REG_ID_FRAME_RATE	9
+/*! @brief Register ID for the upper left corner (x << 16 | y) of the
+  statistics region of interest i. */
+#define REG_ID_STAT_ROI_POS(i)	(16 + 2*(i))
+/*! @brief Register ID for the size (width << 16 | height) of the
+  statistics region of interest i. */
+#define REG_ID_STAT_ROI_SIZE(i)	(17 + 2*(i))
+/*! @brief Register ID for the frame rate divisor of rendition i. */
+#define REG_ID_REND_DIVISOR(i)	(24 + (i))
+/*! @brief Register ID for the transport profile of the feed socket
+  (FEED_PROFILE_*). */
+#define REG_ID_FEED_PROFILE	27
+/*! @brief Register ID for the byte budget of the feed retention window (0
+  to disable, see MSG_CMD_RESUME_FEED). */
+#define REG_ID_FEED_RETAIN_BYTES	28
+/*! @brief Register ID for the pattern of the synthetic frame source
+  (SYNTH_*, SYNTH_OFF to capture from the camera). Only writable in idle
+  mode. */
+#define REG_ID_SYNTH_PATTERN	29
+/*! @brief Register ID for the frame size (width << 16 | height) of the
+  synthetic frame source. */
+#define REG_ID_SYNTH_SIZE	30
+/*! @brief Register ID for the pixel format (V4L2_PIX_FMT_*) of the
+  synthetic frame source. */
+#define REG_ID_SYNTH_PIX_FMT	31
+/*! @brief Register ID for the frame rate of the synthetic frame source
+  (frames per 1000 s, 0 for one frame per trigger). */
+#define REG_ID_SYNTH_RATE	32
+/*! @brief Register ID for the share of the frame that has to change for
+  the image to be sent (per mille, see change.h), 0 to send every frame. */
+#define REG_ID_CHANGE_THRESHOLD	33
+/*! @brief Register ID for the longest time the image is not sent in spite
+  of no change (ms), 0 for no heartbeat. */
+#define REG_ID_CHANGE_HEARTBEAT	34
+/*! @brief Register ID for the position (x << 16 | y, even) of the read-out
+  window of the sensor. */
+#define REG_ID_SENSOR_WIN_POS	35
+/*! @brief Register ID for the size (width << 16 | height, even) of the
+  read-out window of the sensor, 0 to extend it to the edges of the
+  sensor. Smaller windows are read out faster. The window is applied
+  after the command, so position and size set in the same command are
+  applied together. */
+#define REG_ID_SENSOR_WIN_SIZE	36
+/*! @brief Register ID for the position (x << 16 | y) of region of
+  interest i (0 .. ROI_MAX - 1) sent with FEED_CONTENT_ROIS. */
+#define REG_ID_FEED_ROI_POS(i)	(37 + 2*(i))
+/*! @brief Register ID for the size (width << 16 | height) of region of
+  interest i; a region with no area is not sent. */
+#define REG_ID_FEED_ROI_SIZE(i)	(38 + 2*(i))
+/*! @brief Register ID for the bandwidth cap of the feed (bytes per
+  second), 0 for no cap. */
+#define REG_ID_FEED_RATE_CAP	53
+/*! @brief Register ID for the burst size of the feed bandwidth cap
+  (bytes, at least FEED_CAP_CHUNK). */
+#define REG_ID_FEED_BURST	54
+/*! @brief Register ID to let the target choose the rendition and frame
+  rate of the images sent (1) instead of the subscribed renditions (0),
+  see qos.h. Needs a configured frame rate (REG_ID_FRAME_RATE with the
+  internal trigger, or REG_ID_SYNTH_RATE). */
+#define REG_ID_QOS_ENABLE	55
+/*! @brief Register ID for the enabled stages of the processing pipeline
+  (bit i for stage i, see SetupPipeline). */
+#define REG_ID_PIPE_ENABLE	56
+/*! @brief Register ID for the size of the batches small feed messages
+  are sent in (bytes), 0 to send every message on its own. */
+#define REG_ID_FEED_BATCH_BYTES	57
+/*! @brief Register ID for the longest time a feed message waits in a
+  batch (us). */
+#define REG_ID_FEED_BATCH_US	58
+
+/*! @brief Feed content bit: Send the image data (MSG_FEED_DATA). */
+#define FEED_CONTENT_IMAGE	(1 << 0)
+/*! @brief Feed content bit: Send the statistics record (MSG_FEED_STATS). */
+#define FEED_CONTENT_STATS	(1 << 1)
+/*! @brief Feed content bit: Send the regions of interest
+  (MSG_FEED_ROIS). */
+#define FEED_CONTENT_ROIS	(1 << 2)
+
+/*! @brief Registers with an ID from here on are read-only status
+  registers updated by the target. */
+#define REG_ID_STATUS_FIRST	64
+/*! @brief Register ID for the achieved frame rate (frames per 1000 s). */
+#define REG_ID_STATUS_FPS	64
+/*! @brief Register ID for the mean deviation of the self-triggers from their
+  planned time (us). */
+#define REG_ID_STATUS_TRIG_JITTER_MEAN	65
+/*! @brief Register ID for the largest deviation of the self-triggers from
+  their planned time (us). */
+#define REG_ID_STATUS_TRIG_JITTER_MAX	66
+/*! @brief Register ID for the mean deviation of the frame intervals from
+  the target frame rate (us). */
+#define REG_ID_STATUS_FRAME_DEV_MEAN	67
+/*! @brief Register ID for the largest deviation of the frame intervals from
+  the target frame rate (us). */
+#define REG_ID_STATUS_FRAME_DEV_MAX	68
+/*! @brief Register ID for the mean deviation of the send intervals from
+  the target frame rate (us). */
+#define REG_ID_STATUS_SEND_DEV_MEAN	69
+/*! @brief Register ID for the largest deviation of the send intervals from
+  the target frame rate (us). */
+#define REG_ID_STATUS_SEND_DEV_MAX	70
+/*! @brief Register ID for the number of frame slots skipped to keep the
+  target frame rate. */
+#define REG_ID_STATUS_SKIPPED_SLOTS	71
+/*! @brief Register ID for the throughput of the feed (kB/s). */
+#define REG_ID_STATUS_FEED_KBPS	72
+/*! @brief Register ID for the round trip time of the feed connection as
+  measured by TCP (us). */
+#define REG_ID_STATUS_FEED_RTT	73
+/*! @brief Register ID for the send buffer size of the feed socket
+  (bytes). */
+#define REG_ID_STATUS_FEED_SNDBUF	74
+/*! @brief Register ID for the number of retransmitted feed segments. */
+#define REG_ID_STATUS_FEED_RETRANS	75
+/*! @brief Register ID for the total number of frames not sent because
+  the scene did not change. */
+#define REG_ID_STATUS_SUPPRESSED	76
+/*! @brief Register ID for the changed share of the last frame checked (per
+  mille). */
+#define REG_ID_STATUS_CHANGE	77
+/*! @brief Register ID for the mean time the main loop came around later
+  than MAIN_LOOP_POLL_US while waiting for a frame (us). */
+#define REG_ID_STATUS_LOOP_LATE_MEAN	78
+/*! @brief Register ID for the longest time the main loop came around later
+  than MAIN_LOOP_POLL_US while waiting for a frame (us). */
+#define REG_ID_STATUS_LOOP_LATE_MAX	79
+/*! @brief Register ID for the number of feed messages dropped because of
+  the bandwidth cap. */
+#define REG_ID_STATUS_FEED_CAP_DROPPED	80
+/*! @brief Register ID for the quality of service mode (EnQosMode). */
+#define REG_ID_STATUS_QOS_MODE	81
+/*! @brief Register ID for the load of the feed measured last (per mille
+  of the frame period). */
+#define REG_ID_STATUS_QOS_LOAD	82
+/*! @brief Register ID for the mean time of stage i of the processing
+  pipeline (us). */
+#define REG_ID_STATUS_PIPE_US(i)	(83 + (i))
+/*! @brief Register ID for the number of batches of small feed messages
+  sent. */
+#define REG_ID_STATUS_FEED_BATCHES	91
+/*! @brief Register ID for the number of feed messages sent in
+  batches. */
+#define REG_ID_STATUS_FEED_BATCHED_MSGS	92
 
 /*! @brief The supported trigger modes. */
 enum EnTriggerMode
@@ -123,20 +313,44 @@ enum EnTriggerMode
 
 extern struct CBP_PARAM regfile[];
 
+/*! @brief A read-out window of the sensor. */
+struct SensorWindow
+{
+	/*! @brief Column of the left edge. */
+	uint32 x;
+	/*! @brief Row of the top edge. */
+	uint32 y;
+	/*! @brief Width. */
+	uint32 width;
+	/*! @brief Height. */
+	uint32 height;
+};
+
 /*------------------- Main data object and members ------------------*/
 
 /*! @brief The structure storing all important variables of the application.
  * */
 struct DATA
 {
-	/*! @brief The frame buffers for the frame capture device driver.*/
-	uint8 u8FrameBuffers[NR_FRAME_BUFFERS][OSC_CAM_MAX_IMAGE_HEIGHT*OSC_CAM_MAX_IMAGE_WIDTH];
-	/*! @brief A buffer to hold the resulting color image. */
-	uint8 u8ResultImage[3*OSC_CAM_MAX_IMAGE_WIDTH*OSC_CAM_MAX_IMAGE_HEIGHT];
-
-	/*! @brief The last raw image captured. Always points to one of the frame
-	 * buffers. */
-	uint8* pCurRawImg;
+	/*! @brief The frame buffers for the frame capture device driver,
+	 * allocated by SetupFrameBuffers. */
+	uint8 *pFrameBuffers[NR_FRAME_BUFFERS];
+	/*! @brief Size of each frame buffer (bytes). */
+	uint32 frameBufSize;
+
+	/*! @brief The captured frames handed from the capture loop to their
+	 * consumers.
+	 *
+	 * A frame buffer is only set up for the next capture when the frame
+	 * it held has been released by all consumers. */
+	struct FrameRing frames;
+	/*! @brief Descriptor of the frame the current FRAMESEQ_EVT or
+	 * FRAMEPAR_EVT is about. */
+	struct FrameDesc *pFrame;
+	/*! @brief Descriptor of the frame read last or NULL if its frame
+	 * buffer may have been overwritten since. Snapshots are taken from
+	 * it. */
+	struct FrameDesc *pLatest;
 	
 	/*! @brief Handle to the framework instance. */
 	void *hFramework;
@@ -155,8 +369,45 @@ struct DATA
 #endif /* HAS_CPLD */
 	/*! @brief Exposure time [us] */
 	uint32 exposureTime;	
+	/*! @brief Read-out window of the sensor the frames are captured
+	 * with. */
+	struct SensorWindow sensorWin;
+	/*! @brief Read-out window set by the registers; a size of 0 extends
+	 * to the edges of the sensor. */
+	struct SensorWindow sensorWinReq;
+	/*! @brief TRUE if sensorWinReq has not been applied yet. It is
+	 * applied when no frame buffer is in use. */
+	bool bSensorWinPending;
 	enum EnTriggerMode enTriggerMode;
+	/*! @brief Scheduler of the self-triggers. */
+	struct TrigSched trig;
+	/*! @brief Lateness of the main loop while waiting for a frame. */
+	struct DevStat loopLate;
+
+	/*! @brief What is sent over the feed (FEED_CONTENT_* bits). */
+	uint32 feedContent;
+	/*! @brief Regions of interest of the statistics record. */
+	struct StatRoi statRois[STAT_MAX_ROIS];
+	/*! @brief Scratch space for the statistics kernels, one per worker. */
+	struct StatAccu statAccu[POOL_MAX_WORKERS];
+	/*! @brief Statistics record of the current frame. */
+	struct FeedStats stats;
+	/*! @brief The renditions of the current frame sent over the feed. */
+	struct RendSet rends;
+	/*! @brief Decides whether the image of a frame is sent. */
+	struct ChangeDetect change;
+	/*! @brief Regions of interest of the current frame sent over the
+	  feed. */
+	struct RoiSet rois;
+	/*! @brief Chooses the images sent from the load of the feed. */
+	struct QosCtrl qos;
+	/*! @brief The processing stages every captured frame passes. */
+	struct Pipeline pipe;
   
+	/*! @brief Synthetic frame source replacing the camera if
+	  enabled. */
+	struct SynthCam synth;
+
 	/*! @brief Variables relevant for communication. */
 	struct COMM comm;
 };
@@ -177,6 +428,19 @@ OSC_ERR Unload();
  *//*********************************************************************/
 void Terminate();
 
+/*********************************************************************//*!
+ * @brief Allocate the frame buffers for frames of a size and hand them to
+ * the frame capture device driver and the synthetic source.
+ *
+ * The previous frame buffers are freed, so no capture may be set up and
+ * the frames read before are gone.
+ *
+ * @param width Width of the frames.
+ * @param height Height of the frames.
+ * @return SUCCESS or an appropriate error code.
+ *//*********************************************************************/
+OSC_ERR SetupFrameBuffers(uint32 width, uint32 height);
+
 /*********************************************************************//*!
  * @brief Give control to statemachine.
  * 
@@ -188,15 +452,13 @@ OSC_ERR StateControl(void);
 
 
 /*********************************************************************//*!
- * @brief Process a newly captured frame.
- * 
- * In the case of this template, this consists just of debayering the
- * image and writing the result to the result image buffer. This should
- * be the starting point where you add your code.
+ * @brief Register the stages of the processing pipeline.
+ *
+ * The stages are, in this order: "stats", "rois", "change" and "image".
  * 
- * @param pRawImg The raw image to process.
+ * @return SUCCESS or an appropriate error code.
  *//*********************************************************************/
-void ProcessFrame(uint8 *pRawImg);
+OSC_ERR SetupPipeline(void);
 
 /*********************************************************************//*!
  * @brief Get software version numbers
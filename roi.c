@@ -0,0 +1,134 @@
+/*	Target side application for the Rich Viewer.
+	Copyright (C) 2008 Supercomputing Systems AG
+
+	This library is free software; you can redistribute it and/or modify it
+	under the terms of the GNU Lesser General Public License as published by
+	the Free Software Foundation; either version 2.1 of the License, or (at
+	your option) any later version.
+
+	This library is distributed in the hope that it will be useful, but
+	WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser
+	General Public License for more details.
+
+	You should have received a copy of the GNU Lesser General Public License
+	along with this library; if not, write to the Free Software Foundation,
+	Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+
+/*! @file roi.c
+ * @brief Region of interest packing implementation.
+ */
+
+#include "roi.h"
+#include "communication.h"
+#include <stdlib.h>
+#include <string.h>
+
+void Roi_Init(struct RoiSet *pSet)
+{
+	memset(pSet, 0, sizeof(struct RoiSet));
+}
+
+void Roi_DeInit(struct RoiSet *pSet)
+{
+	free(pSet->pBuf);
+	pSet->pBuf = NULL;
+	pSet->bufSize = 0;
+	pSet->len = 0;
+}
+
+OSC_ERR Roi_Pack(struct RoiSet *pSet,
+		 const uint8 *pImg,
+		 uint32 width,
+		 uint32 height,
+		 bool bBayer)
+{
+	struct StatRoi clip[ROI_MAX];
+	uint8 *pDst[ROI_MAX];
+	struct FeedRoiToc toc;
+	uint32 i, n = 0, x, y, w, h, len, yMin = height, yMax = 0;
+	const uint8 *pRow;
+	uint8 *pBuf;
+
+	/* Clip the regions to the image and lay out the message. */
+	for(i = 0; i < ROI_MAX; i++)
+	{
+		x = MIN(pSet->rects[i].x, width);
+		y = MIN(pSet->rects[i].y, height);
+		if(bBayer)
+		{
+			/* Keep the bayer pattern. */
+			x &= ~1;
+			y &= ~1;
+		}
+		w = MIN(pSet->rects[i].width, width - x);
+		h = MIN(pSet->rects[i].height, height - y);
+		if(bBayer)
+		{
+			w &= ~1;
+			h &= ~1;
+		}
+		if(w == 0 || h == 0)
+		{
+			continue;
+		}
+		clip[n].x = x;
+		clip[n].y = y;
+		clip[n].width = w;
+		clip[n].height = h;
+		yMin = MIN(yMin, y);
+		yMax = MAX(yMax, y + h);
+		n++;
+	}
+
+	toc.nRois = n;
+	len = sizeof(uint32) + n*sizeof(struct FeedRoiEntry);
+	for(i = 0; i < n; i++)
+	{
+		toc.roi[i].pos = clip[i].x << 16 | clip[i].y;
+		toc.roi[i].size = clip[i].width << 16 | clip[i].height;
+		toc.roi[i].offset = len;
+		len += clip[i].width*clip[i].height;
+	}
+	pSet->len = 0;
+	if(n == 0)
+	{
+		return SUCCESS;
+	}
+
+	if(len > pSet->bufSize)
+	{
+		pBuf = malloc(len);
+		if(pBuf == NULL)
+		{
+			return -EOUT_OF_MEMORY;
+		}
+		free(pSet->pBuf);
+		pSet->pBuf = pBuf;
+		pSet->bufSize = len;
+	}
+	memcpy(pSet->pBuf, &toc, toc.roi[0].offset);
+	for(i = 0; i < n; i++)
+	{
+		pDst[i] = pSet->pBuf + toc.roi[i].offset;
+	}
+
+	/* One pass over the rows the regions cover, so every row of the image
+	 * is read only once even if the regions overlap. */
+	for(y = yMin; y < yMax; y++)
+	{
+		pRow = pImg + y*width;
+		for(i = 0; i < n; i++)
+		{
+			if(y >= clip[i].y && y < (uint32)clip[i].y + clip[i].height)
+			{
+				memcpy(pDst[i], pRow + clip[i].x, clip[i].width);
+				pDst[i] += clip[i].width;
+			}
+		}
+	}
+	pSet->len = len;
+	return SUCCESS;
+}
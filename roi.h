@@ -0,0 +1,109 @@
+/*	Target side application for the Rich Viewer.
+	Copyright (C) 2008 Supercomputing Systems AG
+
+	This library is free software; you can redistribute it and/or modify it
+	under the terms of the GNU Lesser General Public License as published by
+	the Free Software Foundation; either version 2.1 of the License, or (at
+	your option) any later version.
+
+	This library is distributed in the hope that it will be useful, but
+	WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser
+	General Public License for more details.
+
+	You should have received a copy of the GNU Lesser General Public License
+	along with this library; if not, write to the Free Software Foundation,
+	Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+
+/*! @file roi.h
+ * @brief Regions of interest of the captured frames sent over the feed.
+ *
+ * Up to ROI_MAX rectangular regions are cut out of the raw image in a
+ * single pass over its rows and packed into one feed message
+ * (MSG_FEED_ROIS): A table of contents (struct FeedRoiToc, only the
+ * entries of the regions sent) followed by the pixels of the regions, one
+ * region after the other.
+ */
+
+#ifndef ROI_H
+#define ROI_H
+
+#include "inc/oscar.h"
+#include "statistics.h"
+
+/*! @brief Maximum number of regions. */
+#define ROI_MAX 8
+
+/*! @brief Entry of the table of contents of a MSG_FEED_ROIS message. */
+struct FeedRoiEntry
+{
+	/*! @brief Upper left corner of the region (x << 16 | y). */
+	uint32 pos;
+	/*! @brief Size of the region (width << 16 | height). */
+	uint32 size;
+	/*! @brief Offset of the pixels of the region from the start of the
+	  table of contents. */
+	uint32 offset;
+};
+
+/*! @brief Table of contents at the start of a MSG_FEED_ROIS message. */
+struct FeedRoiToc
+{
+	/*! @brief Number of regions in the message. */
+	uint32 nRois;
+	/*! @brief The regions; only the first nRois entries are sent. */
+	struct FeedRoiEntry roi[ROI_MAX];
+};
+
+/*! @brief The regions and the message they are packed into. */
+struct RoiSet
+{
+	/*! @brief The regions as configured. They are clipped to the image
+	  when they are packed. */
+	struct StatRoi rects[ROI_MAX];
+	/*! @brief The packed message data, grown as needed. */
+	uint8 *pBuf;
+	/*! @brief Size of pBuf (bytes). */
+	uint32 bufSize;
+	/*! @brief Length of the data packed last (bytes). */
+	uint32 len;
+};
+
+/*********************************************************************//*!
+ * @brief Initialize a set without regions.
+ *
+ * @param pSet Pointer to the region set.
+ *//*********************************************************************/
+void Roi_Init(struct RoiSet *pSet);
+
+/*********************************************************************//*!
+ * @brief Free the message buffer.
+ *
+ * @param pSet Pointer to the region set.
+ *//*********************************************************************/
+void Roi_DeInit(struct RoiSet *pSet);
+
+/*********************************************************************//*!
+ * @brief Cut the regions out of an image and pack them into the message
+ * data (pBuf, len).
+ *
+ * Regions with no area within the image are left out; if none is left,
+ * len is 0. In a bayer image, the regions are rounded down to even
+ * coordinates and sizes, so they keep the bayer pattern.
+ *
+ * @param pSet Pointer to the region set.
+ * @param pImg Pointer to the image (8 bit per pixel).
+ * @param width Width of the image.
+ * @param height Height of the image.
+ * @param bBayer TRUE if the image is a bayer pattern.
+ * @return SUCCESS or -EOUT_OF_MEMORY.
+ *//*********************************************************************/
+OSC_ERR Roi_Pack(struct RoiSet *pSet,
+		 const uint8 *pImg,
+		 uint32 width,
+		 uint32 height,
+		 bool bBayer);
+
+#endif /* ROI_H */
@@ -0,0 +1,368 @@
+/*	Target side application for the Rich Viewer.
+	Copyright (C) 2008 Supercomputing Systems AG
+
+	This library is free software; you can redistribute it and/or modify it
+	under the terms of the GNU Lesser General Public License as published by
+	the Free Software Foundation; either version 2.1 of the License, or (at
+	your option) any later version.
+
+	This library is distributed in the hope that it will be useful, but
+	WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser
+	General Public License for more details.
+
+	You should have received a copy of the GNU Lesser General Public License
+	along with this library; if not, write to the Free Software Foundation,
+	Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+/*! @file statistics.c
+ * @brief Per-frame image statistics implementation.
+ */
+
+#include "statistics.h"
+#include <string.h>
+
+#ifndef MIN
+/*! @brief Build the minimum of two numbers. */
+#define MIN(a, b) ((a) <= (b) ? (a) : (b))
+#endif
+#ifndef MAX
+/*! @brief Build the maximum of two numbers. */
+#define MAX(a, b) ((a) >= (b) ? (a) : (b))
+#endif
+
+/*! @brief Number of rows per tile when the statistics are computed by
+ * the worker pool. */
+#define STAT_TILE_ROWS 16
+
+/*! @brief Number of words that can be summed up in two 16 bit lanes
+ * before a lane may overflow (2 * 255 per word and lane). */
+#define SWAR_SUM_WORDS 128
+
+/*********************************************************************//*!
+ * @brief Add the pixels of a row segment to the partial histograms.
+ *
+ * @param hist The four partial histograms.
+ * @param pPix Pointer to the first pixel.
+ * @param nPix Number of pixels.
+ *//*********************************************************************/
+static void Stat_HistRow(uint32 hist[4][STAT_HIST_BINS], const uint8 *pPix, uint32 nPix)
+{
+	const uint32 *pWord;
+	uint32 w, nWords;
+
+	/* Unaligned head. */
+	while(nPix > 0 && ((unsigned long)pPix & 3) != 0)
+	{
+		hist[0][*pPix++]++;
+		nPix--;
+	}
+
+	/* Every byte lane increments its own histogram, so consecutive
+	 * increments never wait for each other. */
+	pWord = (const uint32*)pPix;
+	nWords = nPix >> 2;
+	while(nWords-- > 0)
+	{
+		w = *pWord++;
+		hist[0][w & 0xff]++;
+		hist[1][(w >> 8) & 0xff]++;
+		hist[2][(w >> 16) & 0xff]++;
+		hist[3][w >> 24]++;
+	}
+
+	/* Tail. */
+	pPix = (const uint8*)pWord;
+	nPix &= 3;
+	while(nPix-- > 0)
+	{
+		hist[0][*pPix++]++;
+	}
+}
+
+/*********************************************************************//*!
+ * @brief Sum up the pixels of a row segment.
+ *
+ * @param pPix Pointer to the first pixel.
+ * @param nPix Number of pixels.
+ * @return The sum of all pixel values.
+ *//*********************************************************************/
+static uint32 Stat_SumRow(const uint8 *pPix, uint32 nPix)
+{
+	const uint32 *pWord;
+	uint32 w, nWords, nBatch, lanes;
+	uint32 sum = 0;
+
+	while(nPix > 0 && ((unsigned long)pPix & 3) != 0)
+	{
+		sum += *pPix++;
+		nPix--;
+	}
+
+	/* Add two pixels per lane and word; fold the lanes before they
+	 * can overflow. */
+	pWord = (const uint32*)pPix;
+	nWords = nPix >> 2;
+	while(nWords > 0)
+	{
+		nBatch = nWords < SWAR_SUM_WORDS ? nWords : SWAR_SUM_WORDS;
+		nWords -= nBatch;
+		lanes = 0;
+		while(nBatch-- > 0)
+		{
+			w = *pWord++;
+			lanes += (w & 0x00ff00ff) + ((w >> 8) & 0x00ff00ff);
+		}
+		sum += (lanes & 0xffff) + (lanes >> 16);
+	}
+
+	pPix = (const uint8*)pWord;
+	nPix &= 3;
+	while(nPix-- > 0)
+	{
+		sum += *pPix++;
+	}
+	return sum;
+}
+
+/*********************************************************************//*!
+ * @brief Clip a region of interest to the image.
+ *
+ * @param pRoi The region of interest.
+ * @param width Width of the image.
+ * @param height Height of the image.
+ * @param pX1 Column after the last column of the clipped region.
+ * @param pY1 Row after the last row of the clipped region.
+ * @return TRUE if the clipped region is not empty.
+ *//*********************************************************************/
+static bool Stat_ClipRoi(const struct StatRoi *pRoi,
+			 uint32 width,
+			 uint32 height,
+			 uint32 *pX1,
+			 uint32 *pY1)
+{
+	if(pRoi->x >= width || pRoi->y >= height ||
+	   pRoi->width == 0 || pRoi->height == 0)
+	{
+		return FALSE;
+	}
+	*pX1 = MIN((uint32)pRoi->x + pRoi->width, width);
+	*pY1 = MIN((uint32)pRoi->y + pRoi->height, height);
+	return TRUE;
+}
+
+/*********************************************************************//*!
+ * @brief Integer square root.
+ *
+ * @param val The radicand.
+ * @return The largest integer whose square is not larger than val.
+ *//*********************************************************************/
+static uint32 Stat_Sqrt(uint64 val)
+{
+	uint64 res = 0;
+	uint64 bit = (uint64)1 << 62;
+
+	while(bit > val)
+	{
+		bit >>= 2;
+	}
+	while(bit != 0)
+	{
+		if(val >= res + bit)
+		{
+			val -= res + bit;
+			res = (res >> 1) + bit;
+		} else {
+			res >>= 1;
+		}
+		bit >>= 2;
+	}
+	return (uint32)res;
+}
+
+void Stat_Clear(struct StatAccu *pAccu)
+{
+	memset(pAccu, 0, sizeof(struct StatAccu));
+}
+
+void Stat_AccumulateRows(struct StatAccu *pAccu,
+			 const uint8 *pImg,
+			 uint32 width,
+			 uint32 height,
+			 uint32 yStart,
+			 uint32 yEnd,
+			 const struct StatRoi *pRois)
+{
+	uint32 i, y, y0, y1, x1;
+
+	yEnd = MIN(yEnd, height);
+	if(yStart >= yEnd)
+	{
+		return;
+	}
+
+	/* The rows are contiguous, so the histogram covers them in one go. */
+	Stat_HistRow(pAccu->hist, pImg + yStart*width, (yEnd - yStart)*width);
+
+	for(i = 0; i < STAT_MAX_ROIS; i++)
+	{
+		if(!Stat_ClipRoi(&pRois[i], width, height, &x1, &y1))
+		{
+			continue;
+		}
+		y0 = MAX((uint32)pRois[i].y, yStart);
+		y1 = MIN(y1, yEnd);
+		for(y = y0; y < y1; y++)
+		{
+			pAccu->roiSum[i] += Stat_SumRow(pImg + y*width + pRois[i].x,
+							x1 - pRois[i].x);
+		}
+	}
+}
+
+void Stat_Merge(struct StatAccu *pDst, const struct StatAccu *pSrc)
+{
+	uint32 i, lane;
+
+	for(lane = 0; lane < 4; lane++)
+	{
+		for(i = 0; i < STAT_HIST_BINS; i++)
+		{
+			pDst->hist[lane][i] += pSrc->hist[lane][i];
+		}
+	}
+	for(i = 0; i < STAT_MAX_ROIS; i++)
+	{
+		pDst->roiSum[i] += pSrc->roiSum[i];
+	}
+}
+
+void Stat_Finish(struct FeedStats *pStats,
+		 const struct StatAccu *pAccu,
+		 uint32 width,
+		 uint32 height,
+		 const struct StatRoi *pRois)
+{
+	uint32 i, cnt, maxCnt = 0, x1, y1, area;
+	uint32 nPix = width*height;
+	uint64 sum = 0, sumSq = 0, mean, meanSq;
+
+	memset(pStats, 0, sizeof(struct FeedStats));
+	if(nPix == 0)
+	{
+		return;
+	}
+
+	pStats->minVal = STAT_HIST_BINS - 1;
+	for(i = 0; i < STAT_HIST_BINS; i++)
+	{
+		cnt = pAccu->hist[0][i] + pAccu->hist[1][i] +
+			pAccu->hist[2][i] + pAccu->hist[3][i];
+		if(cnt == 0)
+		{
+			continue;
+		}
+		if(i < pStats->minVal)
+		{
+			pStats->minVal = i;
+		}
+		pStats->maxVal = i;
+		maxCnt = MAX(maxCnt, cnt);
+		sum += (uint64)cnt*i;
+		sumSq += (uint64)cnt*i*i;
+	}
+
+	/* Mean in 8.8 and mean square in 16.16 fixed point. */
+	mean = (sum << 8)/nPix;
+	meanSq = (sumSq << 16)/nPix;
+	pStats->mean = (uint16)mean;
+	pStats->stdDev = (uint16)Stat_Sqrt(meanSq > mean*mean ? meanSq - mean*mean : 0);
+
+	while((maxCnt >> pStats->histShift) > 0xffff)
+	{
+		pStats->histShift++;
+	}
+	for(i = 0; i < STAT_HIST_BINS; i++)
+	{
+		cnt = pAccu->hist[0][i] + pAccu->hist[1][i] +
+			pAccu->hist[2][i] + pAccu->hist[3][i];
+		pStats->hist[i] = (uint16)(cnt >> pStats->histShift);
+	}
+
+	for(i = 0; i < STAT_MAX_ROIS; i++)
+	{
+		if(!Stat_ClipRoi(&pRois[i], width, height, &x1, &y1))
+		{
+			continue;
+		}
+		area = (x1 - pRois[i].x)*(y1 - pRois[i].y);
+		pStats->roiMean[i] = (uint16)((((uint64)pAccu->roiSum[i]) << 8)/area);
+		pStats->roiMask |= 1 << i;
+	}
+}
+
+/*! @brief Arguments of the tiles of Stat_Compute. */
+struct StatJob
+{
+	/*! @brief One set of intermediate sums per worker. */
+	struct StatAccu *pAccus;
+	/*! @brief The image. */
+	const uint8 *pImg;
+	/*! @brief Width of the image. */
+	uint32 width;
+	/*! @brief Height of the image. */
+	uint32 height;
+	/*! @brief The regions of interest. */
+	const struct StatRoi *pRois;
+};
+
+/*********************************************************************//*!
+ * @brief Accumulate one tile into the sums of the worker.
+ *
+ * @param pArg Pointer to the StatJob.
+ * @param worker Index of the worker.
+ * @param yStart First row of the tile.
+ * @param yEnd Row after the last row of the tile.
+ *//*********************************************************************/
+static void Stat_Tile(void *pArg, uint32 worker, uint32 yStart, uint32 yEnd)
+{
+	struct StatJob *pJob = (struct StatJob*)pArg;
+
+	Stat_AccumulateRows(&pJob->pAccus[worker], pJob->pImg, pJob->width,
+			    pJob->height, yStart, yEnd, pJob->pRois);
+}
+
+void Stat_Compute(struct FeedStats *pStats,
+		  struct StatAccu *pAccus,
+		  const uint8 *pImg,
+		  uint32 width,
+		  uint32 height,
+		  const struct StatRoi *pRois)
+{
+	struct StatJob job;
+	struct TileJob tiles;
+	uint32 i, nWorkers = Pool_Workers();
+
+	for(i = 0; i < nWorkers; i++)
+	{
+		Stat_Clear(&pAccus[i]);
+	}
+
+	job.pAccus = pAccus;
+	job.pImg = pImg;
+	job.width = width;
+	job.height = height;
+	job.pRois = pRois;
+	tiles.pfTile = Stat_Tile;
+	tiles.pArg = &job;
+	tiles.nRows = height;
+	tiles.tileRows = STAT_TILE_ROWS;
+	Pool_Run(&tiles);
+
+	for(i = 1; i < nWorkers; i++)
+	{
+		Stat_Merge(&pAccus[0], &pAccus[i]);
+	}
+	Stat_Finish(pStats, &pAccus[0], width, height, pRois);
+}
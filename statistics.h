@@ -0,0 +1,162 @@
+/*	Target side application for the Rich Viewer.
+	Copyright (C) 2008 Supercomputing Systems AG
+
+	This library is free software; you can redistribute it and/or modify it
+	under the terms of the GNU Lesser General Public License as published by
+	the Free Software Foundation; either version 2.1 of the License, or (at
+	your option) any later version.
+
+	This library is distributed in the hope that it will be useful, but
+	WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser
+	General Public License for more details.
+
+	You should have received a copy of the GNU Lesser General Public License
+	along with this library; if not, write to the Free Software Foundation,
+	Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+/*! @file statistics.h
+ * @brief Per-frame image statistics (histogram, min/max/mean, ROI means).
+ *
+ * The statistics record is small enough to be sent over the feed for
+ * every frame instead of the image itself.
+ */
+
+#ifndef STATISTICS_H
+#define STATISTICS_H
+
+#include "inc/oscar.h"
+#include "workpool.h"
+
+/*! @brief Number of bins of the brightness histogram. */
+#define STAT_HIST_BINS 256
+/*! @brief Maximum number of regions of interest a mean is computed for. */
+#define STAT_MAX_ROIS 4
+
+/*! @brief A rectangular region of interest in pixel coordinates. */
+struct StatRoi
+{
+	/*! @brief Column of the upper left corner. */
+	uint16 x;
+	/*! @brief Row of the upper left corner. */
+	uint16 y;
+	/*! @brief Width of the region. A region with no area is disabled. */
+	uint16 width;
+	/*! @brief Height of the region. */
+	uint16 height;
+};
+
+/*! @brief The statistics record sent over the feed (MSG_FEED_STATS).
+ *
+ * All mean and deviation values are 8.8 fixed point numbers. The histogram
+ * bins hold the pixel counts shifted right by histShift so they fit into
+ * 16 bits. */
+struct FeedStats
+{
+	/*! @brief Smallest pixel value in the image. */
+	uint16 minVal;
+	/*! @brief Largest pixel value in the image. */
+	uint16 maxVal;
+	/*! @brief Mean pixel value (8.8 fixed point). */
+	uint16 mean;
+	/*! @brief Standard deviation of the pixel values (8.8 fixed point). */
+	uint16 stdDev;
+	/*! @brief Bit i is set if roiMean[i] is valid. */
+	uint16 roiMask;
+	/*! @brief Number of bits the histogram counts are shifted right. */
+	uint16 histShift;
+	/*! @brief Mean pixel value of each region of interest (8.8 fixed
+	  point). */
+	uint16 roiMean[STAT_MAX_ROIS];
+	/*! @brief Brightness histogram. */
+	uint16 hist[STAT_HIST_BINS];
+};
+
+/*! @brief Intermediate sums of the statistics kernels.
+ *
+ * Partial results of different image strips can be merged, so the
+ * image may be processed in pieces. */
+struct StatAccu
+{
+	/*! @brief Partial histograms, one per byte lane of a 32 bit word. */
+	uint32 hist[4][STAT_HIST_BINS];
+	/*! @brief Sum of all pixel values within each region of interest. */
+	uint32 roiSum[STAT_MAX_ROIS];
+};
+
+/*********************************************************************//*!
+ * @brief Reset the intermediate sums.
+ *
+ * @param pAccu Pointer to the intermediate sums.
+ *//*********************************************************************/
+void Stat_Clear(struct StatAccu *pAccu);
+
+/*********************************************************************//*!
+ * @brief Accumulate the statistics of a range of image rows.
+ *
+ * The rows are read 32 bits at a time; the histogram is split into one
+ * partial histogram per byte lane and the ROI sums are built with two
+ * 16 bit lanes per word.
+ *
+ * @param pAccu Pointer to the intermediate sums.
+ * @param pImg Pointer to the first pixel of the image.
+ * @param width Width of the image (equals the row stride).
+ * @param height Height of the image.
+ * @param yStart First row to process.
+ * @param yEnd Row after the last row to process.
+ * @param pRois Array of STAT_MAX_ROIS regions of interest.
+ *//*********************************************************************/
+void Stat_AccumulateRows(struct StatAccu *pAccu,
+			 const uint8 *pImg,
+			 uint32 width,
+			 uint32 height,
+			 uint32 yStart,
+			 uint32 yEnd,
+			 const struct StatRoi *pRois);
+
+/*********************************************************************//*!
+ * @brief Add the intermediate sums of pSrc to pDst.
+ *
+ * @param pDst Pointer to the sums to add to.
+ * @param pSrc Pointer to the sums to be added.
+ *//*********************************************************************/
+void Stat_Merge(struct StatAccu *pDst, const struct StatAccu *pSrc);
+
+/*********************************************************************//*!
+ * @brief Build the statistics record from the intermediate sums.
+ *
+ * @param pStats Pointer to the record to be filled out.
+ * @param pAccu Pointer to the sums of the whole image.
+ * @param width Width of the image.
+ * @param height Height of the image.
+ * @param pRois Array of STAT_MAX_ROIS regions of interest.
+ *//*********************************************************************/
+void Stat_Finish(struct FeedStats *pStats,
+		 const struct StatAccu *pAccu,
+		 uint32 width,
+		 uint32 height,
+		 const struct StatRoi *pRois);
+
+/*********************************************************************//*!
+ * @brief Compute the statistics record of a whole image.
+ *
+ * The image is split into strips that are accumulated by the worker pool
+ * and merged afterwards.
+ *
+ * @param pStats Pointer to the record to be filled out.
+ * @param pAccus Array of POOL_MAX_WORKERS intermediate sums used as
+ *               scratch space.
+ * @param pImg Pointer to the image (8 bit per pixel).
+ * @param width Width of the image.
+ * @param height Height of the image.
+ * @param pRois Array of STAT_MAX_ROIS regions of interest.
+ *//*********************************************************************/
+void Stat_Compute(struct FeedStats *pStats,
+		  struct StatAccu *pAccus,
+		  const uint8 *pImg,
+		  uint32 width,
+		  uint32 height,
+		  const struct StatRoi *pRois);
+
+#endif /* STATISTICS_H */
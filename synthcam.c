@@ -0,0 +1,247 @@
+/*	Target side application for the Rich Viewer.
+	Copyright (C) 2008 Supercomputing Systems AG
+
+	This library is free software; you can redistribute it and/or modify it
+	under the terms of the GNU Lesser General Public License as published by
+	the Free Software Foundation; either version 2.1 of the License, or (at
+	your option) any later version.
+
+	This library is distributed in the hope that it will be useful, but
+	WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser
+	General Public License for more details.
+
+	You should have received a copy of the GNU Lesser General Public License
+	along with this library; if not, write to the Free Software Foundation,
+	Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+/*! @file synthcam.c
+ * @brief Synthetic frame source implementation.
+ */
+
+#include "synthcam.h"
+#include "timing.h"
+#include <string.h>
+#include <unistd.h>
+
+/*! @brief Edge length of the squares of the static scene (power of
+  two). */
+#define SYNTH_SQUARE 32
+
+/*********************************************************************//*!
+ * @brief Generate a frame of the moving gradient.
+ *
+ * @param pSynth Pointer to the synthetic source.
+ * @param pImg The frame buffer.
+ *//*********************************************************************/
+static void Synth_Gradient(const struct SynthCam *pSynth, uint8 *pImg)
+{
+	uint32 x, y;
+	uint8 val;
+
+	for(y = 0; y < pSynth->height; y++)
+	{
+		val = (uint8)(y + 2*pSynth->frameNr);
+		for(x = 0; x < pSynth->width; x++)
+		{
+			*pImg++ = val++;
+		}
+	}
+}
+
+/*********************************************************************//*!
+ * @brief Generate a frame of noise.
+ *
+ * Uses a xorshift generator producing four pixels per step.
+ *
+ * @param pSynth Pointer to the synthetic source.
+ * @param pImg The frame buffer.
+ *//*********************************************************************/
+static void Synth_Noise(struct SynthCam *pSynth, uint8 *pImg)
+{
+	uint32 i, n = pSynth->width*pSynth->height;
+	uint32 s = pSynth->noiseState;
+
+	for(i = 0; i + 4 <= n; i += 4)
+	{
+		s ^= s << 13;
+		s ^= s >> 17;
+		s ^= s << 5;
+		pImg[i] = (uint8)s;
+		pImg[i + 1] = (uint8)(s >> 8);
+		pImg[i + 2] = (uint8)(s >> 16);
+		pImg[i + 3] = (uint8)(s >> 24);
+	}
+	for(; i < n; i++)
+	{
+		pImg[i] = (uint8)(s >> (8*(i & 3)));
+	}
+	pSynth->noiseState = s;
+}
+
+/*********************************************************************//*!
+ * @brief Generate a frame of the static scene.
+ *
+ * A checkerboard of dark and bright squares with a gradient in each, so
+ * there are edges as well as smooth areas.
+ *
+ * @param pSynth Pointer to the synthetic source.
+ * @param pImg The frame buffer.
+ *//*********************************************************************/
+static void Synth_Static(const struct SynthCam *pSynth, uint8 *pImg)
+{
+	uint32 x, y;
+	uint8 base;
+
+	for(y = 0; y < pSynth->height; y++)
+	{
+		for(x = 0; x < pSynth->width; x++)
+		{
+			base = ((x / SYNTH_SQUARE) ^ (y / SYNTH_SQUARE)) & 1 ? 0xa0 : 0x20;
+			*pImg++ = base + (uint8)((x + y) & (2*SYNTH_SQUARE - 1));
+		}
+	}
+}
+
+void Synth_Init(struct SynthCam *pSynth, uint32 width, uint32 height, uint32 pixFmt)
+{
+	memset(pSynth, 0, sizeof(struct SynthCam));
+	pSynth->width = width;
+	pSynth->height = height;
+	pSynth->pixFmt = pixFmt;
+	pSynth->noiseState = 2463534242u;
+}
+
+OSC_ERR Synth_AddFrameBuffer(struct SynthCam *pSynth, uint8 *pBuf, uint32 size)
+{
+	if(pSynth->nBuffers == SYNTH_MAX_BUFFERS)
+	{
+		return -EOUT_OF_MEMORY;
+	}
+	if(pSynth->nBuffers == 0 || size < pSynth->bufSize)
+	{
+		pSynth->bufSize = size;
+	}
+	pSynth->pBuffers[pSynth->nBuffers++] = pBuf;
+	return SUCCESS;
+}
+
+void Synth_ClearFrameBuffers(struct SynthCam *pSynth)
+{
+	pSynth->nBuffers = 0;
+	pSynth->nextBuf = 0;
+	pSynth->bufSize = 0;
+	pSynth->bSetUp = FALSE;
+	pSynth->bTriggered = FALSE;
+}
+
+OSC_ERR Synth_SetPattern(struct SynthCam *pSynth, uint32 pattern)
+{
+	if(pattern >= SYNTH_PATTERN_COUNT)
+	{
+		return -EINVALID_PARAMETER;
+	}
+	pSynth->pattern = pattern;
+	pSynth->bSetUp = FALSE;
+	pSynth->bTriggered = FALSE;
+	return SUCCESS;
+}
+
+OSC_ERR Synth_SetSize(struct SynthCam *pSynth, uint32 width, uint32 height)
+{
+	/* Even, so the Bayer pattern and the renditions are complete. */
+	if(width == 0 || height == 0 || (width & 1) || (height & 1) ||
+	   width*height > pSynth->bufSize)
+	{
+		return -EINVALID_PARAMETER;
+	}
+	pSynth->width = width;
+	pSynth->height = height;
+	return SUCCESS;
+}
+
+void Synth_SetRate(struct SynthCam *pSynth, uint32 milliHz)
+{
+	if(milliHz == 0)
+	{
+		pSynth->periodCyc = 0;
+	} else {
+		pSynth->periodCyc = Timing_UsToCyc(1000000)*1000/milliHz;
+	}
+	pSynth->nextCyc = 0;
+}
+
+OSC_ERR Synth_SetupCapture(struct SynthCam *pSynth)
+{
+	pSynth->bSetUp = TRUE;
+	pSynth->bTriggered = FALSE;
+	return SUCCESS;
+}
+
+void Synth_Trigger(struct SynthCam *pSynth)
+{
+	pSynth->bTriggered = pSynth->bSetUp;
+}
+
+OSC_ERR Synth_ReadPicture(struct SynthCam *pSynth, uint8 **ppPic, uint32 timeout_ms)
+{
+	uint64 now, waitCyc;
+	uint8 *pImg;
+
+	if(!pSynth->bSetUp || pSynth->nBuffers == 0)
+	{
+		return -ENO_CAPTURE_STARTED;
+	}
+
+	if(pSynth->periodCyc == 0)
+	{
+		if(!pSynth->bTriggered)
+		{
+			usleep(timeout_ms*1000);
+			return -ETIMEOUT;
+		}
+	} else {
+		now = OscSupCycGet64();
+		if(pSynth->nextCyc == 0)
+		{
+			pSynth->nextCyc = now;
+		}
+		if(pSynth->nextCyc > now)
+		{
+			waitCyc = pSynth->nextCyc - now;
+			if(waitCyc > Timing_UsToCyc(timeout_ms*1000))
+			{
+				usleep(timeout_ms*1000);
+				return -ETIMEOUT;
+			}
+			usleep(Timing_CycToUs(waitCyc));
+		} else if(now - pSynth->nextCyc > pSynth->periodCyc)
+		{
+			/* The frames were not read in time; like a camera, the
+			 * source does not catch up on the missed ones. */
+			pSynth->nextCyc = now;
+		}
+		pSynth->nextCyc += pSynth->periodCyc;
+	}
+
+	pImg = pSynth->pBuffers[pSynth->nextBuf];
+	pSynth->nextBuf = (pSynth->nextBuf + 1) % pSynth->nBuffers;
+	switch(pSynth->pattern)
+	{
+	case SYNTH_GRADIENT:
+		Synth_Gradient(pSynth, pImg);
+		break;
+	case SYNTH_NOISE:
+		Synth_Noise(pSynth, pImg);
+		break;
+	default:
+		Synth_Static(pSynth, pImg);
+	}
+	pSynth->frameNr++;
+	pSynth->bSetUp = FALSE;
+	pSynth->bTriggered = FALSE;
+
+	*ppPic = pImg;
+	return SUCCESS;
+}
@@ -0,0 +1,183 @@
+/*	Target side application for the Rich Viewer.
+	Copyright (C) 2008 Supercomputing Systems AG
+
+	This library is free software; you can redistribute it and/or modify it
+	under the terms of the GNU Lesser General Public License as published by
+	the Free Software Foundation; either version 2.1 of the License, or (at
+	your option) any later version.
+
+	This library is distributed in the hope that it will be useful, but
+	WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser
+	General Public License for more details.
+
+	You should have received a copy of the GNU Lesser General Public License
+	along with this library; if not, write to the Free Software Foundation,
+	Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+/*! @file synthcam.h
+ * @brief Synthetic frame source replacing the camera, e.g. to benchmark
+ * the processing and the feed on the host without image files.
+ *
+ * The source mimics the capture interface of the framework: A capture is
+ * set up, triggered and read into the frame buffers in turn. The content
+ * of the frames is generated with known properties:
+ * - SYNTH_GRADIENT: A diagonal gradient moving by two pixels per frame
+ *   (smooth, but every pixel changes from frame to frame).
+ * - SYNTH_NOISE: Uniform random pixels (8 bits of entropy per pixel).
+ * - SYNTH_STATIC: The same checkerboard scene in every frame.
+ *
+ * With a rate of 0, a frame is delivered as soon as the capture is
+ * triggered. With a rate set, the source is free running like a camera
+ * with an external trigger and delivers a frame every period, whether it
+ * is triggered or not.
+ */
+
+#ifndef SYNTHCAM_H
+#define SYNTHCAM_H
+
+#include "inc/oscar.h"
+
+/*! @brief Maximum number of frame buffers of the synthetic source. */
+#define SYNTH_MAX_BUFFERS 4
+
+/*! @brief Content of the synthetic frames. */
+enum EnSynthPattern
+{
+	/*! @brief Synthetic source disabled, the camera is used. */
+	SYNTH_OFF,
+	/*! @brief Moving gradient. */
+	SYNTH_GRADIENT,
+	/*! @brief Random noise. */
+	SYNTH_NOISE,
+	/*! @brief Static scene. */
+	SYNTH_STATIC,
+	/*! @brief Number of patterns. */
+	SYNTH_PATTERN_COUNT
+};
+
+/*! @brief State of the synthetic frame source. */
+struct SynthCam
+{
+	/*! @brief Content of the frames (EnSynthPattern). */
+	uint32 pattern;
+	/*! @brief Width of the frames. */
+	uint32 width;
+	/*! @brief Height of the frames. */
+	uint32 height;
+	/*! @brief Pixel format of the frames (V4L2_PIX_FMT_*); the content
+	  is the same for all formats. */
+	uint32 pixFmt;
+	/*! @brief Period of the frames in cycles or 0 to deliver a frame
+	  on every trigger. */
+	uint64 periodCyc;
+
+	/*! @brief The frame buffers. */
+	uint8 *pBuffers[SYNTH_MAX_BUFFERS];
+	/*! @brief Size of the smallest frame buffer. */
+	uint32 bufSize;
+	/*! @brief Number of frame buffers. */
+	uint32 nBuffers;
+	/*! @brief Index of the frame buffer the next frame goes to. */
+	uint32 nextBuf;
+
+	/*! @brief TRUE if a capture has been set up. */
+	bool bSetUp;
+	/*! @brief TRUE if the capture has been triggered. */
+	bool bTriggered;
+	/*! @brief Cycle count at which the next frame is due if free
+	  running. */
+	uint64 nextCyc;
+	/*! @brief Number of frames generated. */
+	uint32 frameNr;
+	/*! @brief State of the noise generator. */
+	uint32 noiseState;
+};
+
+/*! @brief Check whether the synthetic source replaces the camera. */
+#define Synth_Enabled(pSynth) ((pSynth)->pattern != SYNTH_OFF)
+
+/*********************************************************************//*!
+ * @brief Initialize a disabled synthetic source without frame buffers.
+ *
+ * @param pSynth Pointer to the synthetic source.
+ * @param width Initial frame width.
+ * @param height Initial frame height.
+ * @param pixFmt Initial pixel format.
+ *//*********************************************************************/
+void Synth_Init(struct SynthCam *pSynth, uint32 width, uint32 height, uint32 pixFmt);
+
+/*********************************************************************//*!
+ * @brief Add a frame buffer the frames are generated into.
+ *
+ * The frame buffers are used in the order they have been added.
+ *
+ * @param pSynth Pointer to the synthetic source.
+ * @param pBuf The frame buffer.
+ * @param size Size of the frame buffer.
+ * @return SUCCESS or -EOUT_OF_MEMORY if there are too many buffers.
+ *//*********************************************************************/
+OSC_ERR Synth_AddFrameBuffer(struct SynthCam *pSynth, uint8 *pBuf, uint32 size);
+
+/*********************************************************************//*!
+ * @brief Remove all frame buffers, e.g. before they are freed.
+ *
+ * @param pSynth Pointer to the synthetic source.
+ *//*********************************************************************/
+void Synth_ClearFrameBuffers(struct SynthCam *pSynth);
+
+/*********************************************************************//*!
+ * @brief Select the content of the frames.
+ *
+ * @param pSynth Pointer to the synthetic source.
+ * @param pattern The pattern (EnSynthPattern), SYNTH_OFF to disable.
+ * @return SUCCESS or -EINVALID_PARAMETER.
+ *//*********************************************************************/
+OSC_ERR Synth_SetPattern(struct SynthCam *pSynth, uint32 pattern);
+
+/*********************************************************************//*!
+ * @brief Set the size of the frames.
+ *
+ * @param pSynth Pointer to the synthetic source.
+ * @param width Width (even).
+ * @param height Height (even).
+ * @return SUCCESS or -EINVALID_PARAMETER if the frames would not fit
+ *         into the frame buffers.
+ *//*********************************************************************/
+OSC_ERR Synth_SetSize(struct SynthCam *pSynth, uint32 width, uint32 height);
+
+/*********************************************************************//*!
+ * @brief Set the frame rate of the free running source.
+ *
+ * @param pSynth Pointer to the synthetic source.
+ * @param milliHz Frames per 1000 s, or 0 to deliver a frame per trigger.
+ *//*********************************************************************/
+void Synth_SetRate(struct SynthCam *pSynth, uint32 milliHz);
+
+/*********************************************************************//*!
+ * @brief Set up the capture of the next frame.
+ *
+ * @param pSynth Pointer to the synthetic source.
+ * @return SUCCESS
+ *//*********************************************************************/
+OSC_ERR Synth_SetupCapture(struct SynthCam *pSynth);
+
+/*********************************************************************//*!
+ * @brief Trigger the capture set up.
+ *
+ * @param pSynth Pointer to the synthetic source.
+ *//*********************************************************************/
+void Synth_Trigger(struct SynthCam *pSynth);
+
+/*********************************************************************//*!
+ * @brief Wait for the frame of the capture set up and generate it.
+ *
+ * @param pSynth Pointer to the synthetic source.
+ * @param ppPic The frame buffer holding the frame.
+ * @param timeout_ms Longest time to wait for the frame (ms).
+ * @return SUCCESS, -ETIMEOUT or -ENO_CAPTURE_STARTED.
+ *//*********************************************************************/
+OSC_ERR Synth_ReadPicture(struct SynthCam *pSynth, uint8 **ppPic, uint32 timeout_ms);
+
+#endif /* SYNTHCAM_H */
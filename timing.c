@@ -0,0 +1,161 @@
+/*	Target side application for the Rich Viewer.
+	Copyright (C) 2008 Supercomputing Systems AG
+
+	This library is free software; you can redistribute it and/or modify it
+	under the terms of the GNU Lesser General Public License as published by
+	the Free Software Foundation; either version 2.1 of the License, or (at
+	your option) any later version.
+
+	This library is distributed in the hope that it will be useful, but
+	WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser
+	General Public License for more details.
+
+	You should have received a copy of the GNU Lesser General Public License
+	along with this library; if not, write to the Free Software Foundation,
+	Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+/*! @file timing.c
+ * @brief Cycle counter based time measurement implementation.
+ */
+
+#include "timing.h"
+
+/*! @brief Number of cycles used to determine the counter frequency. */
+#define CALIB_CYCLES 1000000
+
+/*! @brief Frequency of the cycle counter (cycles per second). */
+static uint64 cycPerSec = 1000000;
+
+void Timing_Init(void)
+{
+	uint32 us = OscSupCycToMicroSecs(CALIB_CYCLES);
+
+	if(us != 0)
+	{
+		cycPerSec = ((uint64)CALIB_CYCLES*1000000)/us;
+	}
+}
+
+uint32 Timing_CycToUs(uint64 cyc)
+{
+	return (uint32)((cyc*1000000)/cycPerSec);
+}
+
+uint64 Timing_UsToCyc(uint32 us)
+{
+	return ((uint64)us*cycPerSec)/1000000;
+}
+
+bool Timing_RateMark(struct RateMeter *pMeter, uint64 now)
+{
+	uint32 elapsedUs;
+
+	if(pMeter->windowStart == 0)
+	{
+		pMeter->windowStart = now;
+		return FALSE;
+	}
+
+	pMeter->count++;
+	elapsedUs = Timing_CycToUs(now - pMeter->windowStart);
+	if(elapsedUs < RATE_WINDOW_MS*1000)
+	{
+		return FALSE;
+	}
+
+	pMeter->milliHz = (uint32)(((uint64)pMeter->count*1000000000)/elapsedUs);
+	pMeter->count = 0;
+	pMeter->windowStart = now;
+	return TRUE;
+}
+
+void Timing_DevAdd(struct DevStat *pStat, uint64 actual, uint64 planned)
+{
+	uint32 devUs;
+
+	if(actual >= planned)
+	{
+		devUs = Timing_CycToUs(actual - planned);
+	} else {
+		devUs = Timing_CycToUs(planned - actual);
+	}
+
+	pStat->count++;
+	pStat->sumUs += devUs;
+	if(devUs > pStat->maxUs)
+	{
+		pStat->maxUs = devUs;
+	}
+}
+
+uint32 Timing_DevMean(const struct DevStat *pStat)
+{
+	if(pStat->count == 0)
+	{
+		return 0;
+	}
+	return pStat->sumUs/pStat->count;
+}
+
+void Timing_BucketSetup(struct TokenBucket *pBucket, uint32 rate, uint32 burst)
+{
+	pBucket->rate = rate;
+	pBucket->burst = burst == 0 ? 1 : burst;
+	pBucket->tokens = pBucket->burst;
+	pBucket->lastCyc = 0;
+}
+
+uint32 Timing_BucketFill(struct TokenBucket *pBucket, uint64 now)
+{
+	uint64 add, elapsed;
+
+	if(pBucket->rate == 0)
+	{
+		return 0xffffffff;
+	}
+	if(pBucket->lastCyc == 0 || now < pBucket->lastCyc)
+	{
+		pBucket->lastCyc = now;
+		return pBucket->tokens;
+	}
+
+	/* Long enough to fill any bucket, short enough not to overflow. */
+	elapsed = now - pBucket->lastCyc;
+	if(elapsed > Timing_UsToCyc(1000000000))
+	{
+		elapsed = Timing_UsToCyc(1000000000);
+	}
+	add = ((uint64)Timing_CycToUs(elapsed)*pBucket->rate)/1000000;
+	if(pBucket->tokens + add >= pBucket->burst)
+	{
+		pBucket->tokens = pBucket->burst;
+		pBucket->lastCyc = now;
+	} else if(add != 0)
+	{
+		/* Only the time the tokens added took is used up, so the
+		 * fractions of tokens are not lost. */
+		pBucket->tokens += (uint32)add;
+		pBucket->lastCyc += Timing_UsToCyc((uint32)((add*1000000)/pBucket->rate));
+	}
+	return pBucket->tokens;
+}
+
+void Timing_BucketTake(struct TokenBucket *pBucket, uint32 n)
+{
+	if(n > pBucket->tokens)
+	{
+		n = pBucket->tokens;
+	}
+	pBucket->tokens -= n;
+}
+
+uint32 Timing_BucketWaitUs(const struct TokenBucket *pBucket, uint32 n)
+{
+	if(pBucket->rate == 0 || pBucket->tokens >= n)
+	{
+		return 0;
+	}
+	return (uint32)(((uint64)(n - pBucket->tokens)*1000000 + pBucket->rate - 1)/pBucket->rate);
+}
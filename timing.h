@@ -0,0 +1,154 @@
+/*	Target side application for the Rich Viewer.
+	Copyright (C) 2008 Supercomputing Systems AG
+
+	This library is free software; you can redistribute it and/or modify it
+	under the terms of the GNU Lesser General Public License as published by
+	the Free Software Foundation; either version 2.1 of the License, or (at
+	your option) any later version.
+
+	This library is distributed in the hope that it will be useful, but
+	WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser
+	General Public License for more details.
+
+	You should have received a copy of the GNU Lesser General Public License
+	along with this library; if not, write to the Free Software Foundation,
+	Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+/*! @file timing.h
+ * @brief Cycle counter based time measurement.
+ */
+
+#ifndef TIMING_H
+#define TIMING_H
+
+#include "inc/oscar.h"
+
+/*! @brief Length of the window a rate is averaged over (ms). */
+#define RATE_WINDOW_MS 2000
+
+/*! @brief Measures the rate of a recurring event. */
+struct RateMeter
+{
+	/*! @brief Cycle count at the start of the current window. */
+	uint64 windowStart;
+	/*! @brief Number of events in the current window. */
+	uint32 count;
+	/*! @brief Rate of the last completed window in events per 1000 s. */
+	uint32 milliHz;
+};
+
+/*! @brief Statistics of the deviations of events from their schedule. */
+struct DevStat
+{
+	/*! @brief Number of deviations recorded. */
+	uint32 count;
+	/*! @brief Sum of the absolute deviations (us). */
+	uint32 sumUs;
+	/*! @brief Largest absolute deviation (us). */
+	uint32 maxUs;
+};
+
+/*! @brief Token bucket limiting the rate of a resource, e.g. bytes
+  sent. */
+struct TokenBucket
+{
+	/*! @brief Tokens added per second, 0 for no limit. */
+	uint32 rate;
+	/*! @brief Largest number of tokens held (burst size). */
+	uint32 burst;
+	/*! @brief Number of tokens held. */
+	uint32 tokens;
+	/*! @brief Cycle count up to which tokens have been added, 0 if
+	  none yet. */
+	uint64 lastCyc;
+};
+
+/*********************************************************************//*!
+ * @brief Determine the frequency of the cycle counter.
+ *
+ * Has to be called once before any other function of this module is used.
+ *//*********************************************************************/
+void Timing_Init(void);
+
+/*********************************************************************//*!
+ * @brief Convert a number of cycles to microseconds.
+ *
+ * @param cyc Number of cycles.
+ * @return Number of microseconds.
+ *//*********************************************************************/
+uint32 Timing_CycToUs(uint64 cyc);
+
+/*********************************************************************//*!
+ * @brief Convert microseconds to a number of cycles.
+ *
+ * @param us Number of microseconds.
+ * @return Number of cycles.
+ *//*********************************************************************/
+uint64 Timing_UsToCyc(uint32 us);
+
+/*********************************************************************//*!
+ * @brief Count an event of a rate meter.
+ *
+ * @param pMeter Pointer to the rate meter.
+ * @param now Current cycle count.
+ * @return TRUE if a window has completed and pMeter->milliHz is new.
+ *//*********************************************************************/
+bool Timing_RateMark(struct RateMeter *pMeter, uint64 now);
+
+/*********************************************************************//*!
+ * @brief Record the deviation of an event from its schedule.
+ *
+ * @param pStat Pointer to the deviation statistics.
+ * @param actual Cycle count at which the event happened.
+ * @param planned Cycle count at which the event was planned.
+ *//*********************************************************************/
+void Timing_DevAdd(struct DevStat *pStat, uint64 actual, uint64 planned);
+
+/*********************************************************************//*!
+ * @brief Get the mean absolute deviation.
+ *
+ * @param pStat Pointer to the deviation statistics.
+ * @return The mean absolute deviation (us) or 0 if none was recorded.
+ *//*********************************************************************/
+uint32 Timing_DevMean(const struct DevStat *pStat);
+
+/*********************************************************************//*!
+ * @brief Set the rate and the burst size of a token bucket and fill it.
+ *
+ * @param pBucket Pointer to the token bucket.
+ * @param rate Tokens per second, 0 for no limit.
+ * @param burst Largest number of tokens held (at least 1).
+ *//*********************************************************************/
+void Timing_BucketSetup(struct TokenBucket *pBucket, uint32 rate, uint32 burst);
+
+/*********************************************************************//*!
+ * @brief Add the tokens accrued since the last call.
+ *
+ * @param pBucket Pointer to the token bucket.
+ * @param now Current cycle count.
+ * @return Number of tokens held, 0xffffffff if there is no limit.
+ *//*********************************************************************/
+uint32 Timing_BucketFill(struct TokenBucket *pBucket, uint64 now);
+
+/*********************************************************************//*!
+ * @brief Take tokens out of the bucket.
+ *
+ * @param pBucket Pointer to the token bucket.
+ * @param n Number of tokens, more than held empties the bucket.
+ *//*********************************************************************/
+void Timing_BucketTake(struct TokenBucket *pBucket, uint32 n);
+
+/*********************************************************************//*!
+ * @brief Get the time until a number of tokens are held.
+ *
+ * Counts from the last Timing_BucketFill.
+ *
+ * @param pBucket Pointer to the token bucket.
+ * @param n Number of tokens (at most the burst size).
+ * @return The time (us), 0 if the tokens are held or there is no limit.
+ *//*********************************************************************/
+uint32 Timing_BucketWaitUs(const struct TokenBucket *pBucket, uint32 n);
+
+#endif /* TIMING_H */
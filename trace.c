@@ -0,0 +1,39 @@
+/*	Target side application for the Rich Viewer.
+	Copyright (C) 2008 Supercomputing Systems AG
+
+	This library is free software; you can redistribute it and/or modify it
+	under the terms of the GNU Lesser General Public License as published by
+	the Free Software Foundation; either version 2.1 of the License, or (at
+	your option) any later version.
+
+	This library is distributed in the hope that it will be useful, but
+	WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser
+	General Public License for more details.
+
+	You should have received a copy of the GNU Lesser General Public License
+	along with this library; if not, write to the Free Software Foundation,
+	Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+/*! @file trace.c
+ * @brief Event trace implementation.
+ */
+
+#include "trace.h"
+
+struct TraceRing traceRing;
+
+uint32 Trace_Dump(struct TraceRec *pRecs)
+{
+	uint32 i, n, first;
+
+	n = traceRing.bFull ? TRACE_LEN : traceRing.nRecs;
+	/* Modulo 2^32, like nRecs. */
+	first = traceRing.nRecs - n;
+	for(i = 0; i < n; i++)
+	{
+		pRecs[i] = traceRing.recs[(first + i) & (TRACE_LEN - 1)];
+	}
+	return n;
+}
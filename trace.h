@@ -0,0 +1,151 @@
+/*	Target side application for the Rich Viewer.
+	Copyright (C) 2008 Supercomputing Systems AG
+
+	This library is free software; you can redistribute it and/or modify it
+	under the terms of the GNU Lesser General Public License as published by
+	the Free Software Foundation; either version 2.1 of the License, or (at
+	your option) any later version.
+
+	This library is distributed in the hope that it will be useful, but
+	WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser
+	General Public License for more details.
+
+	You should have received a copy of the GNU Lesser General Public License
+	along with this library; if not, write to the Free Software Foundation,
+	Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+/*! @file trace.h
+ * @brief Binary event trace of the main loop, the state machine and the
+ * communication.
+ *
+ * The trace points write a record of an event ID, the cycle count and an
+ * argument to a fixed-size ring, overwriting the oldest records. Tracing
+ * is always on; a trace point is a cycle count read, three stores and a
+ * check for the ring becoming full. The ring can be dumped with
+ * MSG_CMD_TRACE_DUMP to see what led up to e.g. a dropped frame.
+ */
+
+#ifndef TRACE_H
+#define TRACE_H
+
+#include "inc/oscar.h"
+
+/*! @brief Number of records in the ring (power of two). */
+#define TRACE_LEN 8192
+
+/*! @brief The events traced. */
+enum EnTraceEvent
+{
+	/*! @brief A phase of the main loop begins (EnTracePhase); it lasts
+	  until the next phase begins. */
+	TRACE_PHASE,
+	/*! @brief An event is thrown to the state machine
+	  (MainStateEvents). */
+	TRACE_HSM_EVENT,
+	/*! @brief The state machine has changed to another state
+	  (EnTraceState). */
+	TRACE_HSM_STATE,
+	/*! @brief A frame has been read (sequence number). */
+	TRACE_FRAME,
+	/*! @brief A capture has been set up (error code). */
+	TRACE_CAPTURE,
+	/*! @brief A connection has been accepted (TCP port). */
+	TRACE_ACCEPT,
+	/*! @brief A command has been received (message type). */
+	TRACE_COMMAND,
+	/*! @brief A command reply has been sent (message type). */
+	TRACE_REPLY,
+	/*! @brief A feed message has been passed to the communication
+	  (message type). */
+	TRACE_FEED_MSG,
+	/*! @brief Feed data has been written to the socket (bytes). */
+	TRACE_FEED_SEND,
+	/*! @brief Number of events. */
+	TRACE_EVENT_COUNT
+};
+
+/*! @brief The phases of the main loop. */
+enum EnTracePhase
+{
+	/*! @brief Accepting connections. */
+	TRACE_PH_ACCEPT,
+	/*! @brief Handling commands. */
+	TRACE_PH_COMMANDS,
+	/*! @brief Serving a snapshot request. */
+	TRACE_PH_SNAPSHOT,
+	/*! @brief Sending the feed. */
+	TRACE_PH_FEED,
+	/*! @brief Reading a frame. */
+	TRACE_PH_READ,
+	/*! @brief Processing before the next capture (FRAMESEQ_EVT). */
+	TRACE_PH_FRAMESEQ,
+	/*! @brief Setting up the next capture and triggering it. */
+	TRACE_PH_SETUP,
+	/*! @brief Processing in parallel to the next capture
+	  (FRAMEPAR_EVT). */
+	TRACE_PH_FRAMEPAR,
+	/*! @brief Number of phases. */
+	TRACE_PHASE_COUNT
+};
+
+/*! @brief The states of the main state machine. */
+enum EnTraceState
+{
+	TRACE_ST_IDLE,
+	TRACE_ST_CAPTURE,
+	TRACE_ST_INTERNAL,
+	TRACE_ST_EXTERNAL,
+	/*! @brief Number of states. */
+	TRACE_STATE_COUNT
+};
+
+/*! @brief A record of the trace. */
+struct TraceRec
+{
+	/*! @brief Cycle count at the event. */
+	uint64 cyc;
+	/*! @brief The event (EnTraceEvent). */
+	uint32 event;
+	/*! @brief Argument of the event. */
+	uint32 arg;
+};
+
+/*! @brief The trace ring. */
+struct TraceRing
+{
+	/*! @brief The records; record n is at n % TRACE_LEN. */
+	struct TraceRec recs[TRACE_LEN];
+	/*! @brief Number of records written since the start (wraps
+	  around). */
+	uint32 nRecs;
+	/*! @brief TRUE once all the records have been written, so the ring
+	  stays full when nRecs wraps around. */
+	bool bFull;
+};
+
+/*! @brief The trace ring of the application. */
+extern struct TraceRing traceRing;
+
+/*! @brief Write a trace record. */
+#define Trace_Add(ev, a) do {						\
+		struct TraceRec *pRec_ = &traceRing.recs[traceRing.nRecs & (TRACE_LEN - 1)]; \
+		if(++traceRing.nRecs == TRACE_LEN)			\
+		{							\
+			traceRing.bFull = TRUE;				\
+		}							\
+		pRec_->cyc = OscSupCycGet64();				\
+		pRec_->event = (ev);					\
+		pRec_->arg = (uint32)(a);				\
+	} while(0)
+
+/*********************************************************************//*!
+ * @brief Copy the records of the ring, oldest first.
+ *
+ * @param pRecs Buffer with room for TRACE_LEN records.
+ * @return Number of records copied.
+ *//*********************************************************************/
+uint32 Trace_Dump(struct TraceRec *pRecs);
+
+#endif /* TRACE_H */
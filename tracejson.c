@@ -0,0 +1,338 @@
+/*	Target side application for the Rich Viewer.
+	Copyright (C) 2008 Supercomputing Systems AG
+
+	This library is free software; you can redistribute it and/or modify it
+	under the terms of the GNU Lesser General Public License as published by
+	the Free Software Foundation; either version 2.1 of the License, or (at
+	your option) any later version.
+
+	This library is distributed in the hope that it will be useful, but
+	WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser
+	General Public License for more details.
+
+	You should have received a copy of the GNU Lesser General Public License
+	along with this library; if not, write to the Free Software Foundation,
+	Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+/*! @file tracejson.c
+ * @brief Host tool dumping the event trace of a running rich-view and
+ * converting it to the JSON trace event format (chrome://tracing,
+ * Perfetto).
+ *
+ * The phases of the main loop and the states of the state machine become
+ * slices lasting until the next phase or state; all other events become
+ * instant events carrying their argument. The events are put on three
+ * threads: the main loop, the state machine and the communication.
+ *
+ * Usage: rich-view-tracejson_host [-a address] [-o file]
+ */
+
+#include "rich-view.h"
+#include "trace.h"
+#include <arpa/inet.h>
+
+/*! @brief Thread IDs of the trace viewer. */
+enum EnTraceThread
+{
+	THREAD_LOOP = 1,
+	THREAD_HSM,
+	THREAD_COMM
+};
+
+/*! @brief Names of the phases of the main loop (EnTracePhase). */
+static const char *phaseNames[TRACE_PHASE_COUNT] =
+{
+	"accept",
+	"commands",
+	"snapshot",
+	"feed",
+	"read",
+	"frame seq",
+	"setup capture",
+	"frame par"
+};
+/*! @brief Names of the states (EnTraceState). */
+static const char *stateNames[TRACE_STATE_COUNT] =
+{
+	"idle",
+	"capture",
+	"internal",
+	"external"
+};
+/*! @brief Names of the events of the state machine (MainStateEvents). */
+static const char *hsmEventNames[] =
+{
+	"FRAMESEQ_EVT",
+	"FRAMEPAR_EVT",
+	"TRIGGER_EVT",
+	"CMD_GO_IDLE_EVT",
+	"CMD_GO_ACQ_EVT",
+	"CMD_USE_INTERN_TRIGGER_EVT",
+	"CMD_USE_EXTERN_TRIGGER_EVT"
+};
+/*! @brief Names of the other events (EnTraceEvent) and their threads. */
+static const struct
+{
+	const char *strName;
+	const char *strArg;
+	uint32 thread;
+} eventInfo[TRACE_EVENT_COUNT] =
+{
+	{ "phase", "phase", THREAD_LOOP },
+	{ "hsm event", "event", THREAD_HSM },
+	{ "state", "state", THREAD_HSM },
+	{ "frame", "seqNr", THREAD_LOOP },
+	{ "capture setup", "err", THREAD_LOOP },
+	{ "accept", "port", THREAD_COMM },
+	{ "command", "msgType", THREAD_COMM },
+	{ "reply", "msgType", THREAD_COMM },
+	{ "feed message", "msgType", THREAD_COMM },
+	{ "feed send", "bytes", THREAD_COMM }
+};
+
+/*********************************************************************//*!
+ * @brief Connect to a port of the target.
+ *
+ * @param strAddr IP address of the target.
+ * @param port Port number.
+ * @return The connected socket or -1.
+ *//*********************************************************************/
+static int Connect(const char *strAddr, int port)
+{
+	int sock;
+	struct sockaddr_in addr;
+
+	sock = socket(PF_INET, SOCK_STREAM, 0);
+	if(sock < 0)
+	{
+		return -1;
+	}
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons(port);
+	addr.sin_addr.s_addr = inet_addr(strAddr);
+	if(connect(sock, (struct sockaddr*)&addr, sizeof(addr)) != 0)
+	{
+		close(sock);
+		return -1;
+	}
+	return sock;
+}
+
+/*********************************************************************//*!
+ * @brief Receive exactly len bytes.
+ *
+ * @param sock The socket.
+ * @param pBuf Buffer to receive into.
+ * @param len Number of bytes.
+ * @return SUCCESS or -EDEVICE.
+ *//*********************************************************************/
+static OSC_ERR RecvAll(int sock, void *pBuf, uint32 len)
+{
+	uint8 *p = (uint8*)pBuf;
+	int retval;
+
+	while(len > 0)
+	{
+		retval = recv(sock, p, len, 0);
+		if(retval <= 0)
+		{
+			return -EDEVICE;
+		}
+		p += retval;
+		len -= retval;
+	}
+	return SUCCESS;
+}
+
+/*********************************************************************//*!
+ * @brief Dump the trace of the target.
+ *
+ * @param sock The command socket.
+ * @param pReply The reply header.
+ * @param ppRecs The records, to be freed by the caller.
+ * @return SUCCESS or an appropriate error code.
+ *//*********************************************************************/
+static OSC_ERR DumpTrace(int sock, struct MsgHdr *pReply, struct TraceRec **ppRecs)
+{
+	struct MsgHdr hdr;
+
+	memset(&hdr, 0, sizeof(hdr));
+	hdr.msgType = MSG_CMD_TRACE_DUMP;
+	hdr.status = STATUS_REQUEST;
+	if(send(sock, &hdr, sizeof(hdr), 0) != sizeof(hdr) ||
+	   RecvAll(sock, pReply, sizeof(struct MsgHdr)) != SUCCESS)
+	{
+		return -EDEVICE;
+	}
+	if(pReply->status != STATUS_REPLY_SUCC ||
+	   pReply->bodyLength != pReply->msgParams.traceDumpReply.nRecs*sizeof(struct TraceRec) ||
+	   pReply->msgParams.traceDumpReply.cycPerMs == 0)
+	{
+		return -EDEVICE;
+	}
+	*ppRecs = malloc(pReply->bodyLength + 1);
+	if(*ppRecs == NULL)
+	{
+		return -EOUT_OF_MEMORY;
+	}
+	return RecvAll(sock, *ppRecs, pReply->bodyLength);
+}
+
+/*********************************************************************//*!
+ * @brief Write a slice lasting from one record to another.
+ *
+ * @param pFile The output file.
+ * @param strName Name of the slice.
+ * @param thread The thread (EnTraceThread).
+ * @param pRec The record starting the slice.
+ * @param pEnd The record ending it.
+ * @param pFirst The first record (time 0).
+ * @param cycPerMs Cycles per millisecond.
+ *//*********************************************************************/
+static void WriteSlice(FILE *pFile, const char *strName, uint32 thread,
+		       const struct TraceRec *pRec, const struct TraceRec *pEnd,
+		       const struct TraceRec *pFirst, uint32 cycPerMs)
+{
+	fprintf(pFile, ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,"
+		"\"ts\":%.3f,\"dur\":%.3f}",
+		strName, thread,
+		(double)(pRec->cyc - pFirst->cyc)*1000/cycPerMs,
+		(double)(pEnd->cyc - pRec->cyc)*1000/cycPerMs);
+}
+
+/*********************************************************************//*!
+ * @brief Write the records as JSON trace events.
+ *
+ * @param pFile The output file.
+ * @param pRecs The records, oldest first.
+ * @param nRecs Number of records.
+ * @param cycPerMs Cycles per millisecond.
+ *//*********************************************************************/
+static void WriteJson(FILE *pFile, const struct TraceRec *pRecs, uint32 nRecs, uint32 cycPerMs)
+{
+	const struct TraceRec *pRec, *pPhase = NULL, *pState = NULL;
+	uint32 i;
+
+	fprintf(pFile, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n"
+		"{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"args\":{\"name\":\"rich-view\"}},\n"
+		"{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"main loop\"}},\n"
+		"{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"state machine\"}},\n"
+		"{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"communication\"}}",
+		THREAD_LOOP, THREAD_HSM, THREAD_COMM);
+
+	for(i = 0; i < nRecs; i++)
+	{
+		pRec = &pRecs[i];
+		if(pRec->event >= TRACE_EVENT_COUNT)
+		{
+			continue;
+		}
+		switch(pRec->event)
+		{
+		case TRACE_PHASE:
+			if(pPhase != NULL)
+			{
+				WriteSlice(pFile, phaseNames[pPhase->arg], THREAD_LOOP,
+					   pPhase, pRec, pRecs, cycPerMs);
+			}
+			pPhase = pRec->arg < TRACE_PHASE_COUNT ? pRec : NULL;
+			break;
+		case TRACE_HSM_STATE:
+			if(pState != NULL)
+			{
+				WriteSlice(pFile, stateNames[pState->arg], THREAD_HSM,
+					   pState, pRec, pRecs, cycPerMs);
+			}
+			pState = pRec->arg < TRACE_STATE_COUNT ? pRec : NULL;
+			break;
+		default:
+			fprintf(pFile, ",\n{\"name\":\"%s\",\"ph\":\"i\",\"s\":\"t\",\"pid\":1,"
+				"\"tid\":%d,\"ts\":%.3f,\"args\":{\"%s\":%d}}",
+				pRec->event == TRACE_HSM_EVENT &&
+				pRec->arg < sizeof(hsmEventNames)/sizeof(hsmEventNames[0]) ?
+				hsmEventNames[pRec->arg] : eventInfo[pRec->event].strName,
+				eventInfo[pRec->event].thread,
+				(double)(pRec->cyc - pRecs->cyc)*1000/cycPerMs,
+				eventInfo[pRec->event].strArg, (int32)pRec->arg);
+		}
+	}
+
+	/* The current phase and state last until the end of the trace. */
+	if(pPhase != NULL)
+	{
+		WriteSlice(pFile, phaseNames[pPhase->arg], THREAD_LOOP,
+			   pPhase, &pRecs[nRecs - 1], pRecs, cycPerMs);
+	}
+	if(pState != NULL)
+	{
+		WriteSlice(pFile, stateNames[pState->arg], THREAD_HSM,
+			   pState, &pRecs[nRecs - 1], pRecs, cycPerMs);
+	}
+	fprintf(pFile, "\n]}\n");
+}
+
+int main(const int argc, const char * argv[])
+{
+	const char *strAddr = "127.0.0.1";
+	const char *strOut = NULL;
+	struct MsgHdr reply;
+	struct TraceRec *pRecs;
+	FILE *pFile = stdout;
+	int i, sock;
+
+	for(i = 1; i + 1 < argc; i += 2)
+	{
+		if(strcmp(argv[i], "-a") == 0)
+		{
+			strAddr = argv[i + 1];
+		} else if(strcmp(argv[i], "-o") == 0)
+		{
+			strOut = argv[i + 1];
+		} else {
+			break;
+		}
+	}
+	if(i < argc)
+	{
+		fprintf(stderr, "Usage: %s [-a address] [-o file]\n", argv[0]);
+		return 1;
+	}
+
+	sock = Connect(strAddr, TCP_CMD_PORT);
+	if(sock < 0)
+	{
+		fprintf(stderr, "Unable to connect to %s:%d.\n", strAddr, TCP_CMD_PORT);
+		return 1;
+	}
+	if(DumpTrace(sock, &reply, &pRecs) != SUCCESS)
+	{
+		fprintf(stderr, "Unable to dump the trace.\n");
+		return 1;
+	}
+	close(sock);
+
+	if(strOut != NULL)
+	{
+		pFile = fopen(strOut, "w");
+		if(pFile == NULL)
+		{
+			fprintf(stderr, "Unable to open %s.\n", strOut);
+			return 1;
+		}
+	}
+	WriteJson(pFile, pRecs, reply.msgParams.traceDumpReply.nRecs,
+		  reply.msgParams.traceDumpReply.cycPerMs);
+	if(pFile != stdout)
+	{
+		fclose(pFile);
+	}
+	fprintf(stderr, "%d of %d events, %d overwritten.\n",
+		reply.msgParams.traceDumpReply.nRecs,
+		reply.msgParams.traceDumpReply.nTotal,
+		reply.msgParams.traceDumpReply.nTotal - reply.msgParams.traceDumpReply.nRecs);
+	free(pRecs);
+	return 0;
+}
@@ -0,0 +1,182 @@
+/*	Target side application for the Rich Viewer.
+	Copyright (C) 2008 Supercomputing Systems AG
+
+	This library is free software; you can redistribute it and/or modify it
+	under the terms of the GNU Lesser General Public License as published by
+	the Free Software Foundation; either version 2.1 of the License, or (at
+	your option) any later version.
+
+	This library is distributed in the hope that it will be useful, but
+	WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser
+	General Public License for more details.
+
+	You should have received a copy of the GNU Lesser General Public License
+	along with this library; if not, write to the Free Software Foundation,
+	Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+/*! @file trigger.c
+ * @brief Scheduler for the self-triggering implementation.
+ */
+
+#include "trigger.h"
+#include <string.h>
+#include <unistd.h>
+#include <sched.h>
+
+/*! @brief Time before the trigger up to which the poll sleeps (us). The
+ * rest is waited with yields, as the OS wakes the sleepers late. */
+#define TRIG_SLEEP_MARGIN_US 2000
+
+void Trig_Init(struct TrigSched *pSched, uint32 blankUs, uint32 pollUs)
+{
+	memset(pSched, 0, sizeof(struct TrigSched));
+	pSched->blankCyc = Timing_UsToCyc(blankUs);
+	pSched->pollCyc = Timing_UsToCyc(pollUs);
+}
+
+void Trig_SetFrameRate(struct TrigSched *pSched, uint32 milliHz)
+{
+	if(milliHz == 0)
+	{
+		pSched->periodCyc = 0;
+	} else {
+		pSched->periodCyc = Timing_UsToCyc(1000000)*1000/milliHz;
+	}
+	/* Start a new grid with the next trigger. */
+	pSched->lastDue = 0;
+	pSched->lastFrame = 0;
+	pSched->lastSend = 0;
+}
+
+/*********************************************************************//*!
+ * @brief Record the deviation of an interval from the slot grid.
+ *
+ * The interval may span several slots if slots have been skipped.
+ *
+ * @param pSched Pointer to the scheduler.
+ * @param pStat Pointer to the deviation statistics.
+ * @param last Cycle count of the last event.
+ * @param now Cycle count of this event.
+ *//*********************************************************************/
+static void Trig_GridDev(struct TrigSched *pSched,
+			 struct DevStat *pStat,
+			 uint64 last,
+			 uint64 now)
+{
+	uint64 nSlots;
+
+	if(pSched->periodCyc == 0 || last == 0 || now < last)
+	{
+		return;
+	}
+	nSlots = (now - last + pSched->periodCyc/2)/pSched->periodCyc;
+	if(nSlots == 0)
+	{
+		nSlots = 1;
+	}
+	Timing_DevAdd(pStat, now, last + nSlots*pSched->periodCyc);
+}
+
+void Trig_Arm(struct TrigSched *pSched, uint64 frameCyc)
+{
+	uint64 earliest, nMissed;
+
+	/* The sensor must not be triggered during the vertical blank. */
+	earliest = frameCyc + pSched->blankCyc;
+
+	if(pSched->periodCyc == 0 || pSched->lastDue == 0)
+	{
+		pSched->due = earliest;
+	} else {
+		/* Next slot of the grid; skip the slots that can no longer
+		 * be met. */
+		pSched->due = pSched->lastDue + pSched->periodCyc;
+		if(pSched->due < earliest)
+		{
+			nMissed = (earliest - pSched->due + pSched->periodCyc - 1)/pSched->periodCyc;
+			pSched->due += nMissed*pSched->periodCyc;
+			pSched->nSkipped += (uint32)nMissed;
+		}
+	}
+	pSched->bArmed = TRUE;
+}
+
+bool Trig_Poll(struct TrigSched *pSched)
+{
+	uint64 now, marginCyc;
+
+	if(!pSched->bArmed)
+	{
+		return FALSE;
+	}
+
+	if(OscSupCycGet64() + pSched->pollCyc + pSched->busyCyc < pSched->due)
+	{
+		/* We will be called again before the trigger is due, even if
+		 * a frame is processed in between. */
+		return FALSE;
+	}
+
+	/* Sleep in slices for the bulk of the wait, then give up the CPU
+	 * until the planned time instead of spinning on it. */
+	marginCyc = Timing_UsToCyc(TRIG_SLEEP_MARGIN_US);
+	now = OscSupCycGet64();
+	while(now < pSched->due)
+	{
+		if(pSched->due - now > marginCyc)
+		{
+			usleep(Timing_CycToUs(pSched->due - now - marginCyc));
+		} else {
+			sched_yield();
+		}
+		now = OscSupCycGet64();
+	}
+	return TRUE;
+}
+
+void Trig_SetBusy(struct TrigSched *pSched, uint64 busyCyc)
+{
+	/* Decay by 1/8 per frame. */
+	pSched->busyCyc -= pSched->busyCyc >> 3;
+	if(busyCyc > pSched->busyCyc)
+	{
+		pSched->busyCyc = busyCyc;
+	}
+}
+
+void Trig_FrameReceived(struct TrigSched *pSched, uint64 now)
+{
+	Trig_GridDev(pSched, &pSched->frameDev, pSched->lastFrame, now);
+	pSched->lastFrame = now;
+}
+
+void Trig_SendStarted(struct TrigSched *pSched, uint64 now)
+{
+	Trig_GridDev(pSched, &pSched->sendDev, pSched->lastSend, now);
+	pSched->lastSend = now;
+}
+
+void Trig_ResetStats(struct TrigSched *pSched)
+{
+	memset(&pSched->jitter, 0, sizeof(pSched->jitter));
+	memset(&pSched->frameDev, 0, sizeof(pSched->frameDev));
+	memset(&pSched->sendDev, 0, sizeof(pSched->sendDev));
+	pSched->nSkipped = 0;
+}
+
+void Trig_Fired(struct TrigSched *pSched, uint64 now)
+{
+	if(pSched->bArmed)
+	{
+		Timing_DevAdd(&pSched->jitter, now, pSched->due);
+		pSched->lastDue = pSched->due;
+	} else {
+		/* Triggered without a plan (first trigger), start a new grid. */
+		pSched->lastDue = now;
+		pSched->lastFrame = 0;
+		pSched->lastSend = 0;
+	}
+	pSched->bArmed = FALSE;
+}
@@ -0,0 +1,155 @@
+/*	Target side application for the Rich Viewer.
+	Copyright (C) 2008 Supercomputing Systems AG
+
+	This library is free software; you can redistribute it and/or modify it
+	under the terms of the GNU Lesser General Public License as published by
+	the Free Software Foundation; either version 2.1 of the License, or (at
+	your option) any later version.
+
+	This library is distributed in the hope that it will be useful, but
+	WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser
+	General Public License for more details.
+
+	You should have received a copy of the GNU Lesser General Public License
+	along with this library; if not, write to the Free Software Foundation,
+	Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+/*! @file trigger.h
+ * @brief Scheduler for the self-triggering (internal trigger mode).
+ *
+ * After a frame has been read and the next capture has been set up, the
+ * scheduler decides when the next trigger is fired: Either at the
+ * earliest moment after the vertical blank time of the sensor or at a
+ * fixed frame rate.
+ *
+ * At a fixed frame rate, the triggers are placed on a grid of time slots
+ * one period apart. If a slot cannot be met, it is skipped instead of
+ * firing the trigger late, so the frames that are captured and sent stay
+ * evenly spaced.
+ */
+
+#ifndef TRIGGER_H
+#define TRIGGER_H
+
+#include "timing.h"
+
+/*! @brief State of the trigger scheduler. */
+struct TrigSched
+{
+	/*! @brief Minimum time between the end of a frame and the next
+	  trigger (cycles). */
+	uint64 blankCyc;
+	/*! @brief Longest time between two polls of the scheduler when no
+	  frame is processed (cycles). */
+	uint64 pollCyc;
+	/*! @brief Estimated time the processing of a frame blocks the polls
+	  (cycles). */
+	uint64 busyCyc;
+	/*! @brief Trigger period (cycles) or 0 to trigger as fast as possible. */
+	uint64 periodCyc;
+	/*! @brief TRUE if a capture has been set up but not yet triggered. */
+	bool bArmed;
+	/*! @brief Cycle count at which the next trigger is planned. */
+	uint64 due;
+	/*! @brief Cycle count at which the last trigger was planned. */
+	uint64 lastDue;
+	/*! @brief Cycle count at which the last frame was received. */
+	uint64 lastFrame;
+	/*! @brief Cycle count at which sending of the last frame started. */
+	uint64 lastSend;
+
+	/*! @brief Deviation of the triggers from the planned time. */
+	struct DevStat jitter;
+	/*! @brief Deviation of the frame intervals from the grid. */
+	struct DevStat frameDev;
+	/*! @brief Deviation of the send intervals from the grid. */
+	struct DevStat sendDev;
+	/*! @brief Number of time slots that had to be skipped. */
+	uint32 nSkipped;
+};
+
+/*********************************************************************//*!
+ * @brief Initialize the trigger scheduler.
+ *
+ * @param pSched Pointer to the scheduler.
+ * @param blankUs Vertical blank time of the sensor (us).
+ * @param pollUs Longest time between two calls of Trig_Poll (us).
+ *//*********************************************************************/
+void Trig_Init(struct TrigSched *pSched, uint32 blankUs, uint32 pollUs);
+
+/*********************************************************************//*!
+ * @brief Set the target frame rate.
+ *
+ * @param pSched Pointer to the scheduler.
+ * @param milliHz Frame rate in frames per 1000 s or 0 to trigger as fast
+ *                as the sensor allows.
+ *//*********************************************************************/
+void Trig_SetFrameRate(struct TrigSched *pSched, uint32 milliHz);
+
+/*********************************************************************//*!
+ * @brief Plan the trigger for a capture that has just been set up.
+ *
+ * @param pSched Pointer to the scheduler.
+ * @param frameCyc Cycle count at which the previous frame was received.
+ *//*********************************************************************/
+void Trig_Arm(struct TrigSched *pSched, uint64 frameCyc);
+
+/*********************************************************************//*!
+ * @brief Check whether the planned trigger has to be fired now.
+ *
+ * If the trigger is due before the next poll, this function waits for
+ * the planned time. It sleeps until shortly before and yields the CPU for
+ * the rest, as the scheduler of the OS wakes sleepers with a granularity
+ * of several milliseconds.
+ *
+ * @param pSched Pointer to the scheduler.
+ * @return TRUE if the caller has to fire the trigger now.
+ *//*********************************************************************/
+bool Trig_Poll(struct TrigSched *pSched);
+
+/*********************************************************************//*!
+ * @brief Set the time the last frame processing blocked the polls.
+ *
+ * The scheduler waits for a trigger that would otherwise become due
+ * while a frame is processed. Long processing times are remembered and
+ * decay slowly.
+ *
+ * @param pSched Pointer to the scheduler.
+ * @param busyCyc Time the processing took (cycles).
+ *//*********************************************************************/
+void Trig_SetBusy(struct TrigSched *pSched, uint64 busyCyc);
+
+/*********************************************************************//*!
+ * @brief Record the reception of a frame for the deviation statistics.
+ *
+ * @param pSched Pointer to the scheduler.
+ * @param now Cycle count at which the frame was received.
+ *//*********************************************************************/
+void Trig_FrameReceived(struct TrigSched *pSched, uint64 now);
+
+/*********************************************************************//*!
+ * @brief Record the start of sending a frame for the deviation statistics.
+ *
+ * @param pSched Pointer to the scheduler.
+ * @param now Cycle count at which sending started.
+ *//*********************************************************************/
+void Trig_SendStarted(struct TrigSched *pSched, uint64 now);
+
+/*********************************************************************//*!
+ * @brief Reset all deviation statistics.
+ *
+ * @param pSched Pointer to the scheduler.
+ *//*********************************************************************/
+void Trig_ResetStats(struct TrigSched *pSched);
+
+/*********************************************************************//*!
+ * @brief Record that the trigger has been fired.
+ *
+ * @param pSched Pointer to the scheduler.
+ * @param now Cycle count at which the trigger was fired.
+ *//*********************************************************************/
+void Trig_Fired(struct TrigSched *pSched, uint64 now);
+
+#endif /* TRIGGER_H */
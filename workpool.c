@@ -0,0 +1,353 @@
+/*	Target side application for the Rich Viewer.
+	Copyright (C) 2008 Supercomputing Systems AG
+
+	This library is free software; you can redistribute it and/or modify it
+	under the terms of the GNU Lesser General Public License as published by
+	the Free Software Foundation; either version 2.1 of the License, or (at
+	your option) any later version.
+
+	This library is distributed in the hope that it will be useful, but
+	WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser
+	General Public License for more details.
+
+	You should have received a copy of the GNU Lesser General Public License
+	along with this library; if not, write to the Free Software Foundation,
+	Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+/*! @file workpool.c
+ * @brief Worker pool implementation.
+ */
+
+#include "workpool.h"
+
+/*********************************************************************//*!
+ * @brief Process the tiles of a job in the calling thread.
+ *
+ * @param pJob Pointer to the job.
+ * @param worker Index of the worker.
+ * @param first First tile to process.
+ * @param end Tile after the last tile to process.
+ *//*********************************************************************/
+static void Pool_RunTiles(const struct TileJob *pJob,
+			  uint32 worker,
+			  uint32 first,
+			  uint32 end)
+{
+	uint32 tile, yEnd;
+
+	for(tile = first; tile < end; tile++)
+	{
+		yEnd = (tile + 1)*pJob->tileRows;
+		if(yEnd > pJob->nRows)
+		{
+			yEnd = pJob->nRows;
+		}
+		pJob->pfTile(pJob->pArg, worker, tile*pJob->tileRows, yEnd);
+	}
+}
+
+#ifdef OSC_HOST
+
+#include <pthread.h>
+#include <unistd.h>
+
+/*! @brief The range of tiles still to be processed by one worker. */
+struct PoolQueue
+{
+	/*! @brief Protects next and end. */
+	pthread_mutex_t lock;
+	/*! @brief Next tile to be processed by the owner. */
+	uint32 next;
+	/*! @brief Tile after the last tile of the range. Thieves take
+	  tiles from this end. */
+	uint32 end;
+	/*! @brief Keeps the queues of different workers in different cache
+	  lines. */
+	uint8 pad[64];
+};
+
+/*! @brief The state of the worker pool. */
+static struct
+{
+	/*! @brief Number of workers including the calling thread. */
+	uint32 nWorkers;
+	/*! @brief The worker threads (index 0 is unused). */
+	pthread_t threads[POOL_MAX_WORKERS];
+	/*! @brief The tile range of each worker. */
+	struct PoolQueue queues[POOL_MAX_WORKERS];
+
+	/*! @brief Protects the members below. */
+	pthread_mutex_t lock;
+	/*! @brief Signals a new job or shutdown to the workers. */
+	pthread_cond_t start;
+	/*! @brief Signals the completion of the last worker. */
+	pthread_cond_t done;
+	/*! @brief Incremented for every job. */
+	uint32 generation;
+	/*! @brief Number of worker threads still working on the job. */
+	uint32 nBusy;
+	/*! @brief TRUE if the worker threads shall terminate. */
+	bool bQuit;
+	/*! @brief The current job. */
+	const struct TileJob *pJob;
+} pool = { 1 };
+
+/*********************************************************************//*!
+ * @brief Take the next tile from the own range or steal from others.
+ *
+ * @param worker Index of the worker.
+ * @param pTile The tile to be processed.
+ * @return TRUE if a tile has been found, FALSE if the job is done.
+ *//*********************************************************************/
+static bool Pool_NextTile(uint32 worker, uint32 *pTile)
+{
+	struct PoolQueue *pOwn = &pool.queues[worker];
+	struct PoolQueue *pVictim;
+	uint32 i, victim, remaining, most, mid, end;
+
+	pthread_mutex_lock(&pOwn->lock);
+	if(pOwn->next < pOwn->end)
+	{
+		*pTile = pOwn->next++;
+		pthread_mutex_unlock(&pOwn->lock);
+		return TRUE;
+	}
+	pthread_mutex_unlock(&pOwn->lock);
+
+	for(;;)
+	{
+		/* Find the worker with the most tiles left. The count may have
+		 * changed when the victim is locked again below. */
+		most = 0;
+		victim = worker;
+		for(i = 0; i < pool.nWorkers; i++)
+		{
+			if(i == worker)
+			{
+				continue;
+			}
+			pthread_mutex_lock(&pool.queues[i].lock);
+			remaining = pool.queues[i].end - pool.queues[i].next;
+			if(pool.queues[i].next >= pool.queues[i].end)
+			{
+				remaining = 0;
+			}
+			pthread_mutex_unlock(&pool.queues[i].lock);
+			if(remaining > most)
+			{
+				most = remaining;
+				victim = i;
+			}
+		}
+		if(victim == worker)
+		{
+			return FALSE;
+		}
+
+		/* Steal the upper half of its range. */
+		pVictim = &pool.queues[victim];
+		pthread_mutex_lock(&pVictim->lock);
+		if(pVictim->next >= pVictim->end)
+		{
+			pthread_mutex_unlock(&pVictim->lock);
+			continue;
+		}
+		end = pVictim->end;
+		mid = pVictim->next + (end - pVictim->next)/2;
+		pVictim->end = mid;
+		pthread_mutex_unlock(&pVictim->lock);
+
+		/* Process the first stolen tile and offer the rest to others. */
+		pthread_mutex_lock(&pOwn->lock);
+		pOwn->next = mid + 1;
+		pOwn->end = end;
+		pthread_mutex_unlock(&pOwn->lock);
+		*pTile = mid;
+		return TRUE;
+	}
+}
+
+/*********************************************************************//*!
+ * @brief Process tiles of the current job until all are done.
+ *
+ * @param worker Index of the worker.
+ *//*********************************************************************/
+static void Pool_Work(uint32 worker)
+{
+	uint32 tile;
+
+	while(Pool_NextTile(worker, &tile))
+	{
+		Pool_RunTiles(pool.pJob, worker, tile, tile + 1);
+	}
+}
+
+/*********************************************************************//*!
+ * @brief Main function of the worker threads.
+ *
+ * @param pArg Index of the worker.
+ * @return NULL
+ *//*********************************************************************/
+static void* Pool_Thread(void *pArg)
+{
+	uint32 worker = (uint32)(unsigned long)pArg;
+	uint32 generation = 0;
+
+	for(;;)
+	{
+		pthread_mutex_lock(&pool.lock);
+		while(pool.generation == generation && !pool.bQuit)
+		{
+			pthread_cond_wait(&pool.start, &pool.lock);
+		}
+		if(pool.bQuit)
+		{
+			pthread_mutex_unlock(&pool.lock);
+			return NULL;
+		}
+		generation = pool.generation;
+		pthread_mutex_unlock(&pool.lock);
+
+		Pool_Work(worker);
+
+		pthread_mutex_lock(&pool.lock);
+		if(--pool.nBusy == 0)
+		{
+			pthread_cond_signal(&pool.done);
+		}
+		pthread_mutex_unlock(&pool.lock);
+	}
+}
+
+OSC_ERR Pool_Init(uint32 nWorkers)
+{
+	uint32 i;
+	long nCpus;
+
+	if(pool.nWorkers > 1)
+	{
+		return -EALREADY_INITIALIZED;
+	}
+
+	if(nWorkers == 0)
+	{
+		nCpus = sysconf(_SC_NPROCESSORS_ONLN);
+		nWorkers = nCpus > 0 ? (uint32)nCpus : 1;
+	}
+	if(nWorkers > POOL_MAX_WORKERS)
+	{
+		nWorkers = POOL_MAX_WORKERS;
+	}
+
+	pthread_mutex_init(&pool.lock, NULL);
+	pthread_cond_init(&pool.start, NULL);
+	pthread_cond_init(&pool.done, NULL);
+	pool.generation = 0;
+	pool.bQuit = FALSE;
+	for(i = 0; i < POOL_MAX_WORKERS; i++)
+	{
+		pthread_mutex_init(&pool.queues[i].lock, NULL);
+		pool.queues[i].next = pool.queues[i].end = 0;
+	}
+
+	pool.nWorkers = 1;
+	for(i = 1; i < nWorkers; i++)
+	{
+		if(pthread_create(&pool.threads[i], NULL, Pool_Thread,
+				  (void*)(unsigned long)i) != 0)
+		{
+			OscLog(WARN, "%s: Unable to start worker %d, using %d workers.\n",
+			       __func__, i, pool.nWorkers);
+			break;
+		}
+		pool.nWorkers++;
+	}
+	OscLog(INFO, "%s: %d workers.\n", __func__, pool.nWorkers);
+	return SUCCESS;
+}
+
+void Pool_DeInit(void)
+{
+	uint32 i;
+
+	if(pool.nWorkers <= 1)
+	{
+		return;
+	}
+
+	pthread_mutex_lock(&pool.lock);
+	pool.bQuit = TRUE;
+	pthread_cond_broadcast(&pool.start);
+	pthread_mutex_unlock(&pool.lock);
+
+	for(i = 1; i < pool.nWorkers; i++)
+	{
+		pthread_join(pool.threads[i], NULL);
+	}
+	pool.nWorkers = 1;
+}
+
+uint32 Pool_Workers(void)
+{
+	return pool.nWorkers;
+}
+
+void Pool_Run(const struct TileJob *pJob)
+{
+	uint32 i, nTiles;
+
+	nTiles = (pJob->nRows + pJob->tileRows - 1)/pJob->tileRows;
+	if(pool.nWorkers <= 1 || nTiles <= 1)
+	{
+		Pool_RunTiles(pJob, 0, 0, nTiles);
+		return;
+	}
+
+	/* Every worker starts with an equal contiguous share. */
+	for(i = 0; i < pool.nWorkers; i++)
+	{
+		pool.queues[i].next = (nTiles*i)/pool.nWorkers;
+		pool.queues[i].end = (nTiles*(i + 1))/pool.nWorkers;
+	}
+
+	pthread_mutex_lock(&pool.lock);
+	pool.pJob = pJob;
+	pool.nBusy = pool.nWorkers - 1;
+	pool.generation++;
+	pthread_cond_broadcast(&pool.start);
+	pthread_mutex_unlock(&pool.lock);
+
+	Pool_Work(0);
+
+	pthread_mutex_lock(&pool.lock);
+	while(pool.nBusy > 0)
+	{
+		pthread_cond_wait(&pool.done, &pool.lock);
+	}
+	pthread_mutex_unlock(&pool.lock);
+}
+
+#else /* OSC_HOST */
+
+OSC_ERR Pool_Init(uint32 nWorkers)
+{
+	return SUCCESS;
+}
+
+void Pool_DeInit(void)
+{
+}
+
+uint32 Pool_Workers(void)
+{
+	return 1;
+}
+
+void Pool_Run(const struct TileJob *pJob)
+{
+	Pool_RunTiles(pJob, 0, 0, (pJob->nRows + pJob->tileRows - 1)/pJob->tileRows);
+}
+
+#endif /* OSC_HOST */
@@ -0,0 +1,100 @@
+/*	Target side application for the Rich Viewer.
+	Copyright (C) 2008 Supercomputing Systems AG
+
+	This library is free software; you can redistribute it and/or modify it
+	under the terms of the GNU Lesser General Public License as published by
+	the Free Software Foundation; either version 2.1 of the License, or (at
+	your option) any later version.
+
+	This library is distributed in the hope that it will be useful, but
+	WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser
+	General Public License for more details.
+
+	You should have received a copy of the GNU Lesser General Public License
+	along with this library; if not, write to the Free Software Foundation,
+	Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+/*! @file workpool.h
+ * @brief Worker pool processing images in tiles of rows.
+ *
+ * A processing stage describes its work as a tile job: A function that
+ * processes a range of rows and the number of rows per tile. On the host
+ * the tiles are distributed over a pool of threads with work stealing:
+ * Every worker starts with a contiguous range of tiles and steals half of
+ * the remaining range of the busiest worker once its own range is done.
+ * On the target, which has a single core, the tiles are processed in
+ * order by the calling thread.
+ */
+
+#ifndef WORKPOOL_H
+#define WORKPOOL_H
+
+#include "inc/oscar.h"
+
+#ifdef OSC_HOST
+/*! @brief Maximum number of workers (including the calling thread). */
+#define POOL_MAX_WORKERS 16
+#else
+#define POOL_MAX_WORKERS 1
+#endif /* OSC_HOST */
+
+/*********************************************************************//*!
+ * @brief Function processing one tile of a job.
+ *
+ * @param pArg The argument of the job.
+ * @param worker Index of the worker processing the tile
+ *               (0 .. POOL_MAX_WORKERS-1). May be used to select
+ *               per-worker scratch memory.
+ * @param yStart First row of the tile.
+ * @param yEnd Row after the last row of the tile.
+ *//*********************************************************************/
+typedef void (*TileFunc)(void *pArg, uint32 worker, uint32 yStart, uint32 yEnd);
+
+/*! @brief A job split into tiles of rows. */
+struct TileJob
+{
+	/*! @brief Function processing one tile. */
+	TileFunc pfTile;
+	/*! @brief Argument passed to pfTile. */
+	void *pArg;
+	/*! @brief Total number of rows. */
+	uint32 nRows;
+	/*! @brief Number of rows per tile. Stages with alignment
+	  requirements choose a multiple of their alignment here. */
+	uint32 tileRows;
+};
+
+/*********************************************************************//*!
+ * @brief Start the worker threads.
+ *
+ * @param nWorkers Number of workers including the calling thread, or 0
+ *                 for one worker per online CPU.
+ * @return SUCCESS or an appropriate error code.
+ *//*********************************************************************/
+OSC_ERR Pool_Init(uint32 nWorkers);
+
+/*********************************************************************//*!
+ * @brief Stop the worker threads.
+ *//*********************************************************************/
+void Pool_DeInit(void);
+
+/*********************************************************************//*!
+ * @brief Get the number of workers including the calling thread.
+ *
+ * @return The number of workers.
+ *//*********************************************************************/
+uint32 Pool_Workers(void);
+
+/*********************************************************************//*!
+ * @brief Process all tiles of a job.
+ *
+ * The calling thread takes part as worker 0. Returns when all tiles have
+ * been processed.
+ *
+ * @param pJob Pointer to the job.
+ *//*********************************************************************/
+void Pool_Run(const struct TileJob *pJob);
+
+#endif /* WORKPOOL_H */